@@ -0,0 +1,81 @@
+#include "AsyncLogSink.h"
+
+#include <chrono>
+
+namespace faf {
+
+AsyncLogSink::AsyncLogSink(std::unique_ptr<rtc::LogSink> target):
+  _target(std::move(target)),
+  _queue(std::make_unique<MpscRing<std::string, queueSize>>())
+{
+  _writer = std::thread(&AsyncLogSink::_run, this);
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+  _stopping.store(true);
+  {
+    std::lock_guard<std::mutex> lock(_wakeupMutex);
+    _wakeup.notify_one();
+  }
+  _writer.join();
+}
+
+void AsyncLogSink::OnLogMessage(std::string const& message)
+{
+  std::string record(message);
+  if (!_queue->tryPush(std::move(record)))
+  {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (_writerWaiting.load(std::memory_order_relaxed))
+  {
+    _wakeup.notify_one();
+  }
+}
+
+std::uint64_t AsyncLogSink::droppedMessages() const
+{
+  return _dropped.load(std::memory_order_relaxed);
+}
+
+std::uint64_t AsyncLogSink::writtenMessages() const
+{
+  return _written.load(std::memory_order_relaxed);
+}
+
+void AsyncLogSink::_run()
+{
+  while (!_stopping.load())
+  {
+    _drain();
+    std::unique_lock<std::mutex> lock(_wakeupMutex);
+    _writerWaiting.store(true);
+    _wakeup.wait_for(lock, std::chrono::milliseconds(maxWriterSleepMs), [this]()
+    {
+      return _stopping.load() || !_queue->empty();
+    });
+    _writerWaiting.store(false);
+  }
+  _drain();
+}
+
+void AsyncLogSink::_drain()
+{
+  std::string record;
+  while (_queue->tryPop(record))
+  {
+    _target->OnLogMessage(record);
+    _written.fetch_add(1, std::memory_order_relaxed);
+  }
+  auto dropped = _dropped.load(std::memory_order_relaxed);
+  if (dropped != _reportedDropped)
+  {
+    /* bypasses RTC_LOG, which would queue the report behind the records it is about */
+    _target->OnLogMessage("[warn] FAF: log queue full, dropped " + std::to_string(dropped - _reportedDropped) + " messages\n");
+    _reportedDropped = dropped;
+  }
+}
+
+} // namespace faf
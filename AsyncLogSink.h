@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <webrtc/rtc_base/logging.h>
+
+#include "MpscRing.h"
+
+namespace faf {
+
+/*! \brief Log sink which hands records to a writer thread
+ *
+ *  Logging threads only move the formatted record into a lock-free ring,
+ *  the writer thread passes it on to the wrapped sink, which may block
+ *  on file I/O and rotation. Records are dropped and counted when the
+ *  ring is full, the writer reports the drops in the log.
+ */
+class AsyncLogSink : public rtc::LogSink
+{
+public:
+  AsyncLogSink(std::unique_ptr<rtc::LogSink> target);
+  /* writes all queued records before returning */
+  virtual ~AsyncLogSink();
+
+  void OnLogMessage(std::string const& message) override;
+
+  std::uint64_t droppedMessages() const;
+  std::uint64_t writtenMessages() const;
+
+  static constexpr std::size_t queueSize = 4096;
+
+protected:
+  void _run();
+  void _drain();
+
+  std::unique_ptr<rtc::LogSink> _target;
+  std::unique_ptr<MpscRing<std::string, queueSize>> _queue;
+  std::atomic<std::uint64_t> _dropped{0};
+  std::atomic<std::uint64_t> _written{0};
+  std::uint64_t _reportedDropped{0};
+  std::atomic<bool> _writerWaiting{false};
+  std::atomic<bool> _stopping{false};
+  std::mutex _wakeupMutex;
+  std::condition_variable _wakeup;
+  std::thread _writer;
+
+  /* bounds the delay of a wakeup which raced with the writer going to sleep */
+  static constexpr int maxWriterSleepMs = 100;
+};
+
+} // namespace faf
@@ -0,0 +1,409 @@
+#include "DirectUdpTransport.h"
+
+#include <cstring>
+
+#include <webrtc/rtc_base/helpers.h>
+#include <webrtc/rtc_base/messagedigest.h>
+#include <webrtc/rtc_base/thread.h>
+
+#include "logging.h"
+
+namespace faf {
+
+static const std::string offererKeyLabel = "faf-ice-adapter direct udp offerer to answerer";
+static const std::string answererKeyLabel = "faf-ice-adapter direct udp answerer to offerer";
+
+DirectUdpTransport::DirectUdpTransport(std::string const& key,
+                                       bool isOfferer,
+                                       DataCallback dataCallback,
+                                       ActiveChangedCallback activeChangedCallback):
+  _dataCallback(dataCallback),
+  _activeChangedCallback(activeChangedCallback),
+  _random(std::random_device()())
+{
+  _keysValid = _initContext(_sendContext.get(), key, isOfferer ? offererKeyLabel : answererKeyLabel) &&
+               _initContext(_receiveContext.get(), key, isOfferer ? answererKeyLabel : offererKeyLabel);
+  if (!_keysValid)
+  {
+    FAF_LOG_ERROR << "DirectUdpTransport unable to derive the keys";
+  }
+}
+
+DirectUdpTransport::~DirectUdpTransport()
+{
+  if (_stunResolver)
+  {
+    _stunResolver->Destroy(false);
+  }
+}
+
+int DirectUdpTransport::bind(std::string const& localIp)
+{
+  _socket.reset(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+  if (!_socket ||
+      _socket->Bind(rtc::SocketAddress(localIp, 0)) != 0)
+  {
+    FAF_LOG_ERROR << "DirectUdpTransport unable to bind UDP socket";
+    _socket.reset();
+    return 0;
+  }
+  _socket->SignalReadEvent.connect(this, &DirectUdpTransport::_onRead);
+  return _socket->GetLocalAddress().port();
+}
+
+void DirectUdpTransport::discoverMappedAddress(rtc::SocketAddress const& stunServer,
+                                               MappedAddressCallback callback)
+{
+  _mappedAddressCallback = callback;
+  _stunServer = stunServer;
+  _stunRequestsSent = 0;
+  _stunTimer.stop();
+  if (!_socket)
+  {
+    _finishDiscovery(rtc::SocketAddress());
+    return;
+  }
+  if (_stunServer.IsUnresolvedIP())
+  {
+    if (_stunResolver)
+    {
+      _stunResolver->Destroy(false);
+    }
+    _stunResolver = new rtc::AsyncResolver();
+    _stunResolver->SignalDone.connect(this, &DirectUdpTransport::_onStunServerResolved);
+    _stunResolver->Start(_stunServer);
+    return;
+  }
+  _sendStunRequest();
+}
+
+void DirectUdpTransport::connect(rtc::SocketAddress const& remoteAddress)
+{
+  _remoteAddress = remoteAddress;
+  _lastReceiveTime = std::chrono::steady_clock::now();
+  _onProbeTimer();
+  _probeTimer.start(_probeIntervalMs, std::bind(&DirectUdpTransport::_onProbeTimer, this));
+}
+
+bool DirectUdpTransport::active() const
+{
+  return _active;
+}
+
+bool DirectUdpTransport::send(const uint8_t* data, std::size_t size)
+{
+  if (!_active)
+  {
+    return false;
+  }
+  return _sendPacket(PacketType::Data, data, size);
+}
+
+std::optional<std::chrono::steady_clock::duration> DirectUdpTransport::lastRoundTripTime() const
+{
+  return _lastRoundTripTime;
+}
+
+uint64_t DirectUdpTransport::bytesSent() const
+{
+  return _bytesSent;
+}
+
+uint64_t DirectUdpTransport::packetsSent() const
+{
+  return _packetsSent;
+}
+
+uint64_t DirectUdpTransport::replaysDropped() const
+{
+  return _replaysDropped;
+}
+
+std::string DirectUdpTransport::createKey()
+{
+  std::string key;
+  if (!rtc::CreateRandomData(keySize, &key))
+  {
+    FAF_LOG_ERROR << "DirectUdpTransport unable to create a random key";
+  }
+  return key;
+}
+
+bool DirectUdpTransport::_sendPacket(PacketType type, const uint8_t* payload, std::size_t payloadSize)
+{
+  /* the sequence number is the nonce, it must not wrap around under the same key */
+  if (!_socket ||
+      !_keysValid ||
+      _remoteAddress.IsNil() ||
+      payloadSize > maxPayloadSize ||
+      _sendSequence == UINT32_MAX)
+  {
+    return false;
+  }
+  auto sequence = _sendSequence++;
+  auto packet = _sendBuffer.data();
+  packet[0] = static_cast<uint8_t>(type);
+  packet[1] = static_cast<uint8_t>(sequence >> 24);
+  packet[2] = static_cast<uint8_t>(sequence >> 16);
+  packet[3] = static_cast<uint8_t>(sequence >> 8);
+  packet[4] = static_cast<uint8_t>(sequence);
+  if (payloadSize > 0)
+  {
+    std::memcpy(packet + headerSize, payload, payloadSize);
+  }
+  auto nonce = _nonce(sequence);
+  std::size_t sealedSize = 0;
+  if (!EVP_AEAD_CTX_seal(_sendContext.get(),
+                         packet + headerSize, &sealedSize, _sendBuffer.size() - headerSize,
+                         nonce.data(), nonce.size(),
+                         packet + headerSize, payloadSize,
+                         packet, headerSize))
+  {
+    FAF_LOG_ERROR << "DirectUdpTransport unable to encrypt packet";
+    return false;
+  }
+  if (type == PacketType::Probe)
+  {
+    _lastProbeSequence = sequence;
+    _lastProbeTime = std::chrono::steady_clock::now();
+  }
+  auto sent = _socket->SendTo(packet, headerSize + sealedSize, _remoteAddress);
+  if (sent <= 0)
+  {
+    return false;
+  }
+  _bytesSent += static_cast<uint64_t>(sent);
+  ++_packetsSent;
+  return true;
+}
+
+bool DirectUdpTransport::_initContext(EVP_AEAD_CTX* context, std::string const& key, std::string const& label)
+{
+  /* one key per direction: HMAC-SHA256 of the direction label, keyed with the shared secret */
+  std::array<uint8_t, 32> digest;
+  if (key.size() != keySize ||
+      rtc::ComputeHmac(rtc::DIGEST_SHA_256,
+                       key.data(), key.size(),
+                       label.data(), label.size(),
+                       digest.data(), digest.size()) != digest.size())
+  {
+    return false;
+  }
+  return EVP_AEAD_CTX_init(context,
+                           EVP_aead_aes_128_gcm(),
+                           digest.data(), keySize,
+                           tagSize,
+                           nullptr) == 1;
+}
+
+std::array<uint8_t, 12> DirectUdpTransport::_nonce(uint32_t sequence)
+{
+  std::array<uint8_t, 12> nonce{};
+  nonce[8] = static_cast<uint8_t>(sequence >> 24);
+  nonce[9] = static_cast<uint8_t>(sequence >> 16);
+  nonce[10] = static_cast<uint8_t>(sequence >> 8);
+  nonce[11] = static_cast<uint8_t>(sequence);
+  return nonce;
+}
+
+void DirectUdpTransport::_onRead(rtc::AsyncSocket* socket)
+{
+  rtc::SocketAddress from;
+  int msgLength;
+  while ((msgLength = socket->RecvFrom(_readBuffer.data(), _readBuffer.size(), &from, nullptr)) > 0)
+  {
+    if (_mappedAddressCallback &&
+        from == _stunServer)
+    {
+      _onStunResponse(_readBuffer.data(), static_cast<std::size_t>(msgLength));
+      continue;
+    }
+    if (from != _remoteAddress ||
+        static_cast<std::size_t>(msgLength) < overhead)
+    {
+      continue;
+    }
+    _onPacket(_readBuffer.data(), static_cast<std::size_t>(msgLength));
+  }
+}
+
+void DirectUdpTransport::_onPacket(uint8_t* packet, std::size_t size)
+{
+  if (!_keysValid)
+  {
+    return;
+  }
+  uint32_t sequence = static_cast<uint32_t>(packet[1]) << 24 | static_cast<uint32_t>(packet[2]) << 16 |
+                      static_cast<uint32_t>(packet[3]) << 8 | packet[4];
+  /* decrypts in place, the tag check also covers the header */
+  auto nonce = _nonce(sequence);
+  std::size_t payloadSize = 0;
+  if (!EVP_AEAD_CTX_open(_receiveContext.get(),
+                         packet + headerSize, &payloadSize, size - headerSize,
+                         nonce.data(), nonce.size(),
+                         packet + headerSize, size - headerSize,
+                         packet, headerSize))
+  {
+    FAF_LOG_TRACE << "DirectUdpTransport dropping packet which does not decrypt";
+    return;
+  }
+  if (!_acceptSequence(sequence))
+  {
+    ++_replaysDropped;
+    FAF_LOG_TRACE << "DirectUdpTransport dropping replayed packet " << sequence;
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  _lastReceiveTime = now;
+  switch (static_cast<PacketType>(packet[0]))
+  {
+    case PacketType::Data:
+      if (_dataCallback)
+      {
+        _dataCallback(packet + headerSize, payloadSize);
+      }
+      break;
+    case PacketType::Probe:
+    {
+      uint8_t ack[4] = {packet[1], packet[2], packet[3], packet[4]};
+      _sendPacket(PacketType::ProbeAck, ack, sizeof(ack));
+      break;
+    }
+    case PacketType::ProbeAck:
+      if (payloadSize == 4)
+      {
+        uint32_t ackedSequence = static_cast<uint32_t>(packet[headerSize]) << 24 | static_cast<uint32_t>(packet[headerSize + 1]) << 16 |
+                                 static_cast<uint32_t>(packet[headerSize + 2]) << 8 | packet[headerSize + 3];
+        if (ackedSequence == _lastProbeSequence)
+        {
+          _lastRoundTripTime = now - _lastProbeTime;
+        }
+        _setActive(true);
+      }
+      break;
+  }
+}
+
+bool DirectUdpTransport::_acceptSequence(uint32_t sequence)
+{
+  if (!_receivedSequence)
+  {
+    _receivedSequence = true;
+    _highestSequence = sequence;
+    _replayWindow = 1;
+    return true;
+  }
+  /* serial number arithmetic, the counter may wrap */
+  auto ahead = sequence - _highestSequence;
+  if (ahead != 0 &&
+      ahead < 0x80000000u)
+  {
+    _replayWindow = ahead < replayWindowSize ? (_replayWindow << ahead) | 1 : 1;
+    _highestSequence = sequence;
+    return true;
+  }
+  auto behind = _highestSequence - sequence;
+  if (behind >= replayWindowSize)
+  {
+    return false;
+  }
+  auto bit = uint64_t(1) << behind;
+  if (_replayWindow & bit)
+  {
+    return false;
+  }
+  _replayWindow |= bit;
+  return true;
+}
+
+void DirectUdpTransport::_onProbeTimer()
+{
+  if (_active &&
+      std::chrono::steady_clock::now() - _lastReceiveTime > std::chrono::milliseconds(_timeoutMs))
+  {
+    _setActive(false);
+  }
+  _sendPacket(PacketType::Probe, nullptr, 0);
+}
+
+void DirectUdpTransport::_setActive(bool active)
+{
+  if (active == _active)
+  {
+    return;
+  }
+  _active = active;
+  FAF_LOG_INFO << "DirectUdpTransport to " << _remoteAddress.ToString() << (active ? " active" : " inactive");
+  if (_activeChangedCallback)
+  {
+    _activeChangedCallback(active);
+  }
+}
+
+void DirectUdpTransport::_onStunServerResolved(rtc::AsyncResolverInterface* resolver)
+{
+  rtc::SocketAddress address;
+  bool resolved = resolver->GetError() == 0 &&
+                  resolver->GetResolvedAddress(AF_INET, &address);
+  if (resolver == _stunResolver)
+  {
+    _stunResolver = nullptr;
+  }
+  resolver->Destroy(false);
+  if (!resolved)
+  {
+    FAF_LOG_DEBUG << "DirectUdpTransport unable to resolve STUN server " << _stunServer.ToString();
+    _finishDiscovery(rtc::SocketAddress());
+    return;
+  }
+  _stunServer = address;
+  _sendStunRequest();
+}
+
+void DirectUdpTransport::_sendStunRequest()
+{
+  if (_stunRequestsSent >= _stunRequests)
+  {
+    FAF_LOG_DEBUG << "DirectUdpTransport STUN server " << _stunServer.ToString() << " did not answer";
+    _finishDiscovery(rtc::SocketAddress());
+    return;
+  }
+  ++_stunRequestsSent;
+  /* retransmissions reuse the transaction ID, RFC 5389 section 7.2.1 */
+  if (_stunRequestsSent == 1)
+  {
+    _stunTransactionId = stun::randomTransactionId(_random);
+  }
+  auto request = stun::bindingRequest(_stunTransactionId);
+  _socket->SendTo(request.data(), request.size(), _stunServer);
+  _stunTimer.singleShot(_stunRetransmitMs, [this]()
+  {
+    _sendStunRequest();
+  });
+}
+
+void DirectUdpTransport::_onStunResponse(const uint8_t* data, std::size_t size)
+{
+  stun::TransactionId transactionId;
+  rtc::SocketAddress mappedAddress;
+  if (!stun::parseBindingResponse(data, size, transactionId, &mappedAddress) ||
+      transactionId != _stunTransactionId ||
+      mappedAddress.IsNil())
+  {
+    return;
+  }
+  _finishDiscovery(mappedAddress);
+}
+
+void DirectUdpTransport::_finishDiscovery(rtc::SocketAddress const& mappedAddress)
+{
+  _stunTimer.stop();
+  auto callback = std::move(_mappedAddressCallback);
+  _mappedAddressCallback = MappedAddressCallback();
+  if (callback)
+  {
+    callback(mappedAddress);
+  }
+}
+
+} // namespace faf
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+
+#include <webrtc/rtc_base/asyncsocket.h>
+#include <webrtc/rtc_base/nethelpers.h>
+
+#include <openssl/aead.h>
+
+#include "StunMessage.h"
+#include "Timer.h"
+
+namespace faf {
+
+/*! \brief Plain UDP path between two relays, bypassing SCTP and DTLS
+ *
+ *  Every packet starts with a 5 byte header: type and 32 bit sequence number.
+ *  The payload is encrypted with AES-128-GCM, the header is authenticated with
+ *  it and the 16 byte tag follows the ciphertext. Each direction has its own
+ *  key, derived from a secret exchanged via the encrypted DataChannel, so packets
+ *  reflected back to their sender do not decrypt. The sequence number is the
+ *  nonce, replayed packets are rejected with a sliding window over it.
+ *  The path becomes active once a probe was acknowledged, and inactive when
+ *  nothing authentic was received within the timeout. Both sides probe each
+ *  other at the same time, which opens the mappings of NATs in between.
+ */
+class DirectUdpTransport : public sigslot::has_slots<>
+{
+public:
+  typedef std::function<void (const uint8_t* data, std::size_t size)> DataCallback;
+  typedef std::function<void (bool active)> ActiveChangedCallback;
+  /* called with a nil address if the STUN server did not answer */
+  typedef std::function<void (rtc::SocketAddress const& mappedAddress)> MappedAddressCallback;
+
+  /** \param key: the shared secret of both transports, see createKey(), must not be used for another transport pair
+       \param isOfferer: selects the key of each direction, must differ between the two transports
+      */
+  DirectUdpTransport(std::string const& key,
+                     bool isOfferer,
+                     DataCallback dataCallback,
+                     ActiveChangedCallback activeChangedCallback);
+  virtual ~DirectUdpTransport();
+
+  /** \brief Bind the local socket to an automatic port
+       \returns the port or 0 on failure
+      */
+  int bind(std::string const& localIp = "0.0.0.0");
+
+  /** \brief Ask a STUN server for the public address of the bound socket
+       \param stunServer: the server address, hostnames are resolved
+       \param callback: called once with the mapped address
+      */
+  void discoverMappedAddress(rtc::SocketAddress const& stunServer,
+                             MappedAddressCallback callback);
+
+  /** \brief Start probing the remote transport
+      */
+  void connect(rtc::SocketAddress const& remoteAddress);
+
+  bool active() const;
+
+  /** \brief Send a datagram to the remote transport
+       \returns false if the path is not active or sending failed
+      */
+  bool send(const uint8_t* data, std::size_t size);
+
+  /** \returns the round trip time of the last acknowledged probe
+      */
+  std::optional<std::chrono::steady_clock::duration> lastRoundTripTime() const;
+
+  /** \returns the bytes of all sent UDP payloads, including headers and probes
+      */
+  uint64_t bytesSent() const;
+  uint64_t packetsSent() const;
+  /** \returns the number of authentic packets which were dropped as replays
+      */
+  uint64_t replaysDropped() const;
+
+  /** \returns a random key for a new pair of transports
+      */
+  static std::string createKey();
+
+  static constexpr std::size_t keySize = 16;
+  static constexpr std::size_t headerSize = 1 + 4;
+  static constexpr std::size_t tagSize = 16;
+  static constexpr std::size_t overhead = headerSize + tagSize;
+  static constexpr std::size_t maxPayloadSize = 65507 - overhead;
+  static constexpr uint32_t replayWindowSize = 64;
+
+protected:
+  enum class PacketType : uint8_t
+  {
+    Data = 0,
+    Probe = 1,
+    ProbeAck = 2
+  };
+
+  bool _sendPacket(PacketType type, const uint8_t* payload, std::size_t payloadSize);
+  bool _initContext(EVP_AEAD_CTX* context, std::string const& key, std::string const& label);
+  static std::array<uint8_t, 12> _nonce(uint32_t sequence);
+  void _onRead(rtc::AsyncSocket* socket);
+  void _onPacket(uint8_t* packet, std::size_t size);
+  bool _acceptSequence(uint32_t sequence);
+  void _onProbeTimer();
+  void _setActive(bool active);
+  void _onStunServerResolved(rtc::AsyncResolverInterface* resolver);
+  void _sendStunRequest();
+  void _onStunResponse(const uint8_t* data, std::size_t size);
+  void _finishDiscovery(rtc::SocketAddress const& mappedAddress);
+
+  bssl::ScopedEVP_AEAD_CTX _sendContext;
+  bssl::ScopedEVP_AEAD_CTX _receiveContext;
+  bool _keysValid{false};
+  DataCallback _dataCallback;
+  ActiveChangedCallback _activeChangedCallback;
+  std::unique_ptr<rtc::AsyncSocket> _socket;
+  rtc::SocketAddress _remoteAddress;
+  bool _active{false};
+  uint32_t _sendSequence{0};
+  uint32_t _lastProbeSequence{0};
+  std::chrono::steady_clock::time_point _lastProbeTime;
+  std::chrono::steady_clock::time_point _lastReceiveTime;
+  std::optional<std::chrono::steady_clock::duration> _lastRoundTripTime;
+  bool _receivedSequence{false};
+  uint32_t _highestSequence{0};
+  uint64_t _replayWindow{0};  /*!< bit n set: _highestSequence - n was received */
+  uint64_t _bytesSent{0};
+  uint64_t _packetsSent{0};
+  uint64_t _replaysDropped{0};
+  Timer _probeTimer;
+
+  rtc::SocketAddress _stunServer;
+  rtc::AsyncResolver* _stunResolver{nullptr};
+  stun::TransactionId _stunTransactionId;
+  MappedAddressCallback _mappedAddressCallback;
+  int _stunRequestsSent{0};
+  Timer _stunTimer;
+  std::mt19937 _random;
+  std::array<uint8_t, 65536> _sendBuffer;
+  std::array<uint8_t, 65536> _readBuffer;
+
+  int _probeIntervalMs{500};
+  int _timeoutMs{3000};
+  int _stunRequests{3};
+  int _stunRetransmitMs{500};
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(DirectUdpTransport);
+};
+
+} // namespace faf
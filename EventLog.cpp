@@ -0,0 +1,273 @@
+#include "EventLog.h"
+
+#include <cstring>
+
+#ifdef WEBRTC_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+
+namespace faf {
+
+static const EventSchema eventSchemas[] = {
+  {EventId::AdapterStarted,   "adapter_started",    "local_player_id:u,version:s"},
+  {EventId::RelayCreated,     "relay_created",      "login:s,offerer:u"},
+  {EventId::RelayRemoved,     "relay_removed",      ""},
+  {EventId::IceState,         "ice_state",          "state:s"},
+  {EventId::GatheringState,   "gathering_state",    "state:s"},
+  {EventId::Connected,        "connected",          "connected:u,time_to_connected_ms:u"},
+  {EventId::Reconnect,        "reconnect",          "reconnects:u"},
+  {EventId::CandidatePair,    "candidate_pair",     "local_type:s,remote_type:s,local_address:s,remote_address:s"},
+  {EventId::DataChannelState, "datachannel_state",  "state:s"},
+  {EventId::DirectUdp,        "direct_udp",         "active:u"},
+  {EventId::PairSwitch,       "pair_switch",        "exclude_relay:u,reason:s"},
+  {EventId::GameState,        "game_state",         "state:s"}
+};
+
+EventSchema const* eventSchema(std::uint64_t id)
+{
+  for (auto const& schema: eventSchemas)
+  {
+    if (static_cast<std::uint64_t>(schema.id) == id)
+    {
+      return &schema;
+    }
+  }
+  return nullptr;
+}
+
+static void write32(std::uint8_t* data, std::uint32_t value)
+{
+  for (int i = 0; i < 4; ++i)
+  {
+    data[i] = static_cast<std::uint8_t>(value >> (8 * i));
+  }
+}
+
+static void write64(std::uint8_t* data, std::uint64_t value)
+{
+  for (int i = 0; i < 8; ++i)
+  {
+    data[i] = static_cast<std::uint8_t>(value >> (8 * i));
+  }
+}
+
+constexpr char EventLog::magic[8];
+
+EventLog::EventLog()
+{
+  _record.reserve(blockSize);
+}
+
+EventLog::~EventLog()
+{
+  close();
+}
+
+bool EventLog::open(std::string const& path, std::size_t size)
+{
+  close();
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::size_t blockCount = size > fileHeaderSize ? (size - fileHeaderSize) / blockSize : 0;
+  if (blockCount < 2)
+  {
+    FAF_LOG_ERROR << "event log size " << size << " is too small";
+    return false;
+  }
+  std::size_t fileSize = fileHeaderSize + blockCount * blockSize;
+#ifdef WEBRTC_WIN
+  auto file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    FAF_LOG_ERROR << "unable to create event log " << path;
+    return false;
+  }
+  auto mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                    static_cast<DWORD>(static_cast<std::uint64_t>(fileSize) >> 32),
+                                    static_cast<DWORD>(fileSize), nullptr);
+  void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, fileSize) : nullptr;
+  if (!data)
+  {
+    FAF_LOG_ERROR << "unable to map event log " << path;
+    if (mapping)
+    {
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return false;
+  }
+  _file = file;
+  _mapping = mapping;
+#else
+  int file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file < 0)
+  {
+    FAF_LOG_ERROR << "unable to create event log " << path;
+    return false;
+  }
+  void* data = MAP_FAILED;
+  if (ftruncate(file, static_cast<off_t>(fileSize)) == 0)
+  {
+    data = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  }
+  if (data == MAP_FAILED)
+  {
+    FAF_LOG_ERROR << "unable to map event log " << path;
+    ::close(file);
+    return false;
+  }
+  _file = file;
+#endif
+  _data = static_cast<std::uint8_t*>(data);
+  _size = fileSize;
+  _blockCount = static_cast<std::uint32_t>(blockCount);
+  _sequence = 0;
+  _startTime = std::chrono::steady_clock::now();
+
+  std::memcpy(_data, magic, sizeof(magic));
+  write32(_data + 8, version);
+  write32(_data + 12, blockSize);
+  write32(_data + 16, _blockCount);
+  auto unixMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  write64(_data + 20, static_cast<std::uint64_t>(unixMicros));
+
+  _currentBlock = _blockCount - 1;
+  _startBlock(0);
+  FAF_LOG_INFO << "writing events to " << path << " (" << fileSize / 1024 << " KiB)";
+  return true;
+}
+
+void EventLog::close()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_data)
+  {
+    return;
+  }
+#ifdef WEBRTC_WIN
+  UnmapViewOfFile(_data);
+  CloseHandle(_mapping);
+  CloseHandle(_file);
+  _mapping = nullptr;
+  _file = nullptr;
+#else
+  munmap(_data, _size);
+  ::close(_file);
+  _file = -1;
+#endif
+  _data = nullptr;
+  _size = 0;
+}
+
+bool EventLog::isOpen()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _data != nullptr;
+}
+
+void EventLog::_appendVarint(std::uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    _record.push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  _record.push_back(static_cast<std::uint8_t>(value));
+}
+
+void EventLog::_appendSigned(std::int64_t value)
+{
+  _appendVarint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+}
+
+void EventLog::_appendString(std::string const& value)
+{
+  _appendVarint(value.size());
+  _record.insert(_record.end(), value.begin(), value.end());
+}
+
+static std::size_t encodeVarint(std::uint8_t* out, std::uint64_t value)
+{
+  std::size_t size = 0;
+  while (value >= 0x80)
+  {
+    out[size++] = static_cast<std::uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[size++] = static_cast<std::uint8_t>(value);
+  return size;
+}
+
+void EventLog::_commit()
+{
+  /* _record holds the event ID, the relay tag and the fields, the timestamp goes in between */
+  std::size_t tagEnd = 1;
+  while (_record[tagEnd] & 0x80)
+  {
+    ++tagEnd;
+  }
+  ++tagEnd;
+
+  auto now = _now();
+  std::uint8_t delta[10];
+  std::uint8_t length[10];
+  std::size_t deltaSize = encodeVarint(delta, now - _blockBaseTime);
+  std::size_t lengthSize = encodeVarint(length, _record.size() + deltaSize);
+  if (blockHeaderSize + _blockUsed + lengthSize + _record.size() + deltaSize > blockSize)
+  {
+    _startBlock(now);
+    deltaSize = encodeVarint(delta, 0);
+    lengthSize = encodeVarint(length, _record.size() + deltaSize);
+    if (blockHeaderSize + lengthSize + _record.size() + deltaSize > blockSize)
+    {
+      FAF_LOG_WARN << "dropping event " << static_cast<int>(_record[0]) << " of " << _record.size() << " bytes";
+      return;
+    }
+  }
+  auto block = _block(_currentBlock);
+  auto out = block + blockHeaderSize + _blockUsed;
+  std::memcpy(out, length, lengthSize);
+  out += lengthSize;
+  std::memcpy(out, _record.data(), tagEnd);
+  out += tagEnd;
+  std::memcpy(out, delta, deltaSize);
+  out += deltaSize;
+  std::memcpy(out, _record.data() + tagEnd, _record.size() - tagEnd);
+  _blockUsed += static_cast<std::uint32_t>(lengthSize + _record.size() + deltaSize);
+  /* the used size is updated last, so a reader never sees a partial record */
+  write32(block + 16, _blockUsed);
+}
+
+void EventLog::_startBlock(std::uint64_t now)
+{
+  _currentBlock = (_currentBlock + 1) % _blockCount;
+  auto block = _block(_currentBlock);
+  write64(block, ++_sequence);
+  write64(block + 8, now);
+  write32(block + 16, 0);
+  _blockBaseTime = now;
+  _blockUsed = 0;
+}
+
+std::uint8_t* EventLog::_block(std::uint32_t index) const
+{
+  return _data + fileHeaderSize + static_cast<std::size_t>(index) * blockSize;
+}
+
+std::uint64_t EventLog::_now() const
+{
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _startTime).count());
+}
+
+EventLog& eventLog()
+{
+  static EventLog log;
+  return log;
+}
+
+} // namespace faf
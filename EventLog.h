@@ -0,0 +1,161 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace faf {
+
+/* Event IDs are part of the file format, never reuse or renumber them */
+enum class EventId : std::uint8_t
+{
+  AdapterStarted = 1,
+  RelayCreated = 2,
+  RelayRemoved = 3,
+  IceState = 4,
+  GatheringState = 5,
+  Connected = 6,
+  Reconnect = 7,
+  CandidatePair = 8,
+  DataChannelState = 9,
+  DirectUdp = 10,
+  PairSwitch = 11,
+  GameState = 12
+};
+
+/*! \brief Name and fields of an event for the decoder
+ *
+ *  fields is a comma separated list of name:type, types are
+ *  u (unsigned varint), i (zigzag signed varint) and s (varint length + bytes).
+ */
+struct EventSchema
+{
+  EventId id;
+  const char* name;
+  const char* fields;
+};
+
+/** \returns the schema of an event, nullptr for unknown IDs
+   */
+EventSchema const* eventSchema(std::uint64_t id);
+
+/*! \brief Compact binary log of connection events in a memory-mapped ring file
+ *
+ *  The file starts with a header page followed by fixed size blocks.
+ *  Each block has a header with its sequence number, the timestamp the
+ *  records of the block are relative to and the number of used bytes.
+ *  Records never span blocks. When the last block is full, the oldest
+ *  block is overwritten, so the decoder orders the blocks by sequence.
+ *
+ *  A record is: varint payload length, then the payload: varint event ID,
+ *  zigzag varint relay tag (remote player ID, 0 for adapter events),
+ *  varint microseconds since the block timestamp and the event fields.
+ */
+class EventLog
+{
+public:
+  EventLog();
+  virtual ~EventLog();
+
+  /** \brief Create or truncate the ring file and map it
+       \param size: file size in bytes, rounded down to whole blocks
+       \returns false if the file could not be created or mapped
+      */
+  bool open(std::string const& path, std::size_t size);
+  void close();
+  bool isOpen();
+
+  /** \brief Append an event, does nothing if the log is not open
+       \param relay: remote player ID or 0
+       \param fields: unsigned integers, signed integers, bools and strings as listed in the schema
+      */
+  template<typename... Fields>
+  void write(EventId id, int relay, Fields const&... fields)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_data)
+    {
+      return;
+    }
+    _record.clear();
+    _appendVarint(static_cast<std::uint64_t>(id));
+    _appendSigned(relay);
+    /* the timestamp is finished in _commit() once the block is known */
+    _appendFields(fields...);
+    _commit();
+  }
+
+  static constexpr std::uint32_t blockSize = 4096;
+  static constexpr std::uint32_t blockHeaderSize = 20;  /* sequence u64, base time u64, used bytes u32, little endian */
+  static constexpr std::uint32_t fileHeaderSize = 4096; /* magic, version u32, block size u32, block count u32, start unix time in µs u64 */
+  static constexpr char magic[8] = {'F', 'A', 'F', 'E', 'V', 'L', 'O', 'G'};
+  static constexpr std::uint32_t version = 1;
+
+protected:
+  void _appendVarint(std::uint64_t value);
+  void _appendSigned(std::int64_t value);
+  void _appendString(std::string const& value);
+
+  void _appendFields()
+  {
+  }
+
+  template<typename Field, typename... Fields>
+  void _appendFields(Field const& field, Fields const&... fields)
+  {
+    _appendField(field);
+    _appendFields(fields...);
+  }
+
+  template<typename Field>
+  void _appendField(Field const& field)
+  {
+    if constexpr (std::is_same<Field, bool>::value)
+    {
+      _appendVarint(field ? 1 : 0);
+    }
+    else if constexpr (std::is_integral<Field>::value && std::is_signed<Field>::value)
+    {
+      _appendSigned(field);
+    }
+    else if constexpr (std::is_integral<Field>::value || std::is_enum<Field>::value)
+    {
+      _appendVarint(static_cast<std::uint64_t>(field));
+    }
+    else
+    {
+      _appendString(field);
+    }
+  }
+
+  void _commit();
+  void _startBlock(std::uint64_t now);
+  std::uint8_t* _block(std::uint32_t index) const;
+  std::uint64_t _now() const;
+
+  std::mutex _mutex;
+  std::uint8_t* _data{nullptr};
+  std::size_t _size{0};
+  std::uint32_t _blockCount{0};
+  std::uint32_t _currentBlock{0};
+  std::uint64_t _sequence{0};
+  std::uint64_t _blockBaseTime{0};
+  std::uint32_t _blockUsed{0};
+  std::chrono::steady_clock::time_point _startTime;
+  std::vector<std::uint8_t> _record;
+#ifdef WEBRTC_WIN
+  void* _file{nullptr};
+  void* _mapping{nullptr};
+#else
+  int _file{-1};
+#endif
+};
+
+/** \brief The event log of the process, opened in main() if a log directory is set
+   */
+EventLog& eventLog();
+
+} // namespace faf
@@ -0,0 +1,64 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+#include "EventLogReader.h"
+
+/* renders an ice_adapter_events.bin file as text, or with --json as one JSON object per line */
+int main(int argc, char *argv[])
+{
+  bool json = false;
+  std::string path;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg(argv[i]);
+    if (arg == "--json")
+    {
+      json = true;
+    }
+    else if (path.empty())
+    {
+      path = arg;
+    }
+  }
+  if (path.empty())
+  {
+    std::cerr << "usage: faf-ice-eventlog [--json] <ice_adapter_events.bin>" << std::endl;
+    return 1;
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    std::cerr << "unable to open " << path << std::endl;
+    return 1;
+  }
+  std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+
+  std::vector<Json::Value> events;
+  std::string error;
+  if (!faf::readEventLog(data, events, error))
+  {
+    std::cerr << path << ": " << error << std::endl;
+    return 1;
+  }
+  Json::FastWriter writer;
+  for (auto const& event: events)
+  {
+    if (json)
+    {
+      /* FastWriter terminates every document with a newline */
+      std::cout << writer.write(event);
+    }
+    else
+    {
+      std::cout << faf::eventToText(event) << "\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include "EventLogReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+#include "EventLog.h"
+
+namespace faf {
+
+static std::uint32_t read32(std::uint8_t const* data)
+{
+  std::uint32_t result = 0;
+  for (int i = 3; i >= 0; --i)
+  {
+    result = result << 8 | data[i];
+  }
+  return result;
+}
+
+static std::uint64_t read64(std::uint8_t const* data)
+{
+  std::uint64_t result = 0;
+  for (int i = 7; i >= 0; --i)
+  {
+    result = result << 8 | data[i];
+  }
+  return result;
+}
+
+static bool readVarint(std::uint8_t const*& data, std::uint8_t const* end, std::uint64_t& value)
+{
+  value = 0;
+  for (int shift = 0; shift < 64 && data < end; shift += 7)
+  {
+    auto byte = *data++;
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static std::int64_t unzigzag(std::uint64_t value)
+{
+  return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+static std::string formatTime(std::uint64_t unixMicros)
+{
+  auto seconds = static_cast<std::time_t>(unixMicros / 1000000);
+  std::tm tm = *std::gmtime(&seconds);
+  std::ostringstream result;
+  result << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S") << "."
+         << std::setw(6) << std::setfill('0') << unixMicros % 1000000 << "Z";
+  return result.str();
+}
+
+/* decodes the fields of one record payload according to the schema */
+static bool decodeFields(EventSchema const& schema,
+                         std::uint8_t const* data,
+                         std::uint8_t const* end,
+                         Json::Value& event)
+{
+  std::istringstream fields(schema.fields);
+  std::string field;
+  while (std::getline(fields, field, ','))
+  {
+    auto separator = field.find(':');
+    if (separator == std::string::npos)
+    {
+      continue;
+    }
+    auto name = field.substr(0, separator);
+    auto type = field.substr(separator + 1);
+    std::uint64_t value;
+    if (!readVarint(data, end, value))
+    {
+      return false;
+    }
+    if (type == "u")
+    {
+      event[name] = Json::UInt64(value);
+    }
+    else if (type == "i")
+    {
+      event[name] = Json::Int64(unzigzag(value));
+    }
+    else
+    {
+      if (value > static_cast<std::uint64_t>(end - data))
+      {
+        return false;
+      }
+      event[name] = std::string(reinterpret_cast<const char*>(data), static_cast<std::size_t>(value));
+      data += value;
+    }
+  }
+  return true;
+}
+
+bool readEventLog(std::vector<std::uint8_t> const& data,
+                  std::vector<Json::Value>& events,
+                  std::string& error)
+{
+  if (data.size() < EventLog::fileHeaderSize ||
+      std::memcmp(data.data(), EventLog::magic, sizeof(EventLog::magic)) != 0)
+  {
+    error = "not an event log";
+    return false;
+  }
+  if (read32(data.data() + 8) != EventLog::version)
+  {
+    error = "unsupported event log version " + std::to_string(read32(data.data() + 8));
+    return false;
+  }
+  auto blockSize = read32(data.data() + 12);
+  auto blockCount = read32(data.data() + 16);
+  auto startUnixMicros = read64(data.data() + 20);
+  if (blockSize <= EventLog::blockHeaderSize ||
+      EventLog::fileHeaderSize + static_cast<std::uint64_t>(blockSize) * blockCount > data.size())
+  {
+    error = "truncated event log";
+    return false;
+  }
+
+  /* blocks in write order, unused blocks have sequence 0 */
+  std::vector<std::pair<std::uint64_t, std::uint8_t const*>> blocks;
+  for (std::uint32_t i = 0; i < blockCount; ++i)
+  {
+    auto block = data.data() + EventLog::fileHeaderSize + static_cast<std::size_t>(i) * blockSize;
+    auto sequence = read64(block);
+    if (sequence > 0)
+    {
+      blocks.emplace_back(sequence, block);
+    }
+  }
+  std::sort(blocks.begin(), blocks.end());
+
+  events.clear();
+  for (auto const& block: blocks)
+  {
+    auto baseTime = read64(block.second + 8);
+    auto used = std::min(read32(block.second + 16), blockSize - EventLog::blockHeaderSize);
+    auto record = block.second + EventLog::blockHeaderSize;
+    auto blockEnd = record + used;
+    while (record < blockEnd)
+    {
+      std::uint64_t length;
+      if (!readVarint(record, blockEnd, length) ||
+          length > static_cast<std::uint64_t>(blockEnd - record))
+      {
+        break;
+      }
+      auto payload = record;
+      auto payloadEnd = record + length;
+      record = payloadEnd;
+
+      std::uint64_t id, relay, delta;
+      if (!readVarint(payload, payloadEnd, id) ||
+          !readVarint(payload, payloadEnd, relay) ||
+          !readVarint(payload, payloadEnd, delta))
+      {
+        continue;
+      }
+      Json::Value event;
+      auto time = baseTime + delta;
+      event["time"] = formatTime(startUnixMicros + time);
+      event["time_us"] = Json::UInt64(time);
+      event["relay"] = Json::Int64(unzigzag(relay));
+      auto schema = eventSchema(id);
+      if (!schema)
+      {
+        /* written by a newer adapter, the length lets us skip it */
+        event["event"] = "unknown_" + std::to_string(id);
+      }
+      else
+      {
+        event["event"] = schema->name;
+        if (!decodeFields(*schema, payload, payloadEnd, event))
+        {
+          event["damaged"] = true;
+        }
+      }
+      events.push_back(event);
+    }
+  }
+  return true;
+}
+
+std::string eventToText(Json::Value const& event)
+{
+  std::ostringstream result;
+  result << event["time"].asString();
+  if (event["relay"].asInt64() != 0)
+  {
+    result << " relay " << event["relay"].asInt64();
+  }
+  result << " " << event["event"].asString();
+  for (auto const& name: event.getMemberNames())
+  {
+    if (name == "time" ||
+        name == "time_us" ||
+        name == "relay" ||
+        name == "event")
+    {
+      continue;
+    }
+    auto const& value = event[name];
+    result << " " << name << "=";
+    if (value.isString())
+    {
+      result << "\"" << value.asString() << "\"";
+    }
+    else
+    {
+      result << value.asString();
+    }
+  }
+  return result.str();
+}
+
+} // namespace faf
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+namespace faf {
+
+/** \brief Decode an EventLog ring file, oldest event first
+    \param data: the complete file contents
+    \param events: set to one object per event with "time" (ISO 8601 UTC), "time_us" (µs since the log was opened),
+           "event", "relay" and the fields of the event schema
+    \param error: set to a description if the file is no event log
+    \returns false if the file header is invalid, damaged blocks are skipped
+   */
+bool readEventLog(std::vector<std::uint8_t> const& data,
+                  std::vector<Json::Value>& events,
+                  std::string& error);
+
+/** \brief Render a decoded event as a single line of text
+   */
+std::string eventToText(Json::Value const& event);
+
+} // namespace faf
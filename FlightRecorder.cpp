@@ -0,0 +1,88 @@
+#include "FlightRecorder.h"
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace faf {
+
+std::uint64_t FlightRecorder::recorded() const
+{
+  return _recorded;
+}
+
+void FlightRecorder::write(std::ostream& out, std::string const& title) const
+{
+  auto now = std::chrono::steady_clock::now();
+  auto wallTime = std::time(nullptr);
+  std::tm tm = *std::gmtime(&wallTime);
+  out << "# " << title << "\n"
+      << "# " << _packets.size() << " of " << _recorded << " packets, times in ms relative to "
+      << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ") << ", gap to the previous packet\n"
+      << "# time gap direction kind size\n";
+  out << std::fixed << std::setprecision(3);
+  for (std::size_t i = 0; i < _packets.size(); ++i)
+  {
+    auto const& packet = _packets[i];
+    auto gap = i > 0 ? packet.time - _packets[i - 1].time : std::chrono::steady_clock::duration::zero();
+    out << std::chrono::duration<double, std::milli>(packet.time - now).count() << " "
+        << std::chrono::duration<double, std::milli>(gap).count() << " "
+        << directionName(packet.direction) << " "
+        << kindName(packet.kind) << " "
+        << packet.size << "\n";
+  }
+}
+
+bool FlightRecorder::dump(std::string const& path, std::string const& title) const
+{
+  std::ofstream file(path);
+  if (!file)
+  {
+    return false;
+  }
+  write(file, title);
+  file.close();
+  return !file.fail();
+}
+
+std::string FlightRecorder::fileName(int remotePlayerId)
+{
+  auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  auto seconds = static_cast<std::time_t>(now / 1000);
+  std::tm tm = *std::gmtime(&seconds);
+  std::ostringstream result;
+  result << "flight_recorder_" << remotePlayerId << "_"
+         << std::put_time(&tm, "%Y%m%dT%H%M%S") << std::setw(3) << std::setfill('0') << now % 1000 << "Z.txt";
+  return result.str();
+}
+
+const char* FlightRecorder::directionName(Direction direction)
+{
+  switch (direction)
+  {
+    case Direction::Sent:
+      return "sent";
+    case Direction::Received:
+      return "received";
+  }
+  return "";
+}
+
+const char* FlightRecorder::kindName(Kind kind)
+{
+  switch (kind)
+  {
+    case Kind::Data:
+      return "data";
+    case Kind::Ping:
+      return "ping";
+    case Kind::Pong:
+      return "pong";
+    case Kind::Control:
+      return "control";
+  }
+  return "";
+}
+
+} // namespace faf
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "RingBuffer.h"
+
+namespace faf {
+
+/*! \brief The last packets a relay sent and received, for post-mortem analysis
+ *
+ *  Recording a packet stores its timestamp, size, direction and kind into
+ *  a fixed ring, the oldest packets are overwritten. Not thread safe, the
+ *  relay records on its signaling thread.
+ */
+class FlightRecorder
+{
+public:
+  enum class Direction : std::uint8_t
+  {
+    Sent,
+    Received
+  };
+
+  enum class Kind : std::uint8_t
+  {
+    Data,    /*!< game data, via the DataChannel or the direct UDP path */
+    Ping,    /*!< connectivity checker ping */
+    Pong,    /*!< connectivity checker answer */
+    Control  /*!< direct UDP offer or answer */
+  };
+
+  struct Packet
+  {
+    std::chrono::steady_clock::time_point time;
+    std::uint32_t size;
+    Direction direction;
+    Kind kind;
+  };
+
+  static constexpr std::size_t capacity = 4096;
+
+  void record(Direction direction, Kind kind, std::size_t size)
+  {
+    _packets.push({std::chrono::steady_clock::now(), static_cast<std::uint32_t>(size), direction, kind});
+    ++_recorded;
+  }
+
+  /** \returns the number of packets recorded so far, including overwritten ones
+      */
+  std::uint64_t recorded() const;
+
+  /** \brief Write the ring as text, one packet per line, oldest first
+       \param title: written as first comment line
+      */
+  void write(std::ostream& out, std::string const& title) const;
+
+  /** \brief Write the ring to a file
+       \returns false if the file could not be written
+      */
+  bool dump(std::string const& path, std::string const& title) const;
+
+  /** \returns a file name for a dump of the relay to the remote player, unique per millisecond
+      */
+  static std::string fileName(int remotePlayerId);
+
+  static const char* directionName(Direction direction);
+  static const char* kindName(Kind kind);
+
+protected:
+  RingBuffer<Packet, capacity> _packets;
+  std::uint64_t _recorded{0};
+};
+
+} // namespace faf
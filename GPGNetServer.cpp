@@ -84,6 +84,7 @@ void GPGNetServer::sendMessage(GPGNetMessage const& msg)
   {
     (*it)->send(msgString);
   }
+  _messagesSent.add();
 }
 
 void GPGNetServer::sendCreateLobby(InitMode initMode,
@@ -172,6 +173,16 @@ void GPGNetServer::sendPing()
   sendMessage(msg);
 }
 
+std::uint64_t GPGNetServer::messagesReceived() const
+{
+  return _messagesReceived.value();
+}
+
+std::uint64_t GPGNetServer::messagesSent() const
+{
+  return _messagesSent.value();
+}
+
 void GPGNetServer::_onNewClient(rtc::AsyncSocket* socket)
 {
   if (socket != _server.get())
@@ -195,6 +206,7 @@ void GPGNetServer::_onClientDisconnect(GPGNetConnectionHandler* handler)
 
 void GPGNetServer::_onClientMessage(GPGNetMessage msg)
 {
+  _messagesReceived.add();
   SignalNewGPGNetMessage.emit(msg);
 }
 
@@ -9,6 +9,7 @@
 #include <webrtc/rtc_base/messagehandler.h>
 
 #include "GPGNetMessage.h"
+#include "Metrics.h"
 
 namespace faf {
 
@@ -74,6 +75,9 @@ public:
 
   void sendPing();
 
+  std::uint64_t messagesReceived() const;
+  std::uint64_t messagesSent() const;
+
   sigslot::signal1<GPGNetMessage, sigslot::multi_threaded_local> SignalNewGPGNetMessage;
   sigslot::signal0<sigslot::multi_threaded_local> SignalClientConnected;
   sigslot::signal0<sigslot::multi_threaded_local> SignalClientDisconnected;
@@ -85,6 +89,8 @@ protected:
   virtual void OnMessage(rtc::Message* msg) override;
   std::unique_ptr<rtc::AsyncSocket> _server;
   std::set<GPGNetConnectionHandler*> _connectedSockets;
+  Counter _messagesReceived;
+  Counter _messagesSent;
 
   RTC_DISALLOW_COPY_AND_ASSIGN(GPGNetServer);
 };
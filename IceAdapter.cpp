@@ -1,39 +1,62 @@
 #include "IceAdapter.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include <webrtc/rtc_base/thread.h>
 #include <webrtc/api/mediaconstraintsinterface.h>
 #include <webrtc/api/test/fakeconstraints.h>
 #include <webrtc/third_party/jsoncpp/source/include/json/json.h>
-#include <webrtc/media/engine/webrtcmediaengine.h>
 
+#include "EventLog.h"
+#include "JsonMergePatch.h"
+#include "JsonRpcCodec.h"
+#include "Metrics.h"
 #include "logging.h"
 
 namespace faf {
 
 IceAdapter::IceAdapter(IceAdapterOptions const& options):
+  IceAdapter(options, std::make_shared<PeerConnectionFactory>(options))
+{
+}
+
+IceAdapter::IceAdapter(IceAdapterOptions const& options,
+                       std::shared_ptr<PeerConnectionFactory> pcfactory,
+                       EventLog& eventLog):
   _options(options),
+  _pcfactory(pcfactory),
+  _eventLog(eventLog),
   _gpgnetGameState("None"),
   _gametaskString("Idle"),
   _lobbyInitMode("normal"),
   _lobbyPort(_options.gameUdpPort)
 {
+  JsonRpcFraming rpcFraming;
+  if (parseJsonRpcFraming(_options.rpcFraming, rpcFraming))
+  {
+    _jsonRpcServer.setFraming(rpcFraming);
+  }
+  else
+  {
+    FAF_LOG_ERROR << "unknown JSON-RPC framing " << _options.rpcFraming << ", using brace";
+  }
+  _jsonRpcServer.setNotificationBatching(_options.rpcBatchNotifications);
   _jsonRpcServer.listen(_options.rpcPort);
   _gpgnetServer.listen(_options.gpgNetPort);
-
-  _pcfactory = webrtc::CreateModularPeerConnectionFactory(nullptr,
-                                                          nullptr,
-                                                          nullptr,
-                                                          nullptr,
-                                                          nullptr,
-                                                          nullptr);
-  if (!_pcfactory)
+  if (_options.metricsPort > 0)
   {
-    FAF_LOG_ERROR << "Error in CreatePeerConnectionFactory()";
-    std::exit(1);
+    _metricsServer = std::make_unique<MetricsServer>(std::bind(&IceAdapter::_writeMetrics, this, std::placeholders::_1));
+    _metricsServer->listen(_options.metricsPort);
   }
 
+  _icePolicy.transportType = _options.iceTransportType;
+  _icePolicy.disableIpv6 = _options.disableIpv6;
+  _icePolicy.disableTcp = _options.disableTcpCandidates;
+  _icePolicy.lanFirst = _options.lanFirst;
+  _icePolicy.directUdp = _options.directUdp;
+  parseNetworkTypes(_options.ignoreNetworks, _icePolicy.ignoredNetworks);
+
   /* ICE adapter should determine lobby port. This may fail due to race conditions, but we can't pass a socket to the game */
   if (_lobbyPort == 0)
   {
@@ -50,7 +73,9 @@ IceAdapter::IceAdapter(IceAdapterOptions const& options):
   _gpgnetServer.SignalNewGPGNetMessage.connect(this, &IceAdapter::_onGpgNetMessage);
   _gpgnetServer.SignalClientConnected.connect(this, &IceAdapter::_onGameConnected);
   _gpgnetServer.SignalClientDisconnected.connect(this, &IceAdapter::_onGameDisconnected);
+  _jsonRpcServer.SignalClientDisconnected.connect(this, &IceAdapter::_onRpcClientDisconnected);
   _connectRpcMethods();
+  _eventLog.write(EventId::AdapterStarted, 0, static_cast<std::uint64_t>(_options.localPlayerId), FAF_VERSION_STRING);
 }
 
 void IceAdapter::hostGame(std::string const& map)
@@ -60,6 +85,7 @@ void IceAdapter::hostGame(std::string const& map)
                  "",
                  0});
   _gametaskString = "Hosting map " + map + ".";
+  _onStatusChanged();
 }
 
 void IceAdapter::joinGame(std::string const& remotePlayerLogin,
@@ -73,6 +99,7 @@ void IceAdapter::joinGame(std::string const& remotePlayerLogin,
                  remotePlayerLogin,
                  remotePlayerId});
   _gametaskString = "Joining game from player " + remotePlayerLogin + ".";
+  _onStatusChanged();
 }
 
 void IceAdapter::connectToPeer(std::string const& remotePlayerLogin,
@@ -97,6 +124,8 @@ void IceAdapter::disconnectFromPeer(int remotePlayerId)
     return;
   }
   _relays.erase(relayIt);
+  _eventLog.write(EventId::RelayRemoved, remotePlayerId);
+  _notifyStatusSubscribers();
   FAF_LOG_INFO << "removed relay for peer " << remotePlayerId;
   _queueGameTask({IceAdapterGameTask::DisconnectFromPeer,
                   "",
@@ -104,9 +133,98 @@ void IceAdapter::disconnectFromPeer(int remotePlayerId)
                   remotePlayerId});
 }
 
+Json::Value IceAdapter::relayStats(int remotePlayerId) const
+{
+  auto relayIt = _relays.find(remotePlayerId);
+  if (relayIt == _relays.end())
+  {
+    return Json::Value();
+  }
+  return relayIt->second->statsSamples();
+}
+
+Json::Value IceAdapter::relayCounters(int remotePlayerId) const
+{
+  auto relayIt = _relays.find(remotePlayerId);
+  if (relayIt == _relays.end())
+  {
+    return Json::Value();
+  }
+  return relayIt->second->counters();
+}
+
+Json::Value IceAdapter::relayCounters() const
+{
+  Json::Value result(Json::objectValue);
+  for (auto const& relay : _relays)
+  {
+    result[std::to_string(relay.first)] = relay.second->counters();
+  }
+  return result;
+}
+
+bool IceAdapter::dumpFlightRecorder(int remotePlayerId, std::string& path, std::string& error) const
+{
+  auto relayIt = _relays.find(remotePlayerId);
+  if (relayIt == _relays.end())
+  {
+    error = "no relay for remote peer " + std::to_string(remotePlayerId);
+    return false;
+  }
+  if (path.empty())
+  {
+    if (_options.logDirectory.empty())
+    {
+      error = "no path given and no --log-directory set";
+      return false;
+    }
+    path = _options.logDirectory + "/" + FlightRecorder::fileName(remotePlayerId);
+  }
+  if (!relayIt->second->dumpFlightRecorder(path, "request"))
+  {
+    error = "unable to write " + path;
+    return false;
+  }
+  return true;
+}
+
+void IceAdapter::setIcePolicy(IcePolicy const& policy)
+{
+  _icePolicy = policy;
+  for (auto it = _relays.begin(), end = _relays.end(); it != end; ++it)
+  {
+    if (_relayIcePolicies.count(it->first) == 0)
+    {
+      it->second->setIcePolicy(policy);
+    }
+  }
+  _onStatusChanged();
+}
+
+void IceAdapter::setIcePolicy(int remotePlayerId, IcePolicy const& policy)
+{
+  _relayIcePolicies[remotePlayerId] = policy;
+  auto relayIt = _relays.find(remotePlayerId);
+  if (relayIt != _relays.end())
+  {
+    relayIt->second->setIcePolicy(policy);
+  }
+}
+
+IcePolicy IceAdapter::icePolicy(int remotePlayerId) const
+{
+  auto policyIt = _relayIcePolicies.find(remotePlayerId);
+  if (policyIt != _relayIcePolicies.end())
+  {
+    return policyIt->second;
+  }
+  return _icePolicy;
+}
+
 void IceAdapter::setLobbyInitMode(std::string const& initMode)
 {
   _lobbyInitMode = initMode;
+  _onStatusChanged();
 }
 
 void IceAdapter::iceMsg(int remotePlayerId, Json::Value const& msg)
@@ -132,7 +250,7 @@ void IceAdapter::sendToGpgNet(GPGNetMessage const& message)
 
 void IceAdapter::setIceServers(Json::Value const& servers)
 {
-  _iceServers.clear();
+  _configuredIceServers.clear();
   for(std::size_t iServer = 0; iServer < servers.size(); ++iServer)
   {
     auto serverJson = servers[Json::ArrayIndex(iServer)];
@@ -155,17 +273,70 @@ void IceAdapter::setIceServers(Json::Value const& servers)
       dbgMsg += iceServer.password + " user:";
       iceServer.username = serverJson["username"].asString();
       dbgMsg += iceServer.username;
-      _iceServers.push_back(iceServer);
+      _configuredIceServers.push_back(iceServer);
       FAF_LOG_DEBUG << dbgMsg;
     }
   }
+  _iceServerRanking.clear();
+  _applyIceServers(_configuredIceServers);
+  _iceServerProbeTimer.stop();
+  if (_options.iceServerProbeInterval > 0 &&
+      !_configuredIceServers.empty())
+  {
+    _probeIceServers();
+    _iceServerProbeTimer.start(_options.iceServerProbeInterval * 1000, [this]()
+    {
+      _probeIceServers();
+    });
+  }
+}
+
+void IceAdapter::_probeIceServers()
+{
+  _iceServerProber.probe(_configuredIceServers,
+                         std::bind(&IceAdapter::_onIceServersProbed, this, std::placeholders::_1));
+}
+
+void IceAdapter::_onIceServersProbed(std::vector<IceServerProber::Result> const& ranking)
+{
+  _iceServerRanking = ranking;
+  auto reachable = std::count_if(ranking.begin(), ranking.end(), [](IceServerProber::Result const& result)
+  {
+    return result.reachable;
+  });
+  /* with UDP blocked nothing answers, the servers may still work via TCP */
+  if (reachable == 0)
+  {
+    FAF_LOG_WARN << "no ICE server answered the STUN probes, keeping the configured order";
+    _applyIceServers(_configuredIceServers);
+    return;
+  }
+  webrtc::PeerConnectionInterface::IceServers ranked;
+  for (auto const& result: ranking)
+  {
+    if (_options.iceServerLimit > 0 &&
+        ranked.size() >= static_cast<std::size_t>(_options.iceServerLimit))
+    {
+      break;
+    }
+    ranked.push_back(_configuredIceServers.at(result.serverIndex));
+    FAF_LOG_DEBUG << "ICE server " << result.url << ": "
+                  << (result.reachable ? std::to_string(result.roundTripTime.count() / 1000.) + " ms" : "unreachable");
+  }
+  _applyIceServers(ranked);
+}
+
+void IceAdapter::_applyIceServers(webrtc::PeerConnectionInterface::IceServers const& iceServers)
+{
+  _iceServers = iceServers;
   for(auto it = _relays.begin(), end = _relays.end(); it != end; ++it)
   {
     it->second->setIceServers(_iceServers);
   }
+  _onStatusChanged();
 }
 
-Json::Value IceAdapter::status() const
+Json::Value IceAdapter::_statusWithoutRelays() const
 {
   Json::Value result;
   result["version"] = FAF_VERSION_STRING;
@@ -174,7 +345,7 @@ Json::Value IceAdapter::status() const
   /* ice servers */
   {
     Json::Value iceServers(Json::arrayValue);
-    for (auto it = _iceServers.begin(), end = _iceServers.end(); it != end; ++it)
+    for (auto it = _configuredIceServers.begin(), end = _configuredIceServers.end(); it != end; ++it)
     {
       Json::Value iceServer;
       if (!it->uri.empty())
@@ -194,6 +365,23 @@ Json::Value IceAdapter::status() const
       iceServers.append(iceServer);
     }
     result["ice_servers"] = iceServers;
+
+    Json::Value ranking(Json::arrayValue);
+    for (auto const& probeResult: _iceServerRanking)
+    {
+      Json::Value server;
+      server["url"] = probeResult.url;
+      server["reachable"] = probeResult.reachable;
+      server["rtt"] = probeResult.reachable ? Json::Value(probeResult.roundTripTime.count() / 1000.) : Json::Value();
+      auto const& configured = _configuredIceServers.at(probeResult.serverIndex);
+      server["used"] = std::any_of(_iceServers.begin(), _iceServers.end(), [&configured](webrtc::PeerConnectionInterface::IceServer const& used)
+      {
+        return used.urls == configured.urls && used.uri == configured.uri;
+      });
+      ranking.append(server);
+    }
+    result["ice_server_ranking"] = ranking;
+    result["ice_policy"] = _icePolicy.toJson();
   }
   /* Options */
   {
@@ -205,6 +393,30 @@ Json::Value IceAdapter::status() const
     options["gpgnet_port"]          = _gpgnetServer.listenPort();
     options["lobby_port"]           = _options.gameUdpPort;
     options["log_file"]             = std::string(_options.logDirectory);
+    options["rpc_framing"]          = _options.rpcFraming;
+    options["rpc_batch_notifications"] = _options.rpcBatchNotifications;
+    options["metrics_port"]         = _metricsServer ? _metricsServer->listenPort() : 0;
+    options["ice_server_limit"]     = _options.iceServerLimit;
+    options["ice_server_probe_interval"] = _options.iceServerProbeInterval;
+    options["ice_transport_type"]   = _options.iceTransportType;
+    options["disable_ipv6"]         = _options.disableIpv6;
+    options["disable_tcp_candidates"] = _options.disableTcpCandidates;
+    options["ignore_networks"]      = _options.ignoreNetworks;
+    options["lan_first"]            = _options.lanFirst;
+    options["direct_udp"]           = _options.directUdp;
+    options["event_log_size"]       = _options.eventLogSize;
+    options["hold_queue_bytes"]     = _options.holdQueueBytes;
+    options["hold_queue_max_age"]   = _options.holdQueueMaxAge;
+    options["congestion_policy"]    = _options.congestionPolicy;
+    options["congestion_threshold"] = _options.congestionThreshold;
+    options["sessions"]             = _options.sessions;
+    options["pc_factories"]         = _options.pcFactories;
+    options["game_thread_cpus"]     = _options.gameThreadCpus;
+    options["network_thread_cpus"]  = _options.networkThreadCpus;
+    options["worker_thread_cpus"]   = _options.workerThreadCpus;
+    options["game_thread_priority"]    = _options.gameThreadPriority;
+    options["network_thread_priority"] = _options.networkThreadPriority;
+    options["worker_thread_priority"]  = _options.workerThreadPriority;
     result["options"] = options;
   }
   /* GPGNet */
@@ -217,6 +429,13 @@ Json::Value IceAdapter::status() const
     gpgnet["task_string"] = _gametaskString;
     result["gpgnet"] = gpgnet;
   }
+  return result;
+}
+
+Json::Value IceAdapter::status() const
+{
+  _updateStatusCache();
+  Json::Value result(_statusCache);
   /* Relays */
   {
     Json::Value relays(Json::arrayValue);
@@ -229,11 +448,78 @@ Json::Value IceAdapter::status() const
   return result;
 }
 
+std::string const& IceAdapter::serializedStatus() const
+{
+  _updateStatusCache();
+  _serializedStatus.assign(_serializedStatusCache);
+  _serializedStatus += ",\"relays\":[";
+  bool first = true;
+  for (auto it = _relays.begin(), end = _relays.end(); it != end; ++it)
+  {
+    if (!first)
+    {
+      _serializedStatus += ',';
+    }
+    first = false;
+    _serializedStatus += it->second->serializedStatus();
+  }
+  _serializedStatus += "]}";
+  return _serializedStatus;
+}
+
+void IceAdapter::_updateStatusCache() const
+{
+  if (_statusCacheValid)
+  {
+    return;
+  }
+  _statusCache = _statusWithoutRelays();
+  _serializedStatusCache.clear();
+  FastJsonCodec().write(_statusCache, _serializedStatusCache);
+  /* drop the closing brace, serializedStatus() appends the relays */
+  _serializedStatusCache.pop_back();
+  _statusCacheValid = true;
+}
+
+Json::Value IceAdapter::subscribeStatus(rtc::AsyncSocket* socket, int minIntervalMs)
+{
+  auto& subscription = _statusSubscriptions[socket];
+  subscription.minInterval = std::chrono::milliseconds(std::max(0, minIntervalMs));
+  subscription.lastUpdate = std::chrono::steady_clock::now();
+  subscription.lastStatus = _subscriptionStatus();
+  subscription.dirty = false;
+  return subscription.lastStatus;
+}
+
+void IceAdapter::unsubscribeStatus(rtc::AsyncSocket* socket)
+{
+  _statusSubscriptions.erase(socket);
+  if (_statusSubscriptions.empty())
+  {
+    _statusUpdateTimer.stop();
+  }
+}
+
 IceAdapterOptions const& IceAdapter::options() const
 {
   return _options;
 }
 
+std::size_t IceAdapter::relayCount() const
+{
+  return _relays.size();
+}
+
+int IceAdapter::rpcPort() const
+{
+  return _jsonRpcServer.listenPort();
+}
+
+int IceAdapter::gpgNetPort() const
+{
+  return _gpgnetServer.listenPort();
+}
+
 void IceAdapter::_connectRpcMethods()
 {
   _jsonRpcServer.setRpcCallback("quit",
@@ -436,13 +722,137 @@ void IceAdapter::_connectRpcMethods()
 
   });
 
-  _jsonRpcServer.setRpcCallback("status",
+  _jsonRpcServer.setRpcCallbackRaw("status",
+                                   [this](Json::Value const& paramsArray,
+                                          std::string & result,
+                                          Json::Value & error,
+                                          rtc::AsyncSocket* session)
+  {
+    result = serializedStatus();
+  });
+  _jsonRpcServer.setRpcCallback("subscribeStatus",
+                                [this](Json::Value const& paramsArray,
+                                       Json::Value & result,
+                                       Json::Value & error,
+                                       rtc::AsyncSocket* session)
+  {
+    if (paramsArray.size() > 0 &&
+        !paramsArray[0].isInt())
+    {
+      error = "Need 0 or 1 parameters: minIntervalMs (int)";
+      return;
+    }
+    result = subscribeStatus(session, paramsArray.size() > 0 ? paramsArray[0].asInt() : 0);
+  });
+  _jsonRpcServer.setRpcCallback("unsubscribeStatus",
+                                [this](Json::Value const& paramsArray,
+                                       Json::Value & result,
+                                       Json::Value & error,
+                                       rtc::AsyncSocket* session)
+  {
+    unsubscribeStatus(session);
+    result = "ok";
+  });
+  _jsonRpcServer.setRpcCallback("rpcStats",
                                 [this](Json::Value const& paramsArray,
                                        Json::Value & result,
                                        Json::Value & error,
                                        rtc::AsyncSocket* session)
   {
-    result = status();
+    result = _jsonRpcServer.stats();
+  });
+  _jsonRpcServer.setRpcCallback("setIcePolicy",
+                                [this](Json::Value const& paramsArray,
+                                       Json::Value & result,
+                                       Json::Value & error,
+                                       rtc::AsyncSocket* session)
+  {
+    if (paramsArray.size() < 1 ||
+        !paramsArray[0].isObject() ||
+        (paramsArray.size() > 1 && !paramsArray[1].isInt()))
+    {
+      error = "Need 1 or 2 parameters: policy (object), remotePlayerId (int)";
+      return;
+    }
+    bool forRelay = paramsArray.size() > 1;
+    auto policy = forRelay ? icePolicy(paramsArray[1].asInt()) : _icePolicy;
+    std::string policyError;
+    if (!policy.update(paramsArray[0], policyError))
+    {
+      error = policyError;
+      return;
+    }
+    if (forRelay)
+    {
+      setIcePolicy(paramsArray[1].asInt(), policy);
+    }
+    else
+    {
+      setIcePolicy(policy);
+    }
+    result = policy.toJson();
+  });
+  _jsonRpcServer.setRpcCallback("relayStats",
+                                [this](Json::Value const& paramsArray,
+                                       Json::Value & result,
+                                       Json::Value & error,
+                                       rtc::AsyncSocket* session)
+  {
+    if (paramsArray.size() < 1 ||
+        !paramsArray[0].isInt())
+    {
+      error = "Need 1 parameters: remotePlayerId (int)";
+      return;
+    }
+    result = relayStats(paramsArray[0].asInt());
+    if (result.isNull())
+    {
+      error = "no relay for remote peer " + std::to_string(paramsArray[0].asInt());
+    }
+  });
+  _jsonRpcServer.setRpcCallback("relayCounters",
+                                [this](Json::Value const& paramsArray,
+                                       Json::Value & result,
+                                       Json::Value & error,
+                                       rtc::AsyncSocket* session)
+  {
+    if (paramsArray.size() == 0)
+    {
+      result = relayCounters();
+      return;
+    }
+    if (!paramsArray[0].isInt())
+    {
+      error = "Need 0 or 1 parameters: remotePlayerId (int, optional)";
+      return;
+    }
+    result = relayCounters(paramsArray[0].asInt());
+    if (result.isNull())
+    {
+      error = "no relay for remote peer " + std::to_string(paramsArray[0].asInt());
+    }
+  });
+  _jsonRpcServer.setRpcCallback("dumpFlightRecorder",
+                                [this](Json::Value const& paramsArray,
+                                       Json::Value & result,
+                                       Json::Value & error,
+                                       rtc::AsyncSocket* session)
+  {
+    if (paramsArray.size() < 1 ||
+        !paramsArray[0].isInt() ||
+        (paramsArray.size() > 1 && !paramsArray[1].isString()))
+    {
+      error = "Need 1 or 2 parameters: remotePlayerId (int), path (string, optional)";
+      return;
+    }
+    std::string path = paramsArray.size() > 1 ? paramsArray[1].asString() : std::string();
+    std::string errorString;
+    if (!dumpFlightRecorder(paramsArray[0].asInt(), path, errorString))
+    {
+      error = errorString;
+      return;
+    }
+    result = path;
   });
 }
 
@@ -510,15 +920,18 @@ void IceAdapter::_tryExecuteGameTasks()
 void IceAdapter::_onGameConnected()
 {
   FAF_LOG_INFO << "game connected";
+  _eventLog.write(EventId::GameState, 0, "Connected");
   Json::Value params(Json::arrayValue);
   params.append("Connected");
   _jsonRpcServer.sendRequest("onConnectionStateChanged",
                              params);
+  _onStatusChanged();
 }
 
 void IceAdapter::_onGameDisconnected()
 {
   FAF_LOG_INFO << "game disconnected";
+  _eventLog.write(EventId::GameState, 0, "Disconnected");
   Json::Value params(Json::arrayValue);
   params.append("Disconnected");
   _jsonRpcServer.sendRequest("onConnectionStateChanged",
@@ -526,6 +939,7 @@ void IceAdapter::_onGameDisconnected()
   _gametaskString = "Idle";
   _gpgnetGameState = "None";
   _relays.clear();
+  _onStatusChanged();
 }
 
 void IceAdapter::_onGpgNetMessage(GPGNetMessage message)
@@ -536,6 +950,7 @@ void IceAdapter::_onGpgNetMessage(GPGNetMessage message)
     if (message.chunks.size() == 1)
     {
       _gpgnetGameState = message.chunks[0].asString();
+      _eventLog.write(EventId::GameState, 0, _gpgnetGameState);
       if (_gpgnetGameState == "Idle")
       {
         _gpgnetServer.sendCreateLobby(_lobbyInitMode == "normal" ? InitMode::NormalLobby : InitMode::AutoLobby,
@@ -545,6 +960,7 @@ void IceAdapter::_onGpgNetMessage(GPGNetMessage message)
                                       1);
       }
       _tryExecuteGameTasks();
+      _onStatusChanged();
     }
   }
   Json::Value rpcParams(Json::arrayValue);
@@ -608,17 +1024,228 @@ void IceAdapter::_createPeerRelay(int remotePlayerId,
                                onConnectedParams);
   };
 
+  callbacks.congestionCallback = [this, remotePlayerId](bool congested)
+  {
+    Json::Value onCongestionParams(Json::arrayValue);
+    onCongestionParams.append(_options.localPlayerId);
+    onCongestionParams.append(remotePlayerId);
+    onCongestionParams.append(congested);
+    _jsonRpcServer.sendRequest("onRelayCongestion",
+                               onCongestionParams);
+  };
+
+  /* relays cache their own status */
+  callbacks.statusChangedCallback = [this]()
+  {
+    _notifyStatusSubscribers();
+  };
+
   PeerRelay::Options options = {
     remotePlayerId,
     remotePlayerLogin,
     createOffer,
     _lobbyPort,
-    _iceServers
+    _iceServers,
+    icePolicy(remotePlayerId),
+    _options.logDirectory,
+    static_cast<std::size_t>(_options.holdQueueBytes),
+    _options.holdQueueMaxAge,
+    _options.congestionPolicy,
+    static_cast<std::size_t>(_options.congestionThreshold)
   };
+  options.eventLog = &_eventLog;
 
+  _eventLog.write(EventId::RelayCreated, remotePlayerId, remotePlayerLogin, createOffer);
   _relays[remotePlayerId] = std::make_shared<PeerRelay>(options,
                                                         callbacks,
-                                                        _pcfactory);
+                                                        _pcfactory->factory());
+  _notifyStatusSubscribers();
+}
+
+void IceAdapter::_writeMetrics(std::string& out) const
+{
+  writeMetricHeader(out, "faf_ice_adapter_info", "Version of the adapter", "gauge");
+  writeMetricSample(out, "faf_ice_adapter_info", {{"version", FAF_VERSION_STRING}}, 1);
+
+  writeMetricHeader(out, "faf_ice_adapter_game_connected", "Whether the game is connected to the GPGNet server", "gauge");
+  writeMetricSample(out, "faf_ice_adapter_game_connected", {}, _gpgnetServer.hasConnectedClient() ? 1 : 0);
+
+  writeMetricHeader(out, "faf_ice_adapter_gpgnet_messages_total", "GPGNet messages exchanged with the game", "counter");
+  writeMetricSample(out, "faf_ice_adapter_gpgnet_messages_total", {{"direction", "received"}}, _gpgnetServer.messagesReceived());
+  writeMetricSample(out, "faf_ice_adapter_gpgnet_messages_total", {{"direction", "sent"}}, _gpgnetServer.messagesSent());
+
+  auto rpcStats = _jsonRpcServer.stats();
+  auto const& methods = rpcStats["methods"];
+  writeMetricHeader(out, "faf_ice_adapter_rpc_calls_total", "JSON-RPC calls handled per method", "counter");
+  for (auto it = methods.begin(), end = methods.end(); it != end; ++it)
+  {
+    writeMetricSample(out, "faf_ice_adapter_rpc_calls_total", {{"method", it.memberName()}}, (*it)["calls"].asDouble());
+  }
+  writeMetricHeader(out, "faf_ice_adapter_rpc_errors_total", "JSON-RPC calls answered with an error per method", "counter");
+  for (auto it = methods.begin(), end = methods.end(); it != end; ++it)
+  {
+    writeMetricSample(out, "faf_ice_adapter_rpc_errors_total", {{"method", it.memberName()}}, (*it)["errors"].asDouble());
+  }
+
+  writeMetricHeader(out, "faf_ice_adapter_log_dropped_messages_total", "Log records dropped because the log file writer fell behind", "counter");
+  writeMetricSample(out, "faf_ice_adapter_log_dropped_messages_total", {}, logging_dropped_messages());
+
+  writeMetricHeader(out, "faf_ice_adapter_relays", "Number of PeerRelays", "gauge");
+  writeMetricSample(out, "faf_ice_adapter_relays", {}, static_cast<double>(_relays.size()));
+
+  auto relayLabels = [](PeerRelay const& relay, char const* direction = nullptr)
+  {
+    MetricLabels labels{{"remote_player_id", std::to_string(relay.remotePlayerId())},
+                        {"remote_player_login", relay.remotePlayerLogin()}};
+    if (direction)
+    {
+      labels.emplace_back("direction", direction);
+    }
+    return labels;
+  };
+  writeMetricHeader(out, "faf_ice_adapter_relay_connected", "Whether the ICE connection of the relay is established", "gauge");
+  for (auto const& relay : _relays)
+  {
+    writeMetricSample(out, "faf_ice_adapter_relay_connected", relayLabels(*relay.second), relay.second->isConnected() ? 1 : 0);
+  }
+  writeMetricHeader(out, "faf_ice_adapter_relay_packets_total", "Game packets forwarded by the relay", "counter");
+  for (auto const& relay : _relays)
+  {
+    auto const& metrics = relay.second->metrics();
+    writeMetricSample(out, "faf_ice_adapter_relay_packets_total", relayLabels(*relay.second, "game_to_peer"), metrics.gameToPeerPackets.value());
+    writeMetricSample(out, "faf_ice_adapter_relay_packets_total", relayLabels(*relay.second, "peer_to_game"), metrics.peerToGamePackets.value());
+  }
+  writeMetricHeader(out, "faf_ice_adapter_relay_bytes_total", "Game payload bytes forwarded by the relay", "counter");
+  for (auto const& relay : _relays)
+  {
+    auto const& metrics = relay.second->metrics();
+    writeMetricSample(out, "faf_ice_adapter_relay_bytes_total", relayLabels(*relay.second, "game_to_peer"), metrics.gameToPeerBytes.value());
+    writeMetricSample(out, "faf_ice_adapter_relay_bytes_total", relayLabels(*relay.second, "peer_to_game"), metrics.peerToGameBytes.value());
+  }
+  writeMetricHeader(out, "faf_ice_adapter_relay_dropped_packets_total", "Game packets dropped because the relay was not connected", "counter");
+  for (auto const& relay : _relays)
+  {
+    writeMetricSample(out, "faf_ice_adapter_relay_dropped_packets_total", relayLabels(*relay.second), relay.second->metrics().droppedGamePackets.value());
+  }
+  writeMetricHeader(out, "faf_ice_adapter_relay_congestion_dropped_packets_total", "Game packets dropped because the DataChannel send buffer exceeded the congestion threshold", "counter");
+  for (auto const& relay : _relays)
+  {
+    writeMetricSample(out, "faf_ice_adapter_relay_congestion_dropped_packets_total", relayLabels(*relay.second), relay.second->metrics().congestionDroppedPackets.value());
+  }
+  writeMetricHeader(out, "faf_ice_adapter_relay_congestion_episodes_total", "Times the DataChannel send buffer exceeded the congestion threshold", "counter");
+  for (auto const& relay : _relays)
+  {
+    writeMetricSample(out, "faf_ice_adapter_relay_congestion_episodes_total", relayLabels(*relay.second), relay.second->metrics().congestionEpisodes.value());
+  }
+  writeMetricHeader(out, "faf_ice_adapter_relay_reconnects_total", "Recreations of the peerconnection of the relay", "counter");
+  for (auto const& relay : _relays)
+  {
+    writeMetricSample(out, "faf_ice_adapter_relay_reconnects_total", relayLabels(*relay.second), relay.second->metrics().reconnects.value());
+  }
+  writeMetricHeader(out, "faf_ice_adapter_relay_rtt_seconds", "Round trip time of the last connectivity check ping", "gauge");
+  for (auto const& relay : _relays)
+  {
+    writeMetricSample(out, "faf_ice_adapter_relay_rtt_seconds", relayLabels(*relay.second), relay.second->metrics().roundTripTime.value());
+  }
+}
+
+Json::Value IceAdapter::_subscriptionStatus() const
+{
+  /* relays are keyed by the remote player id, so merge patches of single relays stay small */
+  Json::Value result = status();
+  Json::Value relays(Json::objectValue);
+  for (auto const& relay : result["relays"])
+  {
+    auto& keyedRelay = relays[std::to_string(relay["remote_player_id"].asInt())];
+    keyedRelay = relay;
+    /* the packet counters and the hold queue change all the time, they are polled via status or relayCounters */
+    keyedRelay.removeMember("counters");
+    keyedRelay.removeMember("hold_queue");
+  }
+  result["relays"] = relays;
+  return result;
+}
+
+void IceAdapter::_onStatusChanged()
+{
+  _statusCacheValid = false;
+  _notifyStatusSubscribers();
+}
+
+void IceAdapter::_notifyStatusSubscribers()
+{
+  if (_statusSubscriptions.empty())
+  {
+    return;
+  }
+  for (auto& subscription : _statusSubscriptions)
+  {
+    subscription.second.dirty = true;
+  }
+  _scheduleStatusUpdates();
+}
+
+void IceAdapter::_scheduleStatusUpdates()
+{
+  if (_statusUpdateTimer.started())
+  {
+    return;
+  }
+  /* changes within one event loop turn are always coalesced */
+  auto now = std::chrono::steady_clock::now();
+  auto delay = std::chrono::milliseconds::max();
+  for (auto const& subscription : _statusSubscriptions)
+  {
+    if (subscription.second.dirty)
+    {
+      auto due = subscription.second.lastUpdate + subscription.second.minInterval;
+      delay = std::min(delay, std::max(std::chrono::milliseconds(0),
+                                       std::chrono::duration_cast<std::chrono::milliseconds>(due - now)));
+    }
+  }
+  if (delay != std::chrono::milliseconds::max())
+  {
+    _statusUpdateTimer.singleShot(static_cast<int>(delay.count()),
+                                  std::bind(&IceAdapter::_sendStatusUpdates, this));
+  }
+}
+
+void IceAdapter::_sendStatusUpdates()
+{
+  auto now = std::chrono::steady_clock::now();
+  Json::Value currentStatus;
+  for (auto& subscription : _statusSubscriptions)
+  {
+    auto& s = subscription.second;
+    if (!s.dirty ||
+        now < s.lastUpdate + s.minInterval)
+    {
+      continue;
+    }
+    if (currentStatus.isNull())
+    {
+      currentStatus = _subscriptionStatus();
+    }
+    s.dirty = false;
+    auto patch = createJsonMergePatch(s.lastStatus, currentStatus);
+    if (patch.empty())
+    {
+      continue;
+    }
+    s.lastStatus = currentStatus;
+    s.lastUpdate = now;
+    Json::Value params(Json::arrayValue);
+    params.append(patch);
+    _jsonRpcServer.sendRequest("onStatusChanged",
+                               params,
+                               subscription.first);
+  }
+  _scheduleStatusUpdates();
+}
+
+void IceAdapter::_onRpcClientDisconnected(rtc::AsyncSocket* socket)
+{
+  unsubscribeStatus(socket);
 }
 
 } // namespace faf
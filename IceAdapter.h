@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <queue>
 #include <memory>
 
@@ -7,9 +8,14 @@
 #include <webrtc/api/peerconnectioninterface.h>
 
 #include "IceAdapterOptions.h"
+#include "EventLog.h"
 #include "GPGNetServer.h"
+#include "IceServerProber.h"
 #include "JsonRpcServer.h"
+#include "MetricsServer.h"
+#include "PeerConnectionFactory.h"
 #include "PeerRelay.h"
+#include "Timer.h"
 
 namespace faf {
 
@@ -32,6 +38,14 @@ class IceAdapter : public sigslot::has_slots<>
 public:
   IceAdapter(IceAdapterOptions const& options);
 
+  /** \brief Create an IceAdapter using a peer connection factory shared with other sessions
+       \param pcfactory: The factory, created with the same ignore-networks and thread options
+       \param eventLog: The event log of this session and its relays
+      */
+  IceAdapter(IceAdapterOptions const& options,
+             std::shared_ptr<PeerConnectionFactory> pcfactory,
+             EventLog& eventLog = faf::eventLog());
+
   /** \brief Sets the IceAdapter in hosting mode and tells the connected game to host the map once
    *         it reaches "Lobby" state
        \param map: Map to host
@@ -96,8 +110,70 @@ public:
       */
   Json::Value status() const;
 
+  /** \brief The status as compact JSON, assembled from cached fragments
+   *         which are only rebuilt when their inputs change
+      */
+  std::string const& serializedStatus() const;
+
+  /** \brief Subscribe a JSON-RPC client to status changes
+   *         The client receives "onStatusChanged" notifications containing
+   *         RFC 7386 merge patches against the previously sent status.
+       \param socket: The connection of the subscribing client
+       \param minIntervalMs: Minimum time between two notifications
+       \returns The current status as base for the following patches
+      */
+  Json::Value subscribeStatus(rtc::AsyncSocket* socket, int minIntervalMs);
+  void unsubscribeStatus(rtc::AsyncSocket* socket);
+
+  /** \brief Return the sampled getStats() time series of a relay
+       \param remotePlayerId: The ID of the remote player
+       \returns The samples, or null if there is no relay for the player
+      */
+  Json::Value relayStats(int remotePlayerId) const;
+
+  /** \brief Return the packet counters of a relay
+       \returns The counters, or null if there is no relay for the player
+      */
+  Json::Value relayCounters(int remotePlayerId) const;
+
+  /** \returns The packet counters of all relays keyed by remote player ID
+      */
+  Json::Value relayCounters() const;
+
+  /** \brief Write the last packets of a relay to a text file
+       \param remotePlayerId: The ID of the remote player
+       \param path: The file to write, a new file in the log directory if empty. Set to the written file.
+       \param error: Set to the reason if nothing was written
+      */
+  bool dumpFlightRecorder(int remotePlayerId, std::string& path, std::string& error) const;
+
+  /** \brief Set the default candidate policy of all relays without their own policy
+      */
+  void setIcePolicy(IcePolicy const& policy);
+
+  /** \brief Set the candidate policy of the relay to a remote player
+   *         The policy is kept for relays created later for the same player.
+      */
+  void setIcePolicy(int remotePlayerId, IcePolicy const& policy);
+
+  /** \returns The policy of the relay to the remote player, or the default policy
+      */
+  IcePolicy icePolicy(int remotePlayerId) const;
+
   IceAdapterOptions const& options() const;
 
+  /** \returns The number of relays to remote players
+      */
+  std::size_t relayCount() const;
+
+  /** \returns The port the JSON-RPC server listens on, also when --rpc-port is 0
+      */
+  int rpcPort() const;
+
+  /** \returns The port the GPGNet server listens on, also when --gpgnet-port is 0
+      */
+  int gpgNetPort() const;
+
 protected:
   void _connectRpcMethods();
   void _queueGameTask(IceAdapterGameTask t);
@@ -108,18 +184,52 @@ protected:
   void _createPeerRelay(int remotePlayerId,
                         std::string const& remotePlayerLogin,
                         bool createOffer);
+  void _writeMetrics(std::string& out) const;
+  Json::Value _statusWithoutRelays() const;
+  void _updateStatusCache() const;
+  Json::Value _subscriptionStatus() const;
+  void _onStatusChanged();
+  void _notifyStatusSubscribers();
+  void _scheduleStatusUpdates();
+  void _sendStatusUpdates();
+  void _onRpcClientDisconnected(rtc::AsyncSocket* socket);
+  void _probeIceServers();
+  void _onIceServersProbed(std::vector<IceServerProber::Result> const& ranking);
+  void _applyIceServers(webrtc::PeerConnectionInterface::IceServers const& iceServers);
+
+  struct StatusSubscription
+  {
+    std::chrono::milliseconds minInterval;
+    std::chrono::steady_clock::time_point lastUpdate;
+    Json::Value lastStatus;
+    bool dirty{false};
+  };
 
   IceAdapterOptions _options;
-  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> _pcfactory;
+  std::shared_ptr<PeerConnectionFactory> _pcfactory;
+  EventLog& _eventLog;
   GPGNetServer _gpgnetServer;
   JsonRpcServer _jsonRpcServer;
+  std::unique_ptr<MetricsServer> _metricsServer;
   std::queue<IceAdapterGameTask> _gameTasks;
   std::string _gpgnetGameState;
   std::map<int, std::shared_ptr<PeerRelay>> _relays;
   std::string _gametaskString;
-  webrtc::PeerConnectionInterface::IceServers _iceServers;
+  webrtc::PeerConnectionInterface::IceServers _configuredIceServers; /*!< as set by setIceServers() */
+  webrtc::PeerConnectionInterface::IceServers _iceServers;           /*!< ranked and limited, passed to the relays */
+  IceServerProber _iceServerProber;
+  std::vector<IceServerProber::Result> _iceServerRanking;
+  Timer _iceServerProbeTimer;
+  IcePolicy _icePolicy;                  /*!< default policy of new relays */
+  std::map<int, IcePolicy> _relayIcePolicies; /*!< policies set for single remote players */
   std::string _lobbyInitMode;
   int _lobbyPort;
+  mutable Json::Value _statusCache;          /*!< status() without relays */
+  mutable std::string _serializedStatusCache; /*!< _statusCache as JSON, without the closing brace */
+  mutable bool _statusCacheValid{false};
+  mutable std::string _serializedStatus;
+  std::map<rtc::AsyncSocket*, StatusSubscription> _statusSubscriptions;
+  Timer _statusUpdateTimer;
 
   RTC_DISALLOW_COPY_AND_ASSIGN(IceAdapter);
 };
@@ -4,6 +4,8 @@
 #include <iostream>
 
 #include "cxxopts.hpp"
+#include "IcePolicy.h"
+#include "ThreadSettings.h"
 
 namespace faf
 {
@@ -12,7 +14,27 @@ IceAdapterOptions::IceAdapterOptions():
   rpcPort(7236),
   gpgNetPort(0),
   gameUdpPort(0),
-  logLevel("info")
+  logLevel("info"),
+  rpcFraming("brace"),
+  rpcBatchNotifications(false),
+  metricsPort(0),
+  iceServerLimit(0),
+  iceServerProbeInterval(300),
+  iceTransportType("all"),
+  disableIpv6(false),
+  disableTcpCandidates(false),
+  lanFirst(false),
+  directUdp("off"),
+  eventLogSize(4),
+  holdQueueBytes(65536),
+  holdQueueMaxAge(2000),
+  congestionPolicy("drop-newest"),
+  congestionThreshold(16384),
+  sessions(1),
+  pcFactories(0),
+  gameThreadPriority("normal"),
+  networkThreadPriority("normal"),
+  workerThreadPriority("normal")
 {
 }
 
@@ -30,7 +52,31 @@ IceAdapterOptions IceAdapterOptions::init(int argc, char *argv[])
     ("gpgnet-port", "set the port of internal GPGNet server. Set to 0 to use an automatic port. (default: 0)", cxxopts::value<int>(result.gpgNetPort))
     ("lobby-port", "set the port the game lobby should use for incoming UDP packets from the PeerRelay. Set to 0 to use an automatic port. (default: 0)", cxxopts::value<int>(result.gameUdpPort))
     ("log-directory", "log to specified directory", cxxopts::value<std::string>(result.logDirectory))
+    ("event-log-size", "size in MiB of the binary connection event log ice_adapter_events.bin written to the log directory. Set to 0 to disable. (default: 4)", cxxopts::value<int>(result.eventLogSize))
     ("log-level", "set logging verbosity level: error, warn, info, verbose or debug", cxxopts::value<std::string>(result.logLevel))
+    ("rpc-batch-notifications", "send the JSON-RPC notifications of one event loop turn as a single JSON-RPC 2.0 batch array", cxxopts::value<bool>(result.rpcBatchNotifications))
+    ("metrics-port", "serve Prometheus metrics via HTTP on 127.0.0.1 at this port under /metrics. Set to 0 to disable. (default: 0)", cxxopts::value<int>(result.metricsPort))
+    ("ice-server-limit", "only pass the N ICE servers with the lowest measured STUN latency to the peer connections. Set to 0 to pass all, fastest first. (default: 0)", cxxopts::value<int>(result.iceServerLimit))
+    ("ice-server-probe-interval", "seconds between ICE server latency measurements. Set to 0 to disable them and keep the order given by setIceServers. (default: 300)", cxxopts::value<int>(result.iceServerProbeInterval))
+    ("ice-transport-type", "set the ICE candidate types to use: all, relay (TURN only) or nohost (default: all)", cxxopts::value<std::string>(result.iceTransportType))
+    ("disable-ipv6", "do not gather IPv6 candidates", cxxopts::value<bool>(result.disableIpv6))
+    ("disable-tcp-candidates", "do not gather TCP candidates", cxxopts::value<bool>(result.disableTcpCandidates))
+    ("ignore-networks", "comma separated network interface types whose candidates are not used: ethernet, wifi, cellular, vpn, loopback", cxxopts::value<std::string>(result.ignoreNetworks))
+    ("lan-first", "let offering relays try host candidates only for 3 seconds before gathering STUN/TURN candidates", cxxopts::value<bool>(result.lanFirst))
+    ("direct-udp", "send game data over encrypted UDP instead of the DataChannel: off, lan (only between private host candidates) or any (also across NATs via the first STUN server) (default: off)", cxxopts::value<std::string>(result.directUdp))
+    ("hold-queue-bytes", "hold up to this many bytes of game packets per relay while it is not connected and send them once it is. Set to 0 to drop them. (default: 65536)", cxxopts::value<int>(result.holdQueueBytes))
+    ("hold-queue-max-age", "milliseconds after which held game packets are dropped instead of sent (default: 2000)", cxxopts::value<int>(result.holdQueueMaxAge))
+    ("congestion-policy", "handling of game packets while more than congestion-threshold bytes wait in the DataChannel send buffer: none (buffer without limit), drop-newest, drop-oldest (queue them in the hold queue, dropping the oldest) or signal (notify the client via onRelayCongestion and drop above twice the threshold) (default: drop-newest)", cxxopts::value<std::string>(result.congestionPolicy))
+    ("congestion-threshold", "DataChannel buffered bytes which count as congestion (default: 16384)", cxxopts::value<int>(result.congestionThreshold))
+    ("sessions", "run this many independent IceAdapter sessions sharing one peer connection factory, for load tests. Player ID, login and all non-automatic ports are offset by the session index. (default: 1)", cxxopts::value<int>(result.sessions))
+    ("pc-factories", "number of peer connection factories shared by the sessions, each with its own network and worker thread. Set to 0 to use half the CPU cores. (default: 0)", cxxopts::value<int>(result.pcFactories))
+    ("game-thread-cpus", "pin the thread running the game, GPGNet and JSON-RPC sockets and the WebRTC signaling to these CPUs, e.g. 0,2-3 (default: all)", cxxopts::value<std::string>(result.gameThreadCpus))
+    ("network-thread-cpus", "pin the WebRTC network threads running the ICE, DTLS and SCTP sockets to these CPUs (default: all)", cxxopts::value<std::string>(result.networkThreadCpus))
+    ("worker-thread-cpus", "pin the WebRTC worker threads, which e.g. collect the stats, to these CPUs (default: all)", cxxopts::value<std::string>(result.workerThreadCpus))
+    ("game-thread-priority", "priority of the game thread: low, normal, high or highest (default: normal)", cxxopts::value<std::string>(result.gameThreadPriority))
+    ("network-thread-priority", "priority of the WebRTC network threads: low, normal, high or highest (default: normal)", cxxopts::value<std::string>(result.networkThreadPriority))
+    ("worker-thread-priority", "priority of the WebRTC worker threads: low, normal, high or highest (default: normal)", cxxopts::value<std::string>(result.workerThreadPriority))
+    ("rpc-framing", "set the JSON-RPC message framing: brace (concatenated JSON objects), ndjson (one message per line) or length (4 byte big endian length prefix) (default: brace)", cxxopts::value<std::string>(result.rpcFraming))
     ;
 
   options.parse(argc, argv);
@@ -58,6 +104,141 @@ IceAdapterOptions IceAdapterOptions::init(int argc, char *argv[])
     std::exit(1);
   }
 
+  if (result.rpcFraming != "brace" &&
+      result.rpcFraming != "ndjson" &&
+      result.rpcFraming != "length")
+  {
+    std::cerr << "Error: invalid rpc-framing " << result.rpcFraming << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.iceTransportType != "all" &&
+      result.iceTransportType != "relay" &&
+      result.iceTransportType != "nohost")
+  {
+    std::cerr << "Error: invalid ice-transport-type " << result.iceTransportType << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.directUdp != "off" &&
+      result.directUdp != "lan" &&
+      result.directUdp != "any")
+  {
+    std::cerr << "Error: invalid direct-udp " << result.directUdp << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.eventLogSize < 0)
+  {
+    std::cerr << "Error: invalid event-log-size " << result.eventLogSize << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.holdQueueBytes < 0 ||
+      result.holdQueueMaxAge < 0)
+  {
+    std::cerr << "Error: invalid hold-queue-bytes " << result.holdQueueBytes << " or hold-queue-max-age " << result.holdQueueMaxAge << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.congestionPolicy != "none" &&
+      result.congestionPolicy != "drop-newest" &&
+      result.congestionPolicy != "drop-oldest" &&
+      result.congestionPolicy != "signal")
+  {
+    std::cerr << "Error: invalid congestion-policy " << result.congestionPolicy << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.congestionThreshold <= 0)
+  {
+    std::cerr << "Error: invalid congestion-threshold " << result.congestionThreshold << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.sessions < 1)
+  {
+    std::cerr << "Error: invalid sessions " << result.sessions << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  if (result.pcFactories < 0)
+  {
+    std::cerr << "Error: invalid pc-factories " << result.pcFactories << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  for (auto const& cpus: {std::make_pair("game-thread-cpus", result.gameThreadCpus),
+                          std::make_pair("network-thread-cpus", result.networkThreadCpus),
+                          std::make_pair("worker-thread-cpus", result.workerThreadCpus)})
+  {
+    std::vector<int> parsed;
+    if (!parseCpuList(cpus.second, parsed))
+    {
+      std::cerr << "Error: invalid " << cpus.first << " " << cpus.second << "\n" << std::endl;
+      std::cout << options.help() << std::endl;
+      std::exit(1);
+    }
+  }
+
+  for (auto const& priority: {std::make_pair("game-thread-priority", result.gameThreadPriority),
+                              std::make_pair("network-thread-priority", result.networkThreadPriority),
+                              std::make_pair("worker-thread-priority", result.workerThreadPriority)})
+  {
+    ThreadPriority parsed;
+    if (!parseThreadPriority(priority.second, parsed))
+    {
+      std::cerr << "Error: invalid " << priority.first << " " << priority.second << "\n" << std::endl;
+      std::cout << options.help() << std::endl;
+      std::exit(1);
+    }
+  }
+
+  int ignoredNetworks;
+  if (!parseNetworkTypes(result.ignoreNetworks, ignoredNetworks))
+  {
+    std::cerr << "Error: invalid ignore-networks " << result.ignoreNetworks << "\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    std::exit(1);
+  }
+
+  return result;
+}
+
+IceAdapterOptions IceAdapterOptions::forSession(int index) const
+{
+  IceAdapterOptions result(*this);
+  if (index == 0)
+  {
+    return result;
+  }
+  result.localPlayerId += index;
+  result.localPlayerLogin += "_" + std::to_string(index);
+  if (result.rpcPort > 0)
+  {
+    result.rpcPort += index;
+  }
+  if (result.gpgNetPort > 0)
+  {
+    result.gpgNetPort += index;
+  }
+  if (result.gameUdpPort > 0)
+  {
+    result.gameUdpPort += index;
+  }
+  if (result.metricsPort > 0)
+  {
+    result.metricsPort += index;
+  }
   return result;
 }
 
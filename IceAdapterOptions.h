@@ -17,6 +17,36 @@ public:
   int gameUdpPort;        /*!< UDP port the game should use to communicate to the internal Relays */
   std::string logDirectory;    /*!< an optional file loggin directory, default: "" - no file log */
   std::string logLevel;   /*!< logging verbosity level, default: "debug"*/
+  std::string rpcFraming; /*!< JSON-RPC message framing: "brace", "ndjson" or "length", default: "brace" */
+  bool rpcBatchNotifications; /*!< coalesce the JSON-RPC notifications of one event loop turn into a batch, default: false */
+  int metricsPort;        /*!< Port of the local HTTP server serving Prometheus metrics, default: 0 - disabled */
+  int iceServerLimit;     /*!< Number of fastest ICE servers passed to the relays, default: 0 - all, ordered by latency */
+  int iceServerProbeInterval; /*!< Seconds between ICE server latency probes, default: 300, 0 - no probing */
+  std::string iceTransportType; /*!< candidate types to use: "all", "relay" or "nohost", default: "all" */
+  bool disableIpv6;       /*!< do not gather IPv6 candidates, default: false */
+  bool disableTcpCandidates; /*!< do not gather TCP candidates, default: false */
+  std::string ignoreNetworks; /*!< comma separated network interface types to ignore, default: "" */
+  bool lanFirst;          /*!< try host candidates only before gathering STUN/TURN candidates, default: false */
+  std::string directUdp;  /*!< bypass the DataChannel with authenticated UDP: "off", "lan" or "any", default: "off" */
+  int eventLogSize;       /*!< size of the binary event log in the log directory in MiB, default: 4, 0 - disabled */
+  int holdQueueBytes;     /*!< game packets held per relay while not connected, default: 65536, 0 - drop them */
+  int holdQueueMaxAge;    /*!< milliseconds after which held game packets are dropped, default: 2000 */
+  std::string congestionPolicy; /*!< handling of game packets while the DataChannel send buffer is full: "none", "drop-newest", "drop-oldest" or "signal", default: "drop-newest" */
+  int congestionThreshold; /*!< DataChannel buffered bytes which count as congestion, default: 16384 */
+  int sessions;           /*!< number of independent IceAdapter sessions run by the process, default: 1 */
+  int pcFactories;        /*!< number of peer connection factories, each with a network and a worker thread, shared by the sessions, default: 0 - half the CPU cores */
+  std::string gameThreadCpus;    /*!< CPUs of the thread running the game, GPGNet, JSON-RPC and signaling, e.g. "0,2-3", default: "" - all */
+  std::string networkThreadCpus; /*!< CPUs of the libwebrtc network threads, default: "" - all */
+  std::string workerThreadCpus;  /*!< CPUs of the libwebrtc worker threads, default: "" - all */
+  std::string gameThreadPriority;    /*!< "low", "normal", "high" or "highest", default: "normal" */
+  std::string networkThreadPriority; /*!< "low", "normal", "high" or "highest", default: "normal" */
+  std::string workerThreadPriority;  /*!< "low", "normal", "high" or "highest", default: "normal" */
+
+  /** \brief The options of session index of a multi-session host
+   *         Player ID and all non-automatic ports are offset by the index,
+   *         the login gets the index appended. Session 0 keeps the options unchanged.
+      */
+  IceAdapterOptions forSession(int index) const;
 
   /** \brief Create an options object from cmd arguments
       */
@@ -0,0 +1,159 @@
+#include "IcePolicy.h"
+
+#include <sstream>
+#include <utility>
+
+#include <webrtc/rtc_base/network_constants.h>
+
+namespace faf {
+
+static const std::pair<const char*, int> networkTypeNames[] = {
+  {"ethernet", rtc::ADAPTER_TYPE_ETHERNET},
+  {"wifi", rtc::ADAPTER_TYPE_WIFI},
+  {"cellular", rtc::ADAPTER_TYPE_CELLULAR},
+  {"vpn", rtc::ADAPTER_TYPE_VPN},
+  {"loopback", rtc::ADAPTER_TYPE_LOOPBACK}
+};
+
+bool parseNetworkTypes(std::string const& names, int& mask)
+{
+  int result = 0;
+  std::istringstream stream(names);
+  std::string name;
+  while (std::getline(stream, name, ','))
+  {
+    if (name.empty())
+    {
+      continue;
+    }
+    bool found = false;
+    for (auto const& networkType: networkTypeNames)
+    {
+      if (name == networkType.first)
+      {
+        result |= networkType.second;
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+    {
+      return false;
+    }
+  }
+  mask = result;
+  return true;
+}
+
+std::string networkTypesToString(int mask)
+{
+  std::string result;
+  for (auto const& networkType: networkTypeNames)
+  {
+    if (mask & networkType.second)
+    {
+      if (!result.empty())
+      {
+        result += ",";
+      }
+      result += networkType.first;
+    }
+  }
+  return result;
+}
+
+bool IcePolicy::update(Json::Value const& json, std::string& error)
+{
+  if (!json.isObject())
+  {
+    error = "policy must be an object";
+    return false;
+  }
+  IcePolicy result(*this);
+  if (json.isMember("transport_type"))
+  {
+    auto const& type = json["transport_type"];
+    if (!type.isString() ||
+        (type.asString() != "all" &&
+         type.asString() != "relay" &&
+         type.asString() != "nohost"))
+    {
+      error = "transport_type must be \"all\", \"relay\" or \"nohost\"";
+      return false;
+    }
+    result.transportType = type.asString();
+  }
+  for (auto member: {std::make_pair("disable_ipv6", &result.disableIpv6),
+                     std::make_pair("disable_tcp", &result.disableTcp),
+                     std::make_pair("lan_first", &result.lanFirst)})
+  {
+    if (json.isMember(member.first))
+    {
+      if (!json[member.first].isBool())
+      {
+        error = std::string(member.first) + " must be a bool";
+        return false;
+      }
+      *member.second = json[member.first].asBool();
+    }
+  }
+  if (json.isMember("direct_udp"))
+  {
+    auto const& mode = json["direct_udp"];
+    if (!mode.isString() ||
+        (mode.asString() != "off" &&
+         mode.asString() != "lan" &&
+         mode.asString() != "any"))
+    {
+      error = "direct_udp must be \"off\", \"lan\" or \"any\"";
+      return false;
+    }
+    result.directUdp = mode.asString();
+  }
+  if (json.isMember("ignored_networks"))
+  {
+    auto const& networks = json["ignored_networks"];
+    if (!networks.isString() ||
+        !parseNetworkTypes(networks.asString(), result.ignoredNetworks))
+    {
+      error = "ignored_networks must be a comma separated list of ethernet, wifi, cellular, vpn or loopback";
+      return false;
+    }
+  }
+  *this = result;
+  return true;
+}
+
+Json::Value IcePolicy::toJson() const
+{
+  Json::Value result;
+  result["transport_type"] = transportType;
+  result["disable_ipv6"] = disableIpv6;
+  result["disable_tcp"] = disableTcp;
+  result["ignored_networks"] = networkTypesToString(ignoredNetworks);
+  result["lan_first"] = lanFirst;
+  result["direct_udp"] = directUdp;
+  return result;
+}
+
+void IcePolicy::apply(webrtc::PeerConnectionInterface::RTCConfiguration& configuration) const
+{
+  if (transportType == "relay")
+  {
+    configuration.type = webrtc::PeerConnectionInterface::kRelay;
+  }
+  else if (transportType == "nohost")
+  {
+    configuration.type = webrtc::PeerConnectionInterface::kNoHost;
+  }
+  else
+  {
+    configuration.type = webrtc::PeerConnectionInterface::kAll;
+  }
+  configuration.disable_ipv6 = disableIpv6;
+  configuration.tcp_candidate_policy = disableTcp ?
+        webrtc::PeerConnectionInterface::kTcpCandidatePolicyDisabled :
+        webrtc::PeerConnectionInterface::kTcpCandidatePolicyEnabled;
+}
+
+} // namespace faf
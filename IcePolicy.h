@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+#include <webrtc/api/peerconnectioninterface.h>
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+namespace faf {
+
+/*! \brief Candidate gathering and filtering settings of a PeerRelay
+ *
+ *  Set globally via commandline options and per relay via the setIcePolicy RPC.
+ */
+struct IcePolicy
+{
+  std::string transportType{"all"}; /*!< "all", "relay" or "nohost" */
+  bool disableIpv6{false};
+  bool disableTcp{false};
+  int ignoredNetworks{0};           /*!< rtc::AdapterType bitmask, candidates of these interfaces are not used */
+  bool lanFirst{false};             /*!< the offerer tries host candidates only before gathering STUN/TURN candidates */
+  std::string directUdp{"off"};     /*!< send game data over authenticated plain UDP: "off", "lan" (private host candidate pairs only) or "any" */
+
+  /** \brief Overwrite the members present in the JSON object
+       \param error: set to a description of the first invalid member
+       \returns false if a member is invalid, the policy is unchanged then
+      */
+  bool update(Json::Value const& json, std::string& error);
+
+  Json::Value toJson() const;
+
+  /** \brief Set the transport type, IPv6 and TCP policy of a configuration
+      */
+  void apply(webrtc::PeerConnectionInterface::RTCConfiguration& configuration) const;
+};
+
+/** \brief Parse a comma separated list of network interface types:
+ *         "ethernet", "wifi", "cellular", "vpn" and "loopback"
+    \returns false if a name is unknown
+   */
+bool parseNetworkTypes(std::string const& names, int& mask);
+
+std::string networkTypesToString(int mask);
+
+} // namespace faf
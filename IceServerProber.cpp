@@ -0,0 +1,303 @@
+#include "IceServerProber.h"
+
+#include <algorithm>
+
+#include <webrtc/rtc_base/thread.h>
+
+#include "StunMessage.h"
+#include "logging.h"
+
+namespace faf {
+
+IceServerProber::IceServerProber(int probesPerServer,
+                                 int probeIntervalMs,
+                                 int timeoutMs):
+  _probesPerServer(std::max(1, probesPerServer)),
+  _probeIntervalMs(probeIntervalMs),
+  _timeoutMs(timeoutMs),
+  _random(std::random_device()())
+{
+}
+
+IceServerProber::~IceServerProber()
+{
+  _reset();
+}
+
+void IceServerProber::probe(webrtc::PeerConnectionInterface::IceServers const& servers,
+                            ResultCallback callback)
+{
+  _reset();
+  _callback = callback;
+
+  _socket = _createSocket(AF_INET);
+  if (!_socket)
+  {
+    FAF_LOG_ERROR << "IceServerProber unable to bind UDP socket";
+  }
+  /* hosts without IPv6 leave IPv6 servers unprobed */
+  _socket6 = _createSocket(AF_INET6);
+
+  _targets.resize(servers.size());
+  for (std::size_t i = 0; i < servers.size(); ++i)
+  {
+    auto& target = _targets[i];
+    target.result.serverIndex = i;
+    target.timer = std::make_unique<Timer>();
+
+    auto urls = servers[i].urls;
+    if (!servers[i].uri.empty())
+    {
+      urls.push_back(servers[i].uri);
+    }
+    std::string host;
+    int port = 0;
+    auto urlIt = std::find_if(urls.begin(), urls.end(), [&host, &port](std::string const& url)
+    {
+      return parseUrl(url, host, port);
+    });
+    if (urlIt == urls.end() ||
+        !_socket)
+    {
+      target.done = true;
+      continue;
+    }
+    target.result.url = *urlIt;
+    target.address = rtc::SocketAddress(host, port);
+    if (target.address.IsUnresolvedIP())
+    {
+      target.resolver = new rtc::AsyncResolver();
+      target.resolver->SignalDone.connect(this, &IceServerProber::_onResolved);
+      target.resolver->Start(target.address);
+    }
+    else
+    {
+      _sendProbe(i);
+    }
+  }
+  _finishIfDone();
+}
+
+bool IceServerProber::probing() const
+{
+  return static_cast<bool>(_callback);
+}
+
+bool IceServerProber::parseUrl(std::string const& url, std::string& host, int& port)
+{
+  auto schemeEnd = url.find(':');
+  if (schemeEnd == std::string::npos)
+  {
+    return false;
+  }
+  auto scheme = url.substr(0, schemeEnd);
+  std::transform(scheme.begin(), scheme.end(), scheme.begin(), ::tolower);
+  /* stuns:/turns: servers only listen for TLS */
+  if (scheme != "stun" &&
+      scheme != "turn")
+  {
+    return false;
+  }
+  auto hostPort = url.substr(schemeEnd + 1, url.find('?') - schemeEnd - 1);
+  std::size_t portSeparator;
+  if (!hostPort.empty() &&
+      hostPort.front() == '[')
+  {
+    auto bracketEnd = hostPort.find(']');
+    if (bracketEnd == std::string::npos)
+    {
+      return false;
+    }
+    host = hostPort.substr(1, bracketEnd - 1);
+    portSeparator = hostPort.find(':', bracketEnd);
+  }
+  else
+  {
+    portSeparator = hostPort.find(':');
+    host = hostPort.substr(0, portSeparator);
+  }
+  port = 3478;
+  if (portSeparator != std::string::npos)
+  {
+    auto portString = hostPort.substr(portSeparator + 1);
+    if (portString.empty() ||
+        !std::all_of(portString.begin(), portString.end(), ::isdigit) ||
+        portString.size() > 5)
+    {
+      return false;
+    }
+    port = std::stoi(portString);
+  }
+  return !host.empty() && port > 0 && port <= 65535;
+}
+
+std::unique_ptr<rtc::AsyncSocket> IceServerProber::_createSocket(int family)
+{
+  std::unique_ptr<rtc::AsyncSocket> socket(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(family, SOCK_DGRAM));
+  if (!socket ||
+      socket->Bind(rtc::SocketAddress(family == AF_INET6 ? "::" : "0.0.0.0", 0)) != 0)
+  {
+    return nullptr;
+  }
+  socket->SignalReadEvent.connect(this, &IceServerProber::_onRead);
+  return socket;
+}
+
+void IceServerProber::_onResolved(rtc::AsyncResolverInterface* resolver)
+{
+  auto targetIt = std::find_if(_targets.begin(), _targets.end(), [resolver](Target const& target)
+  {
+    return target.resolver == resolver;
+  });
+  if (targetIt == _targets.end())
+  {
+    return;
+  }
+  targetIt->resolver = nullptr;
+  rtc::SocketAddress address;
+  bool resolved = resolver->GetError() == 0 &&
+                  (resolver->GetResolvedAddress(AF_INET, &address) ||
+                   (_socket6 && resolver->GetResolvedAddress(AF_INET6, &address)));
+  resolver->Destroy(false);
+  if (!resolved)
+  {
+    FAF_LOG_DEBUG << "IceServerProber unable to resolve " << targetIt->result.url;
+    _finishTarget(*targetIt);
+    return;
+  }
+  targetIt->address = address;
+  /* the probes of this server start now, independent of the others */
+  _sendProbe(static_cast<std::size_t>(targetIt - _targets.begin()));
+}
+
+void IceServerProber::_sendProbe(std::size_t targetIndex)
+{
+  auto& target = _targets[targetIndex];
+  auto& socket = target.address.family() == AF_INET6 ? _socket6 : _socket;
+  if (!socket)
+  {
+    _finishTarget(target);
+    return;
+  }
+  auto transactionId = stun::randomTransactionId(_random);
+  auto request = stun::bindingRequest(transactionId);
+  _pendingProbes[transactionId] = {targetIndex, std::chrono::steady_clock::now()};
+  ++target.pendingProbes;
+  socket->SendTo(request.data(), request.size(), target.address);
+  if (++target.sentProbes < _probesPerServer)
+  {
+    target.timer->singleShot(_probeIntervalMs, [this, targetIndex]()
+    {
+      _sendProbe(targetIndex);
+    });
+  }
+  else
+  {
+    target.timer->singleShot(_timeoutMs, [this, targetIndex]()
+    {
+      _finishTarget(_targets[targetIndex]);
+    });
+  }
+}
+
+void IceServerProber::_onRead(rtc::AsyncSocket* socket)
+{
+  rtc::SocketAddress from;
+  int msgLength;
+  while ((msgLength = socket->RecvFrom(_readBuffer.data(), _readBuffer.size(), &from, nullptr)) > 0)
+  {
+    auto now = std::chrono::steady_clock::now();
+    stun::TransactionId transactionId;
+    if (!stun::parseBindingResponse(_readBuffer.data(), static_cast<std::size_t>(msgLength), transactionId))
+    {
+      continue;
+    }
+    auto probeIt = _pendingProbes.find(transactionId);
+    if (probeIt == _pendingProbes.end())
+    {
+      continue;
+    }
+    auto& target = _targets[probeIt->second.targetIndex];
+    auto roundTripTime = std::chrono::duration_cast<std::chrono::microseconds>(now - probeIt->second.sendTime);
+    if (!target.result.reachable ||
+        roundTripTime < target.result.roundTripTime)
+    {
+      target.result.roundTripTime = roundTripTime;
+    }
+    target.result.reachable = true;
+    _pendingProbes.erase(probeIt);
+    if (--target.pendingProbes == 0 &&
+        target.sentProbes >= _probesPerServer)
+    {
+      _finishTarget(target);
+    }
+  }
+}
+
+void IceServerProber::_finishTarget(Target& target)
+{
+  target.timer->stop();
+  target.done = true;
+  _finishIfDone();
+}
+
+void IceServerProber::_finishIfDone()
+{
+  auto done = std::all_of(_targets.begin(), _targets.end(), [](Target const& target)
+  {
+    return target.done;
+  });
+  if (!_callback ||
+      !done)
+  {
+    return;
+  }
+  /* deferred, the callback may start the next probe */
+  _finishTimer.singleShot(0, [this]()
+  {
+    _finish();
+  });
+}
+
+void IceServerProber::_finish()
+{
+  std::vector<Result> results;
+  results.reserve(_targets.size());
+  for (auto const& target: _targets)
+  {
+    results.push_back(target.result);
+  }
+  std::stable_sort(results.begin(), results.end(), [](Result const& a, Result const& b)
+  {
+    if (a.reachable != b.reachable)
+    {
+      return a.reachable;
+    }
+    return a.reachable && a.roundTripTime < b.roundTripTime;
+  });
+  auto callback = std::move(_callback);
+  _reset();
+  if (callback)
+  {
+    callback(results);
+  }
+}
+
+void IceServerProber::_reset()
+{
+  _finishTimer.stop();
+  for (auto& target: _targets)
+  {
+    if (target.resolver)
+    {
+      target.resolver->Destroy(false);
+    }
+  }
+  _targets.clear();
+  _pendingProbes.clear();
+  _socket.reset();
+  _socket6.reset();
+  _callback = ResultCallback();
+}
+
+} // namespace faf
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <webrtc/api/peerconnectioninterface.h>
+#include <webrtc/rtc_base/asyncsocket.h>
+#include <webrtc/rtc_base/nethelpers.h>
+
+#include "Timer.h"
+
+namespace faf {
+
+/*! \brief Measures the STUN Binding round trip time to ICE servers
+ *
+ *  Sends a few STUN Binding requests over UDP to the first stun: or turn:
+ *  URL of every server. TURN servers answer Binding requests as well,
+ *  so the same probe ranks both. The probes of a server with a hostname
+ *  start once the name is resolved. IPv6 servers are probed over an IPv6
+ *  socket if the host has one.
+ */
+class IceServerProber : public sigslot::has_slots<>
+{
+public:
+  struct Result
+  {
+    std::size_t serverIndex;   /*!< index into the probed server list */
+    std::string url;           /*!< the probed URL, empty if the server has none usable */
+    bool reachable{false};
+    std::chrono::microseconds roundTripTime{0}; /*!< fastest of the answered probes */
+  };
+
+  /* results ordered by round trip time, unreachable servers last in their original order */
+  typedef std::function<void (std::vector<Result> const& results)> ResultCallback;
+
+  IceServerProber(int probesPerServer = 3,
+                  int probeIntervalMs = 200,
+                  int timeoutMs = 2000);
+  virtual ~IceServerProber();
+
+  /** \brief Start probing the servers, replacing a running probe
+       \param callback: called once with the ranked results
+      */
+  void probe(webrtc::PeerConnectionInterface::IceServers const& servers,
+             ResultCallback callback);
+
+  bool probing() const;
+
+  /** \brief Parse host and port of a "stun:" or "turn:" URL
+       \returns false for other schemes and malformed URLs
+      */
+  static bool parseUrl(std::string const& url, std::string& host, int& port);
+
+protected:
+  struct Target
+  {
+    Result result;
+    rtc::SocketAddress address;
+    rtc::AsyncResolver* resolver{nullptr};
+    int sentProbes{0};
+    int pendingProbes{0};
+    bool done{false};
+    std::unique_ptr<Timer> timer; /*!< the next probe, or the timeout after the last one */
+  };
+
+  struct PendingProbe
+  {
+    std::size_t targetIndex;
+    std::chrono::steady_clock::time_point sendTime;
+  };
+
+  std::unique_ptr<rtc::AsyncSocket> _createSocket(int family);
+  void _onResolved(rtc::AsyncResolverInterface* resolver);
+  void _onRead(rtc::AsyncSocket* socket);
+  void _sendProbe(std::size_t targetIndex);
+  void _finishTarget(Target& target);
+  void _finishIfDone();
+  void _finish();
+  void _reset();
+
+  int _probesPerServer;
+  int _probeIntervalMs;
+  int _timeoutMs;
+  std::vector<Target> _targets;
+  std::map<std::array<uint8_t, 12>, PendingProbe> _pendingProbes;
+  ResultCallback _callback;
+  std::unique_ptr<rtc::AsyncSocket> _socket;
+  std::unique_ptr<rtc::AsyncSocket> _socket6;
+  Timer _finishTimer;
+  std::mt19937 _random;
+  std::array<uint8_t, 512> _readBuffer;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(IceServerProber);
+};
+
+} // namespace faf
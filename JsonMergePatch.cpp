@@ -0,0 +1,71 @@
+#include "JsonMergePatch.h"
+
+namespace faf {
+
+Json::Value createJsonMergePatch(Json::Value const& from, Json::Value const& to)
+{
+  Json::Value patch(Json::objectValue);
+  if (!from.isObject() ||
+      !to.isObject())
+  {
+    /* non-objects can only be replaced */
+    return to;
+  }
+  for (auto it = from.begin(), end = from.end(); it != end; ++it)
+  {
+    if (!to.isMember(it.memberName()))
+    {
+      patch[it.memberName()] = Json::Value();
+    }
+  }
+  for (auto it = to.begin(), end = to.end(); it != end; ++it)
+  {
+    auto const& name = it.memberName();
+    if (!from.isMember(name))
+    {
+      patch[name] = *it;
+      continue;
+    }
+    Json::Value const& fromMember = from[name];
+    if (fromMember == *it)
+    {
+      continue;
+    }
+    if (fromMember.isObject() &&
+        it->isObject())
+    {
+      patch[name] = createJsonMergePatch(fromMember, *it);
+    }
+    else
+    {
+      patch[name] = *it;
+    }
+  }
+  return patch;
+}
+
+void applyJsonMergePatch(Json::Value& target, Json::Value const& patch)
+{
+  if (!patch.isObject())
+  {
+    target = patch;
+    return;
+  }
+  if (!target.isObject())
+  {
+    target = Json::Value(Json::objectValue);
+  }
+  for (auto it = patch.begin(), end = patch.end(); it != end; ++it)
+  {
+    if (it->isNull())
+    {
+      target.removeMember(it.memberName());
+    }
+    else
+    {
+      applyJsonMergePatch(target[it.memberName()], *it);
+    }
+  }
+}
+
+} // namespace faf
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+namespace faf {
+
+/** \brief Create an RFC 7386 JSON merge patch which turns from into to
+ *         Removed members are set to null, arrays are replaced as a whole.
+ *         Members with null values can't be expressed and must be avoided in to.
+    \returns The patch, an empty object if both values are equal
+   */
+Json::Value createJsonMergePatch(Json::Value const& from, Json::Value const& to);
+
+/** \brief Apply an RFC 7386 JSON merge patch to target
+   */
+void applyJsonMergePatch(Json::Value& target, Json::Value const& patch);
+
+} // namespace faf
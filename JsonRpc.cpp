@@ -1,12 +1,16 @@
 #include "JsonRpc.h"
 
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
 #include "logging.h"
-#include "trim.h"
 
 namespace faf {
 
 JsonRpc::JsonRpc():
-  _currentId(0)
+  _currentId(0),
+  _codec(std::make_shared<FastJsonCodec>())
 {
 }
 
@@ -14,16 +18,133 @@ JsonRpc::~JsonRpc()
 {
 }
 
+void JsonRpc::RpcMethodStats::record(std::chrono::steady_clock::duration duration, bool failed)
+{
+  auto micros = static_cast<std::uint64_t>(std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(duration).count()));
+  ++calls;
+  if (failed)
+  {
+    ++errors;
+  }
+  totalMicroseconds += micros;
+  maxMicroseconds = std::max(maxMicroseconds, micros);
+  std::size_t bucket = 0;
+  while (bucket + 1 < latencyHistogram.size() &&
+         micros > bucketUpperBound(bucket))
+  {
+    ++bucket;
+  }
+  ++latencyHistogram[bucket];
+}
+
+std::uint64_t JsonRpc::RpcMethodStats::bucketUpperBound(std::size_t bucket)
+{
+  return std::uint64_t(1) << bucket;
+}
+
+Json::Value JsonRpc::RpcMethodStats::toJson() const
+{
+  Json::Value result;
+  result["calls"] = static_cast<Json::UInt64>(calls);
+  result["errors"] = static_cast<Json::UInt64>(errors);
+  result["mean_us"] = calls > 0 ? static_cast<double>(totalMicroseconds) / calls : 0.;
+  result["max_us"] = static_cast<Json::UInt64>(maxMicroseconds);
+
+  /* percentiles are estimated by the upper bound of their histogram bucket */
+  auto percentile = [this](double p) -> Json::UInt64
+  {
+    auto threshold = static_cast<std::uint64_t>(p * calls);
+    std::uint64_t count = 0;
+    for (std::size_t i = 0; i < latencyHistogram.size(); ++i)
+    {
+      count += latencyHistogram[i];
+      if (count > threshold)
+      {
+        return std::min(bucketUpperBound(i), maxMicroseconds);
+      }
+    }
+    return maxMicroseconds;
+  };
+  result["p50_us"] = calls > 0 ? percentile(0.5) : 0;
+  result["p99_us"] = calls > 0 ? percentile(0.99) : 0;
+
+  /* [upper bound in microseconds, count] for every non-empty bucket, the last bucket is unbounded */
+  Json::Value histogram(Json::arrayValue);
+  for (std::size_t i = 0; i < latencyHistogram.size(); ++i)
+  {
+    if (latencyHistogram[i] > 0)
+    {
+      Json::Value bucket(Json::arrayValue);
+      if (i + 1 < latencyHistogram.size())
+      {
+        bucket.append(static_cast<Json::UInt64>(bucketUpperBound(i)));
+      }
+      else
+      {
+        bucket.append(Json::Value());
+      }
+      bucket.append(static_cast<Json::UInt64>(latencyHistogram[i]));
+      histogram.append(bucket);
+    }
+  }
+  result["latency_histogram_us"] = histogram;
+  return result;
+}
+
 void JsonRpc::setRpcCallback(std::string const& method,
                              RpcCallback cb)
 {
-  _callbacks[method] = cb;
+  auto& entry = _method(method);
+  entry.callback = cb;
+  entry.callbackAsync = RpcCallbackAsync();
+  entry.callbackRaw = RpcCallbackRaw();
 }
 
 void JsonRpc::setRpcCallbackAsync(std::string const& method,
                                   RpcCallbackAsync cb)
 {
-  _callbacksAsync[method] = cb;
+  auto& entry = _method(method);
+  entry.callback = RpcCallback();
+  entry.callbackAsync = cb;
+  entry.callbackRaw = RpcCallbackRaw();
+}
+
+void JsonRpc::setRpcCallbackRaw(std::string const& method,
+                                RpcCallbackRaw cb)
+{
+  auto& entry = _method(method);
+  entry.callback = RpcCallback();
+  entry.callbackAsync = RpcCallbackAsync();
+  entry.callbackRaw = cb;
+}
+
+JsonRpc::RpcMethod& JsonRpc::_method(std::string const& name)
+{
+  auto it = _methods.find(name);
+  if (it == _methods.end())
+  {
+    /* deque elements never move, the key stays valid */
+    _methodNames.push_back(name);
+    it = _methods.emplace(_methodNames.back(), RpcMethod()).first;
+  }
+  return it->second;
+}
+
+Json::Value JsonRpc::stats() const
+{
+  Json::Value result;
+  Json::Value methods(Json::objectValue);
+  for (auto const& method : _methods)
+  {
+    if (method.second.stats.calls > 0)
+    {
+      methods[std::string(method.first)] = method.second.stats.toJson();
+    }
+  }
+  result["methods"] = methods;
+  result["unknown_method_calls"] = static_cast<Json::UInt64>(_unknownMethodCalls);
+  result["pending_requests"] = static_cast<Json::UInt64>(_currentRequests.size());
+  return result;
 }
 
 void JsonRpc::sendRequest(std::string const& method,
@@ -56,144 +177,229 @@ void JsonRpc::sendRequest(std::string const& method,
   request["jsonrpc"] = "2.0";
   request["method"] = method;
   request["params"] = paramsArray;
+  if (!resultCb &&
+      _batchNotifications)
+  {
+    /* notifications of one event loop turn are sent as one batch */
+    _queuedNotifications.emplace_back(socket, request);
+    if (!_notificationFlushTimer.started())
+    {
+      _notificationFlushTimer.singleShot(0, std::bind(&JsonRpc::_flushNotifications, this));
+    }
+    return;
+  }
+  int id = _currentId;
   if (resultCb)
   {
-    _currentRequests[_currentId] = resultCb;
-    request["id"] = _currentId;
-    ++_currentId;
+    if (_currentRequests.size() >= _maxPendingRequests)
+    {
+      FAF_LOG_ERROR << "too many pending requests, dropping request " << method;
+      resultCb(Json::Value(),
+               Json::Value("too many pending requests"));
+      return;
+    }
+    PendingRequest pending;
+    pending.callback = resultCb;
+    pending.socket = socket;
+    pending.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_requestTimeoutMs);
+    _currentRequests.emplace(id, std::move(pending));
+    request["id"] = id;
+    /* ids stay positive, a wrapped id can't collide with a pending one thanks to the timeout */
+    _currentId = _currentId == std::numeric_limits<int>::max() ? 0 : _currentId + 1;
+    _scheduleRequestExpiry();
   }
-  std::string requestString = Json::FastWriter().write(request);
-
-  if (!_sendMessage(requestString, socket))
+  if (!_sendJson(request, socket))
   {
     Json::Value error = "send failed";
     if (resultCb)
     {
+      _currentRequests.erase(id);
       resultCb(Json::Value(),
                error);
     }
   }
 }
 
-Json::Value JsonRpc::_parseJsonFromMsgBuffer(std::string& msgBuffer)
+void JsonRpc::setRequestTimeout(int timeoutMs)
 {
-  //FAF_LOG_TRACE << "parsing JSON string: " << msgBuffer;
-  Json::Value result;
+  _requestTimeoutMs = timeoutMs;
+}
 
-  if (msgBuffer.empty())
-  {
-    return result;
-  }
-  if (msgBuffer.at(0) != '{')
-  {
-    msgBuffer.clear();
-    FAF_LOG_ERROR << "invalid JSON msg";
-    return result;
-  }
+void JsonRpc::setMaxPendingRequests(std::size_t maxPendingRequests)
+{
+  _maxPendingRequests = maxPendingRequests;
+}
 
-  bool inString = false;
-  int braceNestingLevel = 0;
-  std::size_t msgPos = 0;
+std::size_t JsonRpc::pendingRequests() const
+{
+  return _currentRequests.size();
+}
 
-  for (; msgPos < msgBuffer.size(); ++msgPos)
-  {
-    const char& c = msgBuffer.at(msgPos);
-    if (c == '"')
-    {
-      inString = !inString;
-    }
+void JsonRpc::setFraming(JsonRpcFraming framing)
+{
+  _framing = framing;
+}
 
-    if (!inString)
-    {
-      if (c == '{')
-      {
-        ++braceNestingLevel;
-      }
+JsonRpcFraming JsonRpc::framing() const
+{
+  return _framing;
+}
 
-      if (c == '}')
-      {
-        --braceNestingLevel;
-        if (braceNestingLevel < 0)
-        {
-          msgBuffer.clear();
-          FAF_LOG_ERROR << "invalid JSON msg";
-          return result;
-        }
+void JsonRpc::setCodec(std::shared_ptr<JsonRpcCodec> codec)
+{
+  _codec = codec;
+}
 
-        /* parse msg */
-        if (braceNestingLevel == 0)
-        {
-          Json::Reader reader;
-          if (!reader.parse(std::string(msgBuffer.cbegin(),
-                                        msgBuffer.cbegin() + static_cast<std::string::difference_type>(msgPos + 1)),
-                            result))
-          {
-            FAF_LOG_ERROR << "error parsing JSON msg: " << reader.getFormatedErrorMessages();
-            msgBuffer.clear();
-            return result;
-          }
-          if (msgPos + 1 >= msgBuffer.size())
-          {
-            msgBuffer.clear();
-          }
-          else
-          {
-            msgBuffer = msgBuffer.substr(msgPos + 1);
-          }
-          return result;
-        }
-      }
-    }
+void JsonRpc::setNotificationBatching(bool enabled)
+{
+  _batchNotifications = enabled;
+  if (!enabled)
+  {
+    _flushNotifications();
   }
-  return result;
 }
 
 void JsonRpc::_processJsonMessage(Json::Value const& jsonMessage, rtc::AsyncSocket* socket)
 {
   //FAF_LOG_TRACE << "processing JSON msg: " << jsonMessage.toStyledString();
-  if (jsonMessage.isMember("method"))
+  if (jsonMessage.isArray())
+  {
+    _processBatch(jsonMessage, socket);
+  }
+  else if (jsonMessage.isMember("method"))
   {
     /* this message is a request */
-    _processRequest(jsonMessage, [this, socket, jsonMessage](Json::Value response)
+    _processRequest(jsonMessage, [this, socket](Json::Value response)
         {
           /* we don't need to respond to notifications */
-          if (jsonMessage.isMember("id"))
+          if (response.isMember("id"))
           {
-            std::string responseString = Json::FastWriter().write(response);
-            //FAF_LOG_TRACE << "sending response:" << responseString;
-            _sendMessage(responseString, socket);
+            _sendJson(response, socket);
           }
         },
-        socket);
+        socket,
+        [this, socket](Json::Value const& id, std::string const& rawResult)
+        {
+          _sendRawResult(id, rawResult, socket);
+        });
   }
   else if (jsonMessage.isMember("error") ||
            jsonMessage.isMember("result"))
   {
-    /* this message is a response */
-    if (jsonMessage.isMember("id"))
+    _processResponse(jsonMessage);
+  }
+}
+
+void JsonRpc::_processBatch(Json::Value const& batch, rtc::AsyncSocket* socket)
+{
+  if (batch.empty())
+  {
+    Json::Value response;
+    response["jsonrpc"] = "2.0";
+    response["id"] = Json::Value();
+    response["error"]["code"] = -32600;
+    response["error"]["message"] = "empty batch";
+    _sendJson(response, socket);
+    return;
+  }
+
+  struct BatchState
+  {
+    Json::Value responses{Json::arrayValue};
+    std::size_t pendingRequests{0};
+  };
+  auto state = std::make_shared<BatchState>();
+
+  for (Json::ArrayIndex i = 0, size = batch.size(); i < size; ++i)
+  {
+    Json::Value const& message = batch[i];
+    if (message.isObject() &&
+        message.isMember("method"))
     {
-      if (jsonMessage["id"].isInt())
-      {
-        auto reqIt = _currentRequests.find(jsonMessage["id"].asInt());
-        if (reqIt != _currentRequests.end())
-        {
-          try
-          {
-            reqIt->second(jsonMessage.isMember("result") ? jsonMessage["result"] : Json::Value(),
-                          jsonMessage.isMember("error") ? jsonMessage["error"] : Json::Value());
-          }
-          catch (std::exception& e)
+      ++state->pendingRequests;
+    }
+    else if (!message.isObject() ||
+             (!message.isMember("error") &&
+              !message.isMember("result")))
+    {
+      Json::Value response;
+      response["jsonrpc"] = "2.0";
+      response["id"] = Json::Value();
+      response["error"]["code"] = -32600;
+      response["error"]["message"] = "invalid batch entry";
+      state->responses.append(response);
+    }
+  }
+  const bool containsRequests = state->pendingRequests > 0;
+
+  /* the responses of a batch are sent in one array once all of its requests are answered */
+  for (Json::ArrayIndex i = 0, size = batch.size(); i < size; ++i)
+  {
+    Json::Value const& message = batch[i];
+    if (!message.isObject())
+    {
+      continue;
+    }
+    if (message.isMember("method"))
+    {
+      _processRequest(message, [this, socket, state](Json::Value response)
           {
-            FAF_LOG_ERROR << "exception in request handler for id " << jsonMessage["id"].asInt() << ": " << e.what();
-          }
-          _currentRequests.erase(reqIt);
-        }
-      }
+            if (response.isMember("id"))
+            {
+              state->responses.append(response);
+            }
+            if (--state->pendingRequests == 0 &&
+                !state->responses.empty())
+            {
+              _sendJson(state->responses, socket);
+            }
+          },
+          socket);
+    }
+    else if (message.isMember("error") ||
+             message.isMember("result"))
+    {
+      _processResponse(message);
     }
   }
+
+  if (!containsRequests &&
+      !state->responses.empty())
+  {
+    _sendJson(state->responses, socket);
+  }
 }
 
-void JsonRpc::_processRequest(Json::Value const& request, ResponseCallback responseCallback, rtc::AsyncSocket* socket)
+void JsonRpc::_processResponse(Json::Value const& response)
+{
+  if (!response.isMember("id") ||
+      !response["id"].isInt())
+  {
+    return;
+  }
+  auto reqIt = _currentRequests.find(response["id"].asInt());
+  if (reqIt == _currentRequests.end())
+  {
+    return;
+  }
+  /* the callback may send new requests, so remove the entry first */
+  auto resultCb = std::move(reqIt->second.callback);
+  _currentRequests.erase(reqIt);
+  try
+  {
+    resultCb(response.isMember("result") ? response["result"] : Json::Value(),
+             response.isMember("error") ? response["error"] : Json::Value());
+  }
+  catch (std::exception& e)
+  {
+    FAF_LOG_ERROR << "exception in request handler for id " << response["id"].asInt() << ": " << e.what();
+  }
+}
+
+void JsonRpc::_processRequest(Json::Value const& request,
+                              ResponseCallback responseCallback,
+                              rtc::AsyncSocket* socket,
+                              RawResponseCallback rawResponseCallback)
 {
   Json::Value response;
   response["jsonrpc"] = "2.0";
@@ -209,7 +415,8 @@ void JsonRpc::_processRequest(Json::Value const& request, ResponseCallback respo
     responseCallback(response);
     return;
   }
-  if (!request["method"].isString())
+  Json::Value const& methodValue = request["method"];
+  if (!methodValue.isString())
   {
     response["error"]["code"] = -1;
     response["error"]["message"] = "'method' parameter must be a string";
@@ -217,23 +424,76 @@ void JsonRpc::_processRequest(Json::Value const& request, ResponseCallback respo
     return;
   }
 
-  //FAF_LOG_TRACE << "dispatching JSRONRPC method '" << request["method"].asString() << "'";
+  //FAF_LOG_TRACE << "dispatching JSRONRPC method '" << methodValue.asString() << "'";
 
-  Json::Value params(Json::arrayValue);
-  if (request.isMember("params") &&
-      request["params"].isArray())
+  static const Json::Value emptyParams(Json::arrayValue);
+  Json::Value const& params = request.isMember("params") && request["params"].isArray() ? request["params"] : emptyParams;
+
+  /* points into the parsed request, no copy of the name */
+  char const* methodBegin = nullptr;
+  char const* methodEnd = nullptr;
+  methodValue.getString(&methodBegin, &methodEnd);
+  std::string_view methodName(methodBegin, static_cast<std::size_t>(methodEnd - methodBegin));
+  auto it = _methods.find(methodName);
+  if (it == _methods.end())
   {
-    params = request["params"];
+    ++_unknownMethodCalls;
+    FAF_LOG_ERROR << "RPC callback for method '" << methodName << "' not found";
+    response["error"] = std::string("RPC callback for method '") + std::string(methodName) + "' not found";
+    responseCallback(response);
+    return;
   }
 
-  auto it = _callbacks.find(request["method"].asString());
-  if (it != _callbacks.end())
+  RpcMethod* method = &it->second;
+  auto startTime = std::chrono::steady_clock::now();
+  if (method->callbackRaw)
+  {
+    try
+    {
+      std::string rawResult;
+      Json::Value error;
+      method->callbackRaw(params, rawResult, error, socket);
+      if (!error.isNull() ||
+          rawResult.empty())
+      {
+        response["error"] = error.isNull() ? Json::Value("invalid response") : error;
+      }
+      else if (rawResponseCallback)
+      {
+        method->stats.record(std::chrono::steady_clock::now() - startTime, false);
+        if (request.isMember("id"))
+        {
+          rawResponseCallback(request["id"], rawResult);
+        }
+        return;
+      }
+      else
+      {
+        /* batch responses are assembled as one document, so the result has to be parsed */
+        std::string parseError;
+        if (!_codec->parse(rawResult.data(), rawResult.data() + rawResult.size(), response["result"], parseError))
+        {
+          response.removeMember("result");
+          response["error"] = "invalid response";
+        }
+      }
+    }
+    catch (std::exception& e)
+    {
+      FAF_LOG_ERROR << "exception in callback for method '" << it->first << "': " << e.what();
+      response["error"] = std::string("exception in callback: ") + e.what();
+    }
+    method->stats.record(std::chrono::steady_clock::now() - startTime,
+                         response.isMember("error"));
+    responseCallback(response);
+  }
+  else if (method->callback)
   {
     try
     {
       Json::Value result;
       Json::Value error;
-      it->second(params, result, error, socket);
+      method->callback(params, result, error, socket);
 
       /* TODO: Better check for valid error/result combination */
       if (!result.isNull())
@@ -248,72 +508,237 @@ void JsonRpc::_processRequest(Json::Value const& request, ResponseCallback respo
       {
         response["error"] = "invalid response";
       }
-      responseCallback(response);
-      return;
     }
     catch (std::exception& e)
     {
-      FAF_LOG_ERROR << "exception in callback for method '" << request["method"].asString() << "': " << e.what();
+      FAF_LOG_ERROR << "exception in callback for method '" << it->first << "': " << e.what();
+      /* every request is answered, batches wait for all of their responses */
+      response["error"] = std::string("exception in callback: ") + e.what();
     }
+    method->stats.record(std::chrono::steady_clock::now() - startTime,
+                         response.isMember("error"));
+    responseCallback(response);
   }
-  else
+  else if (method->callbackAsync)
   {
-    auto itAsync = _callbacksAsync.find(request["method"].asString());
-    if (itAsync != _callbacksAsync.end())
+    /* the method entries are never erased, so the pointer stays valid for the async response */
+    try
     {
-      try
-      {
-        itAsync->second(params,
-          [response, responseCallback](Json::Value result)
-          {
-            Json::Value r(response);
-            r["result"] = result;
-            responseCallback(r);
-          },
-          [response, responseCallback](Json::Value error)
-          {
-            Json::Value r(response);
-            r["error"] = error;
-            responseCallback(r);
-          },
-          socket);
-      }
-      catch (std::exception& e)
+      method->callbackAsync(params,
+        [response, responseCallback, method, startTime](Json::Value result)
+        {
+          method->stats.record(std::chrono::steady_clock::now() - startTime, false);
+          Json::Value r(response);
+          r["result"] = result;
+          responseCallback(r);
+        },
+        [response, responseCallback, method, startTime](Json::Value error)
+        {
+          method->stats.record(std::chrono::steady_clock::now() - startTime, true);
+          Json::Value r(response);
+          r["error"] = error;
+          responseCallback(r);
+        },
+        socket);
+    }
+    catch (std::exception& e)
+    {
+      FAF_LOG_ERROR << "exception in callback for method '" << it->first << "': " << e.what();
+      method->stats.record(std::chrono::steady_clock::now() - startTime, true);
+      response["error"] = std::string("exception in callback: ") + e.what();
+      responseCallback(response);
+    }
+  }
+}
+
+bool JsonRpc::_sendRawResult(Json::Value const& id, std::string const& rawResult, rtc::AsyncSocket* socket)
+{
+  if (!_queuedNotifications.empty())
+  {
+    _flushNotifications();
+  }
+
+  _writeBuffer.clear();
+  auto frameStart = JsonRpcFramer::beginFrame(_writeBuffer, _framing);
+  _writeBuffer += "{\"id\":";
+  _codec->write(id, _writeBuffer);
+  _writeBuffer += ",\"jsonrpc\":\"2.0\",\"result\":";
+  _writeBuffer += rawResult;
+  _writeBuffer += '}';
+  JsonRpcFramer::endFrame(_writeBuffer, frameStart, _framing);
+  return _sendMessage(_writeBuffer, socket);
+}
+
+void JsonRpc::_flushNotifications()
+{
+  _notificationFlushTimer.stop();
+  /* swap the queue out, _sendJson() flushes it before sending anything else */
+  std::vector<std::pair<rtc::AsyncSocket*, Json::Value>> notifications;
+  notifications.swap(_queuedNotifications);
+
+  /* group by destination socket and keep the order of each destination */
+  for (std::size_t i = 0; i < notifications.size(); ++i)
+  {
+    auto socket = notifications[i].first;
+    if (notifications[i].second.isNull())
+    {
+      continue;
+    }
+    Json::Value batch(Json::arrayValue);
+    for (std::size_t j = i; j < notifications.size(); ++j)
+    {
+      if (notifications[j].first == socket &&
+          !notifications[j].second.isNull())
       {
-        FAF_LOG_ERROR << "exception in callback for method '" << request["method"].asString() << "': " << e.what();
+        batch.append(Json::Value());
+        batch[batch.size() - 1].swap(notifications[j].second);
       }
     }
+    if (batch.size() == 1)
+    {
+      _sendJson(batch[0], socket);
+    }
     else
     {
-      FAF_LOG_ERROR << "RPC callback for method '" << request["method"].asString() << "' not found";
-      response["error"] = std::string("RPC callback for method '") + request["method"].asString() + "' not found";;
-      responseCallback(response);
+      _sendJson(batch, socket);
+    }
+  }
+}
+
+void JsonRpc::_onSocketClosed(rtc::AsyncSocket* socket)
+{
+  _currentMsgs.erase(socket);
+  _queuedNotifications.erase(std::remove_if(_queuedNotifications.begin(),
+                                            _queuedNotifications.end(),
+                                            [socket](std::pair<rtc::AsyncSocket*, Json::Value> const& n)
+                                            {
+                                              return n.first == socket;
+                                            }),
+                             _queuedNotifications.end());
+
+  /* the socket code may still iterate its connections here,
+   * so the callbacks are invoked from the expiry timer */
+  bool failedRequests = false;
+  for (auto& request : _currentRequests)
+  {
+    if (request.second.socket == socket)
+    {
+      request.second.socketClosed = true;
+      failedRequests = true;
+    }
+  }
+  if (failedRequests)
+  {
+    _requestTimeoutTimer.singleShot(0, std::bind(&JsonRpc::_expireRequests, this));
+  }
+}
+
+void JsonRpc::_expireRequests()
+{
+  auto now = std::chrono::steady_clock::now();
+  std::vector<std::pair<RpcRequestResult, Json::Value>> failed;
+  for (auto it = _currentRequests.begin(); it != _currentRequests.end();)
+  {
+    if (it->second.socketClosed)
+    {
+      failed.emplace_back(std::move(it->second.callback), Json::Value("connection closed"));
+      it = _currentRequests.erase(it);
+    }
+    else if (it->second.deadline <= now)
+    {
+      failed.emplace_back(std::move(it->second.callback), Json::Value("request timed out"));
+      it = _currentRequests.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  _scheduleRequestExpiry();
+  if (!failed.empty())
+  {
+    FAF_LOG_DEBUG << failed.size() << " pending requests failed";
+  }
+
+  /* callbacks last, they may send new requests */
+  for (auto& f : failed)
+  {
+    try
+    {
+      f.first(Json::Value(), f.second);
+    }
+    catch (std::exception& e)
+    {
+      FAF_LOG_ERROR << "exception in request handler: " << e.what();
     }
   }
 }
 
+void JsonRpc::_scheduleRequestExpiry()
+{
+  if (_currentRequests.empty())
+  {
+    _requestTimeoutTimer.stop();
+    return;
+  }
+  if (_requestTimeoutTimer.started())
+  {
+    return;
+  }
+  /* the pending map is bounded, a scan for the earliest deadline is cheap */
+  auto earliest = _currentRequests.begin()->second.deadline;
+  for (auto const& request : _currentRequests)
+  {
+    earliest = std::min(earliest, request.second.deadline);
+  }
+  auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(earliest - std::chrono::steady_clock::now()).count();
+  _requestTimeoutTimer.singleShot(static_cast<int>(std::max<std::int64_t>(0, delay)),
+                                  std::bind(&JsonRpc::_expireRequests, this));
+}
+
+bool JsonRpc::_sendJson(Json::Value const& message, rtc::AsyncSocket* socket)
+{
+  /* keep queued notifications in order with everything sent afterwards */
+  if (!_queuedNotifications.empty())
+  {
+    _flushNotifications();
+  }
+
+  /* the buffer is reused to avoid an allocation per message */
+  _writeBuffer.clear();
+  auto frameStart = JsonRpcFramer::beginFrame(_writeBuffer, _framing);
+  _codec->write(message, _writeBuffer);
+  JsonRpcFramer::endFrame(_writeBuffer, frameStart, _framing);
+  return _sendMessage(_writeBuffer, socket);
+}
+
 void JsonRpc::_read(rtc::AsyncSocket* socket)
 {
   int msgLength = 0;
-  std::string& msgBuffer = _currentMsgs[socket];
+  auto framerIt = _currentMsgs.find(socket);
+  if (framerIt == _currentMsgs.end())
+  {
+    framerIt = _currentMsgs.emplace(std::piecewise_construct,
+                                    std::forward_as_tuple(socket),
+                                    std::forward_as_tuple(_framing, _codec)).first;
+  }
+  JsonRpcFramer& framer = framerIt->second;
   do
   {
     msgLength = socket->Recv(_readBuffer.data(), _readBuffer.size(), nullptr);
     if (msgLength > 0)
     {
-      msgBuffer.append(_readBuffer.data(), std::size_t(msgLength));
+      framer.append(_readBuffer.data(), std::size_t(msgLength));
     }
   }
   while (msgLength > 0);
+  Json::Value json;
   while (true)
   {
-    msgBuffer = trim_whitespace(msgBuffer);
-    if (msgBuffer.empty())
-    {
-      break;
-    }
-    Json::Value json = _parseJsonFromMsgBuffer(msgBuffer);
-    if (json.isNull())
+    /* a handler may drop the socket, so don't hold on to the framer */
+    framerIt = _currentMsgs.find(socket);
+    if (framerIt == _currentMsgs.end() ||
+        !framerIt->second.next(json))
     {
       break;
     }
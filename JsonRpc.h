@@ -1,13 +1,24 @@
 #pragma once
 
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <map>
 #include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <webrtc/rtc_base/asyncsocket.h>
 #include <webrtc/third_party/jsoncpp/source/include/json/json.h>
 
+#include "JsonRpcFramer.h"
+#include "Timer.h"
+
 namespace faf {
 
 class JsonRpc
@@ -31,6 +42,19 @@ public:
   void setRpcCallbackAsync(std::string const& method,
                            RpcCallbackAsync cb);
 
+  /* for results which are already serialized: the callback appends the compact JSON
+   * result to rawResult, which is spliced into the response without parsing */
+  typedef std::function<void (Json::Value const& paramsArray,
+                              std::string & rawResult,
+                              Json::Value & error,
+                              rtc::AsyncSocket* socket)> RpcCallbackRaw;
+  void setRpcCallbackRaw(std::string const& method,
+                         RpcCallbackRaw cb);
+
+  /** \brief Return call counters and latency histograms of all called methods
+      */
+  Json::Value stats() const;
+
   typedef std::function<void (Json::Value const& result,
                               Json::Value const& error)> RpcRequestResult;
   void sendRequest(std::string const& method,
@@ -38,20 +62,99 @@ public:
                    rtc::AsyncSocket* socket = nullptr,
                    RpcRequestResult resultCb = RpcRequestResult());
 
+  /** \brief Fail requests which got no response within timeoutMs with an error
+      */
+  void setRequestTimeout(int timeoutMs);
+
+  /** \brief Limit the number of requests awaiting a response.
+   *         Requests exceeding the limit fail immediately.
+      */
+  void setMaxPendingRequests(std::size_t maxPendingRequests);
+  std::size_t pendingRequests() const;
+
+  /** \brief Set the message framing used for all connections
+      */
+  void setFraming(JsonRpcFraming framing);
+  JsonRpcFraming framing() const;
+
+  /** \brief Replace the JSON parser/serializer, default is FastJsonCodec
+      */
+  void setCodec(std::shared_ptr<JsonRpcCodec> codec);
+
+  /** \brief Coalesce the notifications sent in one event loop turn into one JSON-RPC batch
+   *         Requests expecting a result are never delayed.
+      */
+  void setNotificationBatching(bool enabled);
+
 protected:
+  struct RpcMethodStats
+  {
+    std::uint64_t calls{0};
+    std::uint64_t errors{0};
+    std::uint64_t totalMicroseconds{0};
+    std::uint64_t maxMicroseconds{0};
+    /* bucket i counts calls up to 2^i microseconds, the last one is unbounded */
+    std::array<std::uint64_t, 24> latencyHistogram{};
+
+    void record(std::chrono::steady_clock::duration duration, bool failed);
+    Json::Value toJson() const;
+    static std::uint64_t bucketUpperBound(std::size_t bucket);
+  };
+
+  /* one entry per method, exactly one of the callbacks is set */
+  struct RpcMethod
+  {
+    RpcCallback callback;
+    RpcCallbackAsync callbackAsync;
+    RpcCallbackRaw callbackRaw;
+    RpcMethodStats stats;
+  };
+
+  RpcMethod& _method(std::string const& name);
+
+  struct PendingRequest
+  {
+    RpcRequestResult callback;
+    rtc::AsyncSocket* socket;
+    std::chrono::steady_clock::time_point deadline;
+    bool socketClosed{false};
+  };
+
   void _read(rtc::AsyncSocket* socket);
-  Json::Value _parseJsonFromMsgBuffer(std::string& msgBuffer);
   void _processJsonMessage(Json::Value const& jsonMessage, rtc::AsyncSocket* socket);
-  void _processRequest(Json::Value const& request, ResponseCallback response, rtc::AsyncSocket* socket);
+  void _processBatch(Json::Value const& batch, rtc::AsyncSocket* socket);
+  void _processResponse(Json::Value const& response);
+  typedef std::function<void (Json::Value const& id, std::string const& rawResult)> RawResponseCallback;
+  void _processRequest(Json::Value const& request,
+                       ResponseCallback response,
+                       rtc::AsyncSocket* socket,
+                       RawResponseCallback rawResponse = RawResponseCallback());
+  bool _sendJson(Json::Value const& message, rtc::AsyncSocket* socket);
+  bool _sendRawResult(Json::Value const& id, std::string const& rawResult, rtc::AsyncSocket* socket);
+  void _flushNotifications();
+  void _onSocketClosed(rtc::AsyncSocket* socket);
+  void _expireRequests();
+  void _scheduleRequestExpiry();
 
   virtual bool _sendMessage(std::string const& message, rtc::AsyncSocket* socket) = 0;
 
   std::array<char, 2048> _readBuffer;
-  std::map<rtc::AsyncSocket*, std::string> _currentMsgs;
-  std::map<int, RpcRequestResult> _currentRequests;
-  std::map<std::string, RpcCallback> _callbacks;
-  std::map<std::string, RpcCallbackAsync> _callbacksAsync;
+  std::map<rtc::AsyncSocket*, JsonRpcFramer> _currentMsgs;
+  std::map<int, PendingRequest> _currentRequests;
+  int _requestTimeoutMs{30000};
+  std::size_t _maxPendingRequests{1024};
+  Timer _requestTimeoutTimer;
+  /* the keys view the strings in _methodNames, so dispatching a request does not copy the method name */
+  std::unordered_map<std::string_view, RpcMethod> _methods;
+  std::deque<std::string> _methodNames;
+  std::uint64_t _unknownMethodCalls{0};
   int _currentId;
+  JsonRpcFraming _framing{JsonRpcFraming::BraceCounting};
+  std::shared_ptr<JsonRpcCodec> _codec;
+  std::string _writeBuffer;
+  bool _batchNotifications{false};
+  std::vector<std::pair<rtc::AsyncSocket*, Json::Value>> _queuedNotifications;
+  Timer _notificationFlushTimer;
 
 };
 
@@ -0,0 +1,616 @@
+#include "JsonRpcCodec.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace faf {
+
+JsonRpcCodec::~JsonRpcCodec()
+{
+}
+
+bool JsoncppCodec::parse(const char* begin,
+                         const char* end,
+                         Json::Value& result,
+                         std::string& error)
+{
+  if (!_reader.parse(begin, end, result, false))
+  {
+    error = _reader.getFormatedErrorMessages();
+    return false;
+  }
+  return true;
+}
+
+void JsoncppCodec::write(Json::Value const& value, std::string& out)
+{
+  out += _writer.write(value);
+  /* FastWriter terminates every document with a newline, framing is not the codec's business */
+  if (!out.empty() &&
+      out.back() == '\n')
+  {
+    out.pop_back();
+  }
+}
+
+bool FastJsonCodec::parse(const char* begin,
+                          const char* end,
+                          Json::Value& result,
+                          std::string& error)
+{
+  _begin = begin;
+  _pos = begin;
+  _end = end;
+  _skipWhitespace();
+  if (!_parseValue(result, 0))
+  {
+    error = _error;
+    return false;
+  }
+  _skipWhitespace();
+  if (_pos != _end)
+  {
+    _fail("trailing characters after JSON document");
+    error = _error;
+    return false;
+  }
+  return true;
+}
+
+static void writeUnsigned(Json::LargestUInt value, std::string& out)
+{
+  char buffer[24];
+  char* current = buffer + sizeof(buffer);
+  do
+  {
+    *--current = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+  while (value != 0);
+  out.append(current, buffer + sizeof(buffer));
+}
+
+void FastJsonCodec::write(Json::Value const& value, std::string& out)
+{
+  switch (value.type())
+  {
+    case Json::nullValue:
+      out += "null";
+      break;
+    case Json::intValue:
+    {
+      Json::LargestInt i = value.asLargestInt();
+      if (i < 0)
+      {
+        out.push_back('-');
+        /* negate in unsigned arithmetic, so the minimum value doesn't overflow */
+        writeUnsigned(Json::LargestUInt(0) - static_cast<Json::LargestUInt>(i), out);
+      }
+      else
+      {
+        writeUnsigned(static_cast<Json::LargestUInt>(i), out);
+      }
+      break;
+    }
+    case Json::uintValue:
+      writeUnsigned(value.asLargestUInt(), out);
+      break;
+    case Json::realValue:
+    {
+      double d = value.asDouble();
+      if (!std::isfinite(d))
+      {
+        /* JSON has no representation for these */
+        out += "null";
+        break;
+      }
+      char buffer[32];
+      int length = std::snprintf(buffer, sizeof(buffer), "%.17g", d);
+      out.append(buffer, static_cast<std::size_t>(length));
+      if (!std::strpbrk(buffer, ".eE"))
+      {
+        out += ".0";
+      }
+      break;
+    }
+    case Json::stringValue:
+    {
+      const char* str = value.asCString();
+      _writeString(str, str + std::strlen(str), out);
+      break;
+    }
+    case Json::booleanValue:
+      out += value.asBool() ? "true" : "false";
+      break;
+    case Json::arrayValue:
+    {
+      out.push_back('[');
+      for (Json::ArrayIndex i = 0, size = value.size(); i < size; ++i)
+      {
+        if (i > 0)
+        {
+          out.push_back(',');
+        }
+        write(value[i], out);
+      }
+      out.push_back(']');
+      break;
+    }
+    case Json::objectValue:
+    {
+      out.push_back('{');
+      bool first = true;
+      for (auto it = value.begin(), end = value.end(); it != end; ++it)
+      {
+        if (!first)
+        {
+          out.push_back(',');
+        }
+        first = false;
+        const char* name = it.memberName();
+        _writeString(name, name + std::strlen(name), out);
+        out.push_back(':');
+        write(*it, out);
+      }
+      out.push_back('}');
+      break;
+    }
+  }
+}
+
+void FastJsonCodec::_writeString(const char* begin, const char* end, std::string& out)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+  out.push_back('"');
+  const char* unescapedBegin = begin;
+  for (const char* c = begin; c != end; ++c)
+  {
+    const unsigned char uc = static_cast<unsigned char>(*c);
+    if (uc >= 0x20 &&
+        uc != '"' &&
+        uc != '\\')
+    {
+      continue;
+    }
+    out.append(unescapedBegin, c);
+    unescapedBegin = c + 1;
+    switch (uc)
+    {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        out += "\\u00";
+        out.push_back(hexDigits[uc >> 4]);
+        out.push_back(hexDigits[uc & 0xf]);
+        break;
+    }
+  }
+  out.append(unescapedBegin, end);
+  out.push_back('"');
+}
+
+bool FastJsonCodec::_parseValue(Json::Value& result, int depth)
+{
+  if (depth > maxNestingDepth)
+  {
+    return _fail("nesting too deep");
+  }
+  if (_pos == _end)
+  {
+    return _fail("unexpected end of document");
+  }
+  switch (*_pos)
+  {
+    case '{':
+      return _parseObject(result, depth + 1);
+    case '[':
+      return _parseArray(result, depth + 1);
+    case '"':
+      return _parseStringValue(result);
+    case 't':
+      result = true;
+      return _parseLiteral("true", 4);
+    case 'f':
+      result = false;
+      return _parseLiteral("false", 5);
+    case 'n':
+      result = Json::Value();
+      return _parseLiteral("null", 4);
+    default:
+      return _parseNumber(result);
+  }
+}
+
+bool FastJsonCodec::_parseObject(Json::Value& result, int depth)
+{
+  result = Json::Value(Json::objectValue);
+  ++_pos;
+  _skipWhitespace();
+  if (_pos != _end &&
+      *_pos == '}')
+  {
+    ++_pos;
+    return true;
+  }
+  while (true)
+  {
+    if (_pos == _end ||
+        *_pos != '"')
+    {
+      return _fail("expected member name");
+    }
+    if (!_parseString(_scratch))
+    {
+      return false;
+    }
+    _skipWhitespace();
+    if (_pos == _end ||
+        *_pos != ':')
+    {
+      return _fail("expected ':' after member name");
+    }
+    ++_pos;
+    _skipWhitespace();
+    /* _scratch is reused while parsing the member value, so resolve the member first */
+    Json::Value& member = result[_scratch];
+    if (!_parseValue(member, depth))
+    {
+      return false;
+    }
+    _skipWhitespace();
+    if (_pos == _end)
+    {
+      return _fail("unterminated object");
+    }
+    if (*_pos == ',')
+    {
+      ++_pos;
+      _skipWhitespace();
+      continue;
+    }
+    if (*_pos == '}')
+    {
+      ++_pos;
+      return true;
+    }
+    return _fail("expected ',' or '}' in object");
+  }
+}
+
+bool FastJsonCodec::_parseArray(Json::Value& result, int depth)
+{
+  result = Json::Value(Json::arrayValue);
+  ++_pos;
+  _skipWhitespace();
+  if (_pos != _end &&
+      *_pos == ']')
+  {
+    ++_pos;
+    return true;
+  }
+  while (true)
+  {
+    if (!_parseValue(result[result.size()], depth))
+    {
+      return false;
+    }
+    _skipWhitespace();
+    if (_pos == _end)
+    {
+      return _fail("unterminated array");
+    }
+    if (*_pos == ',')
+    {
+      ++_pos;
+      _skipWhitespace();
+      continue;
+    }
+    if (*_pos == ']')
+    {
+      ++_pos;
+      return true;
+    }
+    return _fail("expected ',' or ']' in array");
+  }
+}
+
+bool FastJsonCodec::_parseStringValue(Json::Value& result)
+{
+  /* fast path: strings without escape sequences are copied straight from the input */
+  const char* begin = _pos + 1;
+  for (const char* c = begin; c != _end; ++c)
+  {
+    if (*c == '"')
+    {
+      result = Json::Value(begin, c);
+      _pos = c + 1;
+      return true;
+    }
+    if (*c == '\\')
+    {
+      break;
+    }
+  }
+  if (!_parseString(_scratch))
+  {
+    return false;
+  }
+  result = Json::Value(_scratch.data(), _scratch.data() + _scratch.size());
+  return true;
+}
+
+bool FastJsonCodec::_parseString(std::string& result)
+{
+  result.clear();
+  ++_pos;
+  const char* unescapedBegin = _pos;
+  while (_pos != _end)
+  {
+    const char c = *_pos;
+    if (c == '"')
+    {
+      result.append(unescapedBegin, _pos);
+      ++_pos;
+      return true;
+    }
+    if (c != '\\')
+    {
+      ++_pos;
+      continue;
+    }
+    result.append(unescapedBegin, _pos);
+    ++_pos;
+    if (_pos == _end)
+    {
+      break;
+    }
+    switch (*_pos)
+    {
+      case '"':  result.push_back('"'); break;
+      case '\\': result.push_back('\\'); break;
+      case '/':  result.push_back('/'); break;
+      case 'b':  result.push_back('\b'); break;
+      case 'f':  result.push_back('\f'); break;
+      case 'n':  result.push_back('\n'); break;
+      case 'r':  result.push_back('\r'); break;
+      case 't':  result.push_back('\t'); break;
+      case 'u':
+      {
+        unsigned int codepoint;
+        if (!_parseUnicodeEscape(codepoint))
+        {
+          return false;
+        }
+        /* encode as UTF-8 */
+        if (codepoint < 0x80)
+        {
+          result.push_back(static_cast<char>(codepoint));
+        }
+        else if (codepoint < 0x800)
+        {
+          result.push_back(static_cast<char>(0xc0 | (codepoint >> 6)));
+          result.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+        }
+        else if (codepoint < 0x10000)
+        {
+          result.push_back(static_cast<char>(0xe0 | (codepoint >> 12)));
+          result.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f)));
+          result.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+        }
+        else
+        {
+          result.push_back(static_cast<char>(0xf0 | (codepoint >> 18)));
+          result.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f)));
+          result.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f)));
+          result.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+        }
+        /* _parseUnicodeEscape leaves _pos on the last hex digit */
+        break;
+      }
+      default:
+        return _fail("invalid escape sequence");
+    }
+    ++_pos;
+    unescapedBegin = _pos;
+  }
+  return _fail("unterminated string");
+}
+
+bool FastJsonCodec::_parseUnicodeEscape(unsigned int& codepoint)
+{
+  auto parseHex4 = [this](unsigned int& value)
+  {
+    /* expects _pos on the 'u' */
+    if (_end - _pos < 5)
+    {
+      return false;
+    }
+    value = 0;
+    for (int i = 1; i <= 4; ++i)
+    {
+      const char c = _pos[i];
+      value <<= 4;
+      if (c >= '0' && c <= '9')
+      {
+        value |= static_cast<unsigned int>(c - '0');
+      }
+      else if (c >= 'a' && c <= 'f')
+      {
+        value |= static_cast<unsigned int>(c - 'a' + 10);
+      }
+      else if (c >= 'A' && c <= 'F')
+      {
+        value |= static_cast<unsigned int>(c - 'A' + 10);
+      }
+      else
+      {
+        return false;
+      }
+    }
+    _pos += 4;
+    return true;
+  };
+
+  if (!parseHex4(codepoint))
+  {
+    return _fail("invalid unicode escape sequence");
+  }
+  if (codepoint >= 0xd800 &&
+      codepoint <= 0xdbff)
+  {
+    /* high surrogate, must be followed by an escaped low surrogate */
+    unsigned int low;
+    if (_end - _pos < 3 ||
+        _pos[1] != '\\' ||
+        _pos[2] != 'u')
+    {
+      return _fail("missing low surrogate");
+    }
+    _pos += 2;
+    if (!parseHex4(low) ||
+        low < 0xdc00 ||
+        low > 0xdfff)
+    {
+      return _fail("invalid low surrogate");
+    }
+    codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+  }
+  return true;
+}
+
+bool FastJsonCodec::_parseNumber(Json::Value& result)
+{
+  const char* begin = _pos;
+  bool negative = false;
+  if (_pos != _end &&
+      *_pos == '-')
+  {
+    negative = true;
+    ++_pos;
+  }
+  const char* digitsBegin = _pos;
+  Json::LargestUInt value = 0;
+  bool overflow = false;
+  while (_pos != _end &&
+         *_pos >= '0' &&
+         *_pos <= '9')
+  {
+    auto digit = static_cast<Json::LargestUInt>(*_pos - '0');
+    if (value > (Json::Value::maxLargestUInt - digit) / 10)
+    {
+      overflow = true;
+    }
+    value = value * 10 + digit;
+    ++_pos;
+  }
+  if (_pos == digitsBegin)
+  {
+    return _fail("invalid value");
+  }
+  bool isReal = overflow;
+  if (_pos != _end &&
+      *_pos == '.')
+  {
+    isReal = true;
+    ++_pos;
+    while (_pos != _end &&
+           *_pos >= '0' &&
+           *_pos <= '9')
+    {
+      ++_pos;
+    }
+  }
+  if (_pos != _end &&
+      (*_pos == 'e' || *_pos == 'E'))
+  {
+    isReal = true;
+    ++_pos;
+    if (_pos != _end &&
+        (*_pos == '+' || *_pos == '-'))
+    {
+      ++_pos;
+    }
+    while (_pos != _end &&
+           *_pos >= '0' &&
+           *_pos <= '9')
+    {
+      ++_pos;
+    }
+  }
+
+  if (!isReal)
+  {
+    /* same type selection as Json::Reader */
+    if (negative)
+    {
+      if (value > static_cast<Json::LargestUInt>(Json::Value::maxLargestInt) + 1)
+      {
+        isReal = true;
+      }
+      else
+      {
+        result = static_cast<Json::LargestInt>(Json::LargestUInt(0) - value);
+        return true;
+      }
+    }
+    else if (value <= static_cast<Json::LargestUInt>(Json::Value::maxInt))
+    {
+      result = static_cast<Json::LargestInt>(value);
+      return true;
+    }
+    else
+    {
+      result = value;
+      return true;
+    }
+  }
+
+  /* the input is not null terminated, so strtod gets a copy */
+  _scratch.assign(begin, _pos);
+  char* parseEnd = nullptr;
+  double d = std::strtod(_scratch.c_str(), &parseEnd);
+  if (parseEnd != _scratch.c_str() + _scratch.size())
+  {
+    return _fail("invalid number");
+  }
+  result = d;
+  return true;
+}
+
+bool FastJsonCodec::_parseLiteral(const char* literal, std::size_t size)
+{
+  if (static_cast<std::size_t>(_end - _pos) < size ||
+      std::memcmp(_pos, literal, size) != 0)
+  {
+    return _fail("invalid literal");
+  }
+  _pos += size;
+  return true;
+}
+
+void FastJsonCodec::_skipWhitespace()
+{
+  while (_pos != _end &&
+         (*_pos == ' ' ||
+          *_pos == '\t' ||
+          *_pos == '\n' ||
+          *_pos == '\r'))
+  {
+    ++_pos;
+  }
+}
+
+bool FastJsonCodec::_fail(const char* message)
+{
+  _error = std::string(message) + " at offset " + std::to_string(_pos - _begin);
+  return false;
+}
+
+} // namespace faf
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+namespace faf {
+
+/*! \brief Serialization backend of the JSON-RPC connections
+ */
+class JsonRpcCodec
+{
+public:
+  virtual ~JsonRpcCodec();
+
+  /** \brief Parse a complete JSON document
+       \param begin: Start of the document
+       \param end: End of the document
+       \param result: The parsed value on success
+       \param error: A description of the error on failure
+       \returns true on success
+      */
+  virtual bool parse(const char* begin,
+                     const char* end,
+                     Json::Value& result,
+                     std::string& error) = 0;
+
+  /** \brief Serialize a value in compact form, appending it to out
+      */
+  virtual void write(Json::Value const& value, std::string& out) = 0;
+};
+
+/*! \brief Codec using jsoncpp's Reader and FastWriter
+ */
+class JsoncppCodec : public JsonRpcCodec
+{
+public:
+  virtual bool parse(const char* begin,
+                     const char* end,
+                     Json::Value& result,
+                     std::string& error) override;
+  virtual void write(Json::Value const& value, std::string& out) override;
+
+protected:
+  Json::Reader _reader;
+  Json::FastWriter _writer;
+};
+
+/*! \brief Single pass codec which parses straight into Json::Value
+ *         and serializes without intermediate strings
+ */
+class FastJsonCodec : public JsonRpcCodec
+{
+public:
+  virtual bool parse(const char* begin,
+                     const char* end,
+                     Json::Value& result,
+                     std::string& error) override;
+  virtual void write(Json::Value const& value, std::string& out) override;
+
+  static constexpr int maxNestingDepth = 512;
+
+protected:
+  bool _parseValue(Json::Value& result, int depth);
+  bool _parseObject(Json::Value& result, int depth);
+  bool _parseArray(Json::Value& result, int depth);
+  bool _parseString(std::string& result);
+  bool _parseStringValue(Json::Value& result);
+  bool _parseNumber(Json::Value& result);
+  bool _parseLiteral(const char* literal, std::size_t size);
+  bool _parseUnicodeEscape(unsigned int& codepoint);
+  void _skipWhitespace();
+  bool _fail(const char* message);
+  void _writeString(const char* begin, const char* end, std::string& out);
+
+  const char* _begin{nullptr};
+  const char* _pos{nullptr};
+  const char* _end{nullptr};
+  std::string _error;
+  std::string _scratch;
+};
+
+} // namespace faf
@@ -0,0 +1,295 @@
+#include "JsonRpcFramer.h"
+
+#include <cstring>
+
+#include "logging.h"
+
+namespace faf {
+
+/* don't bother moving memory for small consumed prefixes */
+static constexpr std::size_t minCompactSize = 4096;
+
+static bool isWhitespace(char c)
+{
+  return c == ' '  ||
+         c == '\t' ||
+         c == '\n' ||
+         c == '\r' ||
+         c == '\f' ||
+         c == '\v';
+}
+
+bool parseJsonRpcFraming(std::string const& name, JsonRpcFraming& result)
+{
+  if (name == "brace")
+  {
+    result = JsonRpcFraming::BraceCounting;
+    return true;
+  }
+  if (name == "ndjson")
+  {
+    result = JsonRpcFraming::NewlineDelimited;
+    return true;
+  }
+  if (name == "length")
+  {
+    result = JsonRpcFraming::LengthPrefixed;
+    return true;
+  }
+  return false;
+}
+
+JsonRpcFramer::JsonRpcFramer(JsonRpcFraming framing,
+                             std::shared_ptr<JsonRpcCodec> codec):
+  _framing(framing),
+  _codec(codec)
+{
+  if (!_codec)
+  {
+    _codec = std::make_shared<FastJsonCodec>();
+  }
+}
+
+void JsonRpcFramer::append(const char* data, std::size_t size)
+{
+  _compact();
+  _buffer.append(data, size);
+}
+
+bool JsonRpcFramer::next(Json::Value& result)
+{
+  switch (_framing)
+  {
+    case JsonRpcFraming::BraceCounting:
+      return _nextBraceCounting(result);
+    case JsonRpcFraming::NewlineDelimited:
+      return _nextNewlineDelimited(result);
+    case JsonRpcFraming::LengthPrefixed:
+      return _nextLengthPrefixed(result);
+  }
+  return false;
+}
+
+std::size_t JsonRpcFramer::pendingBytes() const
+{
+  return _buffer.size() - _readPos;
+}
+
+void JsonRpcFramer::clear()
+{
+  _buffer.clear();
+  _readPos = 0;
+  _scanPos = 0;
+  _nestingLevel = 0;
+  _inString = false;
+  _escaped = false;
+}
+
+JsonRpcFraming JsonRpcFramer::framing() const
+{
+  return _framing;
+}
+
+std::size_t JsonRpcFramer::beginFrame(std::string& out, JsonRpcFraming framing)
+{
+  std::size_t frameStart = out.size();
+  if (framing == JsonRpcFraming::LengthPrefixed)
+  {
+    /* placeholder, filled in by endFrame() */
+    out.append(lengthPrefixSize, '\0');
+  }
+  return frameStart;
+}
+
+void JsonRpcFramer::endFrame(std::string& out, std::size_t frameStart, JsonRpcFraming framing)
+{
+  switch (framing)
+  {
+    case JsonRpcFraming::BraceCounting:
+    case JsonRpcFraming::NewlineDelimited:
+      /* brace counting clients always got a trailing newline from Json::FastWriter */
+      out.push_back('\n');
+      break;
+    case JsonRpcFraming::LengthPrefixed:
+    {
+      auto size = static_cast<std::uint32_t>(out.size() - frameStart - lengthPrefixSize);
+      out[frameStart]     = static_cast<char>((size >> 24) & 0xff);
+      out[frameStart + 1] = static_cast<char>((size >> 16) & 0xff);
+      out[frameStart + 2] = static_cast<char>((size >> 8) & 0xff);
+      out[frameStart + 3] = static_cast<char>(size & 0xff);
+      break;
+    }
+  }
+}
+
+bool JsonRpcFramer::_nextBraceCounting(Json::Value& result)
+{
+  const char* buffer = _buffer.data();
+  const std::size_t bufferSize = _buffer.size();
+
+  if (_nestingLevel == 0)
+  {
+    /* skip whitespace between messages */
+    while (_readPos < bufferSize &&
+           isWhitespace(buffer[_readPos]))
+    {
+      ++_readPos;
+    }
+    _scanPos = _readPos;
+    if (_readPos >= bufferSize)
+    {
+      return false;
+    }
+    if (buffer[_readPos] != '{' &&
+        buffer[_readPos] != '[')
+    {
+      FAF_LOG_ERROR << "invalid JSON msg";
+      clear();
+      return false;
+    }
+  }
+
+  for (; _scanPos < bufferSize; ++_scanPos)
+  {
+    const char c = buffer[_scanPos];
+    if (_inString)
+    {
+      if (_escaped)
+      {
+        _escaped = false;
+      }
+      else if (c == '\\')
+      {
+        _escaped = true;
+      }
+      else if (c == '"')
+      {
+        _inString = false;
+      }
+      continue;
+    }
+
+    if (c == '"')
+    {
+      _inString = true;
+    }
+    else if (c == '{' ||
+             c == '[')
+    {
+      ++_nestingLevel;
+    }
+    else if (c == '}' ||
+             c == ']')
+    {
+      --_nestingLevel;
+      if (_nestingLevel == 0)
+      {
+        const char* msgBegin = buffer + _readPos;
+        const char* msgEnd = buffer + _scanPos + 1;
+        _readPos = _scanPos + 1;
+        _scanPos = _readPos;
+        return _parse(msgBegin, msgEnd, result);
+      }
+    }
+  }
+  return false;
+}
+
+bool JsonRpcFramer::_nextNewlineDelimited(Json::Value& result)
+{
+  while (true)
+  {
+    const char* buffer = _buffer.data();
+    const std::size_t bufferSize = _buffer.size();
+    if (_scanPos >= bufferSize)
+    {
+      return false;
+    }
+    auto lineEnd = static_cast<const char*>(std::memchr(buffer + _scanPos, '\n', bufferSize - _scanPos));
+    if (!lineEnd)
+    {
+      _scanPos = bufferSize;
+      return false;
+    }
+    const char* msgBegin = buffer + _readPos;
+    _readPos = static_cast<std::size_t>(lineEnd - buffer) + 1;
+    _scanPos = _readPos;
+
+    /* skip empty lines */
+    while (msgBegin < lineEnd &&
+           isWhitespace(*msgBegin))
+    {
+      ++msgBegin;
+    }
+    if (msgBegin != lineEnd)
+    {
+      return _parse(msgBegin, lineEnd, result);
+    }
+  }
+}
+
+bool JsonRpcFramer::_nextLengthPrefixed(Json::Value& result)
+{
+  if (_buffer.size() - _readPos < lengthPrefixSize)
+  {
+    return false;
+  }
+  auto header = reinterpret_cast<const unsigned char*>(_buffer.data() + _readPos);
+  std::uint32_t size = (std::uint32_t(header[0]) << 24) |
+                       (std::uint32_t(header[1]) << 16) |
+                       (std::uint32_t(header[2]) << 8) |
+                       std::uint32_t(header[3]);
+  if (size > maxMessageSize)
+  {
+    FAF_LOG_ERROR << "JSON msg length " << size << " exceeds limit";
+    clear();
+    return false;
+  }
+  if (_buffer.size() - _readPos - lengthPrefixSize < size)
+  {
+    /* make sure the complete message fits without reallocating on every read */
+    _buffer.reserve(_readPos + lengthPrefixSize + size);
+    return false;
+  }
+  const char* msgBegin = _buffer.data() + _readPos + lengthPrefixSize;
+  _readPos += lengthPrefixSize + size;
+  _scanPos = _readPos;
+  return _parse(msgBegin, msgBegin + size, result);
+}
+
+bool JsonRpcFramer::_parse(const char* begin, const char* end, Json::Value& result)
+{
+  if (!_codec->parse(begin, end, result, _parseError))
+  {
+    FAF_LOG_ERROR << "error parsing JSON msg: " << _parseError;
+    clear();
+    return false;
+  }
+  return true;
+}
+
+void JsonRpcFramer::_compact()
+{
+  if (_readPos == 0)
+  {
+    return;
+  }
+  if (_readPos >= _buffer.size())
+  {
+    _buffer.clear();
+    _scanPos = 0;
+    _readPos = 0;
+    return;
+  }
+  /* only move the unconsumed tail once the consumed prefix is large,
+   * so the amortized cost per byte stays constant */
+  if (_readPos >= minCompactSize &&
+      _readPos >= _buffer.size() / 2)
+  {
+    _buffer.erase(0, _readPos);
+    _scanPos -= _readPos;
+    _readPos = 0;
+  }
+}
+
+} // namespace faf
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+#include "JsonRpcCodec.h"
+
+namespace faf {
+
+enum class JsonRpcFraming
+{
+  BraceCounting,    /*!< concatenated JSON objects or batch arrays, message boundaries are found by counting braces */
+  NewlineDelimited, /*!< NDJSON: one message per line */
+  LengthPrefixed    /*!< every message is preceded by its length as 4 byte big endian integer */
+};
+
+/** \brief Parse a framing name as used on the commandline: "brace", "ndjson" or "length"
+    \returns false if the name is unknown
+   */
+bool parseJsonRpcFraming(std::string const& name, JsonRpcFraming& result);
+
+/*! \brief Incremental splitter for a stream of JSON-RPC messages
+ *
+ *  Received bytes are appended to an internal buffer. The scan state is kept
+ *  across calls, so every byte is scanned at most once, and complete messages
+ *  are parsed in place from the read cursor.
+ *  The consumed prefix of the buffer is only dropped once it dominates the buffer.
+ */
+class JsonRpcFramer
+{
+public:
+  JsonRpcFramer(JsonRpcFraming framing = JsonRpcFraming::BraceCounting,
+                std::shared_ptr<JsonRpcCodec> codec = std::shared_ptr<JsonRpcCodec>());
+
+  void append(const char* data, std::size_t size);
+
+  /** \brief Extract the next complete message from the buffer
+       \param result: The parsed message on success
+       \returns true if a message was extracted, false if more data is needed
+                or the buffer contained garbage and was discarded
+      */
+  bool next(Json::Value& result);
+
+  /** \returns the number of buffered bytes not yet consumed
+      */
+  std::size_t pendingBytes() const;
+
+  void clear();
+
+  JsonRpcFraming framing() const;
+
+  /** \brief Start a message frame at the end of out.
+   *         The message must then be appended to out, followed by endFrame().
+       \returns The offset of the frame, to be passed to endFrame()
+      */
+  static std::size_t beginFrame(std::string& out, JsonRpcFraming framing);
+  static void endFrame(std::string& out, std::size_t frameStart, JsonRpcFraming framing);
+
+  static constexpr std::size_t lengthPrefixSize = 4;
+  static constexpr std::uint32_t maxMessageSize = 64 * 1024 * 1024;
+
+protected:
+  bool _nextBraceCounting(Json::Value& result);
+  bool _nextNewlineDelimited(Json::Value& result);
+  bool _nextLengthPrefixed(Json::Value& result);
+  bool _parse(const char* begin, const char* end, Json::Value& result);
+  void _compact();
+
+  JsonRpcFraming _framing;
+  std::shared_ptr<JsonRpcCodec> _codec;
+  std::string _buffer;
+  std::size_t _readPos{0};  /*!< start of the current, incomplete message */
+  std::size_t _scanPos{0};  /*!< first byte not scanned yet */
+  int _nestingLevel{0};
+  bool _inString{false};
+  bool _escaped{false};
+  std::string _parseError;
+};
+
+} // namespace faf
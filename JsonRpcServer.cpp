@@ -66,7 +66,7 @@ void JsonRpcServer::_onNewClient(rtc::AsyncSocket* socket)
 
 void JsonRpcServer::_onClientDisconnect(rtc::AsyncSocket* socket, int _whatsThis_)
 {
-  _currentMsgs.erase(socket);
+  _onSocketClosed(socket);
   _connectedSockets.erase(socket);
   FAF_LOG_DEBUG << "JsonRpcServer client disonnected: " << _whatsThis_;
   SignalClientDisconnected.emit(socket);
@@ -100,7 +100,7 @@ bool JsonRpcServer::_sendMessage(std::string const& message, rtc::AsyncSocket* s
 
     if (!it->second->Send(message.c_str(), message.size()))
     {
-      _currentMsgs.erase(it->second.get());
+      _onSocketClosed(it->second.get());
       it = _connectedSockets.erase(it);
       FAF_LOG_ERROR << "sending " << message << " failed";
     }
@@ -0,0 +1,96 @@
+#include "Metrics.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace faf {
+
+static void appendEscapedLabelValue(std::string& out, std::string const& value)
+{
+  for (char c : value)
+  {
+    switch (c)
+    {
+      case '\\':
+        out += "\\\\";
+        break;
+      case '"':
+        out += "\\\"";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      default:
+        out += c;
+    }
+  }
+}
+
+void writeMetricHeader(std::string& out,
+                       std::string const& name,
+                       std::string const& help,
+                       std::string const& type)
+{
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+void writeMetricSample(std::string& out,
+                       std::string const& name,
+                       MetricLabels const& labels,
+                       double value)
+{
+  out += name;
+  if (!labels.empty())
+  {
+    out += '{';
+    bool first = true;
+    for (auto const& label : labels)
+    {
+      if (!first)
+      {
+        out += ',';
+      }
+      first = false;
+      out += label.first;
+      out += "=\"";
+      appendEscapedLabelValue(out, label.second);
+      out += '"';
+    }
+    out += '}';
+  }
+  out += ' ';
+  if (std::isnan(value))
+  {
+    out += "NaN";
+  }
+  else if (std::isinf(value))
+  {
+    out += value > 0 ? "+Inf" : "-Inf";
+  }
+  else
+  {
+    /* counters are printed exactly, measurements with 15 significant digits */
+    char buffer[32];
+    if (value == std::floor(value) &&
+        std::fabs(value) < 9e15)
+    {
+      std::snprintf(buffer, sizeof(buffer), "%.0f", value);
+    }
+    else
+    {
+      std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    }
+    out += buffer;
+  }
+  out += '\n';
+}
+
+} // namespace faf
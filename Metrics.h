@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace faf {
+
+/*! \brief Monotonic counter with a single writer
+ *
+ *  The owning thread increments it without a locked read-modify-write,
+ *  any thread may read it, e.g. for a metrics scrape.
+ */
+class Counter
+{
+public:
+  void add(std::uint64_t n = 1)
+  {
+    _value.store(_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  std::uint64_t value() const
+  {
+    return _value.load(std::memory_order_relaxed);
+  }
+protected:
+  std::atomic<std::uint64_t> _value{0};
+};
+
+/*! \brief Last observed value of a measurement, readable from any thread
+ */
+class Gauge
+{
+public:
+  void set(double value)
+  {
+    _value.store(value, std::memory_order_relaxed);
+  }
+  double value() const
+  {
+    return _value.load(std::memory_order_relaxed);
+  }
+protected:
+  std::atomic<double> _value{0.};
+};
+
+typedef std::vector<std::pair<std::string, std::string>> MetricLabels;
+
+/** \brief Append the # HELP and # TYPE lines of a metric in Prometheus text format
+    \param type: "counter" or "gauge"
+   */
+void writeMetricHeader(std::string& out,
+                       std::string const& name,
+                       std::string const& help,
+                       std::string const& type);
+
+/** \brief Append one sample line in Prometheus text format
+   */
+void writeMetricSample(std::string& out,
+                       std::string const& name,
+                       MetricLabels const& labels,
+                       double value);
+
+} // namespace faf
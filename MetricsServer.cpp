@@ -0,0 +1,173 @@
+#include "MetricsServer.h"
+
+#include <webrtc/rtc_base/thread.h>
+
+#include "logging.h"
+
+namespace faf {
+
+MetricsServer::MetricsServer(CollectCallback collect):
+  _collect(collect),
+  _server(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_STREAM))
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+}
+
+void MetricsServer::listen(int port, std::string const& hostname)
+{
+  _server->SignalReadEvent.connect(this, &MetricsServer::_onNewClient);
+  if (_server->Bind(rtc::SocketAddress(hostname, port)) != 0)
+  {
+    FAF_LOG_ERROR << "MetricsServer unable to bind to port " << port;
+    std::exit(1);
+  }
+  _server->Listen(5);
+  FAF_LOG_INFO << "MetricsServer listening on " << hostname << ":" << _server->GetLocalAddress().port();
+}
+
+int MetricsServer::listenPort() const
+{
+  return _server->GetLocalAddress().port();
+}
+
+void MetricsServer::_onNewClient(rtc::AsyncSocket* socket)
+{
+  rtc::SocketAddress acceptAddr;
+  std::unique_ptr<rtc::AsyncSocket> newSocket(_server->Accept(&acceptAddr));
+  if (!newSocket)
+  {
+    return;
+  }
+  newSocket->SignalReadEvent.connect(this, &MetricsServer::_onRead);
+  newSocket->SignalWriteEvent.connect(this, &MetricsServer::_onWrite);
+  newSocket->SignalCloseEvent.connect(this, &MetricsServer::_onClientDisconnect);
+  auto rawSocket = newSocket.get();
+  _connections[rawSocket].socket = std::move(newSocket);
+}
+
+void MetricsServer::_onRead(rtc::AsyncSocket* socket)
+{
+  auto it = _connections.find(socket);
+  if (it == _connections.end())
+  {
+    return;
+  }
+  auto& connection = it->second;
+  int msgLength = 0;
+  do
+  {
+    msgLength = socket->Recv(_readBuffer.data(), _readBuffer.size(), nullptr);
+    if (msgLength > 0 &&
+        connection.response.empty())
+    {
+      connection.request.append(_readBuffer.data(), static_cast<std::size_t>(msgLength));
+    }
+  }
+  while (msgLength > 0);
+
+  if (!connection.response.empty())
+  {
+    return;
+  }
+  if (connection.request.find("\r\n\r\n") != std::string::npos)
+  {
+    _respond(connection);
+  }
+  else if (connection.request.size() > maxRequestSize)
+  {
+    FAF_LOG_WARN << "MetricsServer: request too large";
+    _close(socket);
+  }
+}
+
+void MetricsServer::_onWrite(rtc::AsyncSocket* socket)
+{
+  auto it = _connections.find(socket);
+  if (it != _connections.end() &&
+      !it->second.response.empty())
+  {
+    _flush(it->second);
+  }
+}
+
+void MetricsServer::_onClientDisconnect(rtc::AsyncSocket* socket, int)
+{
+  _close(socket);
+}
+
+void MetricsServer::_respond(Connection& connection)
+{
+  auto requestLineEnd = connection.request.find("\r\n");
+  auto requestLine = connection.request.substr(0, requestLineEnd);
+  std::string status;
+  std::string body;
+  std::string contentType = "text/plain; charset=utf-8";
+  if (requestLine.compare(0, 13, "GET /metrics ") == 0 ||
+      requestLine.compare(0, 13, "GET /metrics?") == 0)
+  {
+    status = "200 OK";
+    contentType = "text/plain; version=0.0.4; charset=utf-8";
+    _collect(body);
+  }
+  else if (requestLine.compare(0, 4, "GET ") == 0)
+  {
+    status = "404 Not Found";
+    body = "metrics are served at /metrics\n";
+  }
+  else
+  {
+    status = "405 Method Not Allowed";
+  }
+  connection.response = "HTTP/1.1 " + status + "\r\n"
+                        "Content-Type: " + contentType + "\r\n"
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                        "Connection: close\r\n"
+                        "\r\n";
+  connection.response += body;
+  _flush(connection);
+}
+
+void MetricsServer::_flush(Connection& connection)
+{
+  auto socket = connection.socket.get();
+  while (connection.sentBytes < connection.response.size())
+  {
+    int sent = socket->Send(connection.response.data() + connection.sentBytes,
+                            connection.response.size() - connection.sentBytes);
+    if (sent <= 0)
+    {
+      if (socket->IsBlocking())
+      {
+        /* continued in _onWrite() */
+        return;
+      }
+      FAF_LOG_WARN << "MetricsServer: sending response failed";
+      break;
+    }
+    connection.sentBytes += static_cast<std::size_t>(sent);
+  }
+  _close(socket);
+}
+
+void MetricsServer::_close(rtc::AsyncSocket* socket)
+{
+  auto it = _connections.find(socket);
+  if (it == _connections.end())
+  {
+    return;
+  }
+  it->second.socket->Close();
+  _closedSockets.push_back(std::move(it->second.socket));
+  _connections.erase(it);
+  rtc::Thread::Current()->Post(RTC_FROM_HERE, this);
+}
+
+void MetricsServer::OnMessage(rtc::Message* msg)
+{
+  _closedSockets.clear();
+}
+
+} // namespace faf
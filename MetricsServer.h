@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <webrtc/rtc_base/asyncsocket.h>
+#include <webrtc/rtc_base/messagehandler.h>
+
+namespace faf {
+
+/*! \brief Minimal HTTP server exposing metrics in Prometheus text format
+ *
+ *  Serves GET /metrics, one request per connection.
+ */
+class MetricsServer : public sigslot::has_slots<>, public rtc::MessageHandler
+{
+public:
+  /* appends the metrics in Prometheus text format to the body */
+  typedef std::function<void (std::string& body)> CollectCallback;
+
+  MetricsServer(CollectCallback collect);
+  virtual ~MetricsServer();
+
+  void listen(int port, std::string const& hostname = "127.0.0.1");
+
+  int listenPort() const;
+
+protected:
+  struct Connection
+  {
+    std::unique_ptr<rtc::AsyncSocket> socket;
+    std::string request;
+    std::string response;
+    std::size_t sentBytes{0};
+  };
+
+  void _onNewClient(rtc::AsyncSocket* socket);
+  void _onRead(rtc::AsyncSocket* socket);
+  void _onWrite(rtc::AsyncSocket* socket);
+  void _onClientDisconnect(rtc::AsyncSocket* socket, int);
+  void _respond(Connection& connection);
+  void _flush(Connection& connection);
+  void _close(rtc::AsyncSocket* socket);
+  virtual void OnMessage(rtc::Message* msg) override;
+
+  static constexpr std::size_t maxRequestSize = 8192;
+
+  CollectCallback _collect;
+  std::unique_ptr<rtc::AsyncSocket> _server;
+  std::map<rtc::AsyncSocket*, Connection> _connections;
+  /* sockets are closed from their own callbacks, so they are deleted later */
+  std::vector<std::unique_ptr<rtc::AsyncSocket>> _closedSockets;
+  std::array<char, 2048> _readBuffer;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(MetricsServer);
+};
+
+} // namespace faf
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace faf {
+
+/*! \brief Bounded lock-free queue for many producer threads and a single consumer thread
+ *
+ *  Every cell carries a sequence number which tells producers and the
+ *  consumer whose turn it is, so producers only contend on one atomic
+ *  increment and never wait for each other or for the consumer.
+ */
+template<typename T, std::size_t Capacity>
+class MpscRing
+{
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+  MpscRing()
+  {
+    for (std::size_t i = 0; i < Capacity; ++i)
+    {
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /** \brief Enqueue a value, callable from any thread
+       \returns false if the ring is full, the value is left untouched then
+      */
+  bool tryPush(T&& value)
+  {
+    Cell* cell;
+    auto position = _pushPosition.load(std::memory_order_relaxed);
+    while (true)
+    {
+      cell = &_cells[position & (Capacity - 1)];
+      auto sequence = cell->sequence.load(std::memory_order_acquire);
+      auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+      if (difference == 0)
+      {
+        if (_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (difference < 0)
+      {
+        return false;
+      }
+      else
+      {
+        position = _pushPosition.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** \brief Dequeue the oldest value, only callable from the consumer thread
+       \returns false if the ring is empty
+      */
+  bool tryPop(T& value)
+  {
+    auto& cell = _cells[_popPosition & (Capacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != _popPosition + 1)
+    {
+      return false;
+    }
+    value = std::move(cell.value);
+    cell.sequence.store(_popPosition + Capacity, std::memory_order_release);
+    ++_popPosition;
+    return true;
+  }
+
+  /** \returns true if the consumer has nothing to pop right now
+      */
+  bool empty() const
+  {
+    return _cells[_popPosition & (Capacity - 1)].sequence.load(std::memory_order_acquire) != _popPosition + 1;
+  }
+
+  static constexpr std::size_t capacity = Capacity;
+
+protected:
+  struct Cell
+  {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  std::array<Cell, Capacity> _cells;
+  alignas(64) std::atomic<std::size_t> _pushPosition{0};
+  alignas(64) std::size_t _popPosition{0};
+};
+
+} // namespace faf
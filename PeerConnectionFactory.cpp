@@ -0,0 +1,85 @@
+#include "PeerConnectionFactory.h"
+
+#include <webrtc/media/engine/webrtcmediaengine.h>
+
+#include "IcePolicy.h"
+#include "logging.h"
+
+namespace faf {
+
+static void startThread(rtc::Thread* thread,
+                        std::string const& name,
+                        ThreadSettings const& settings)
+{
+  thread->SetName(name, nullptr);
+  if (!thread->Start())
+  {
+    FAF_LOG_ERROR << "unable to start the " << name << " thread";
+    std::exit(1);
+  }
+  thread->Invoke<bool>(RTC_FROM_HERE, [&settings, &name]()
+  {
+    return settings.applyToCurrentThread(name);
+  });
+}
+
+PeerConnectionFactory::PeerConnectionFactory(IceAdapterOptions const& options, int index):
+  _networkThread(rtc::Thread::CreateWithSocketServer()),
+  _workerThread(rtc::Thread::Create())
+{
+  startThread(_networkThread.get(), "faf-network-" + std::to_string(index), threadSettings(options, "network"));
+  startThread(_workerThread.get(), "faf-worker-" + std::to_string(index), threadSettings(options, "worker"));
+
+  _factory = webrtc::CreateModularPeerConnectionFactory(_networkThread.get(),
+                                                        _workerThread.get(),
+                                                        rtc::Thread::Current(),
+                                                        nullptr,
+                                                        nullptr,
+                                                        nullptr);
+  if (!_factory)
+  {
+    FAF_LOG_ERROR << "Error in CreatePeerConnectionFactory()";
+    std::exit(1);
+  }
+
+  /* globally ignored networks are not even gathered */
+  webrtc::PeerConnectionFactoryInterface::Options factoryOptions;
+  parseNetworkTypes(options.ignoreNetworks, factoryOptions.network_ignore_mask);
+  _factory->SetOptions(factoryOptions);
+}
+
+PeerConnectionFactory::~PeerConnectionFactory()
+{
+  /* the factory posts its cleanup to the threads */
+  _factory = nullptr;
+  _workerThread->Stop();
+  _networkThread->Stop();
+}
+
+rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> const& PeerConnectionFactory::factory() const
+{
+  return _factory;
+}
+
+ThreadSettings threadSettings(IceAdapterOptions const& options, std::string const& thread)
+{
+  ThreadSettings result;
+  if (thread == "game")
+  {
+    parseCpuList(options.gameThreadCpus, result.cpus);
+    parseThreadPriority(options.gameThreadPriority, result.priority);
+  }
+  else if (thread == "network")
+  {
+    parseCpuList(options.networkThreadCpus, result.cpus);
+    parseThreadPriority(options.networkThreadPriority, result.priority);
+  }
+  else if (thread == "worker")
+  {
+    parseCpuList(options.workerThreadCpus, result.cpus);
+    parseThreadPriority(options.workerThreadPriority, result.priority);
+  }
+  return result;
+}
+
+} // namespace faf
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <webrtc/rtc_base/scoped_ref_ptr.h>
+#include <webrtc/rtc_base/thread.h>
+#include <webrtc/api/peerconnectioninterface.h>
+
+#include "IceAdapterOptions.h"
+#include "ThreadSettings.h"
+
+namespace faf {
+
+/*! \brief A webrtc::PeerConnectionFactoryInterface with explicitly created threads
+ *
+ *  The network thread runs all ICE, DTLS and SCTP sockets, the worker thread
+ *  the remaining libwebrtc work like getStats() collection. The thread creating
+ *  the factory is the signaling thread, it also runs the game, GPGNet and
+ *  JSON-RPC sockets, since the relays are not thread safe.
+ *  Shared by all sessions of a SessionHost which use it.
+ */
+class PeerConnectionFactory
+{
+public:
+  /** \brief Create the threads and the factory, exits the process on failure
+       \param index: appended to the thread names
+      */
+  PeerConnectionFactory(IceAdapterOptions const& options, int index = 0);
+  ~PeerConnectionFactory();
+
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> const& factory() const;
+
+protected:
+  std::unique_ptr<rtc::Thread> _networkThread;
+  std::unique_ptr<rtc::Thread> _workerThread;
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> _factory;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(PeerConnectionFactory);
+};
+
+/** \brief Read the settings of a thread from the options, which IceAdapterOptions::init() validated
+    \param thread: "game", "network" or "worker"
+   */
+ThreadSettings threadSettings(IceAdapterOptions const& options, std::string const& thread);
+
+} // namespace faf
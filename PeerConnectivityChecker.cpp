@@ -7,8 +7,10 @@
 
 namespace faf {
 
-PeerConnectivityChecker::PeerConnectivityChecker(rtc::scoped_refptr<webrtc::DataChannelInterface> dc, ConnectivityLostCallback cb) :
-    _dataChannel(dc), _cb(cb)
+PeerConnectivityChecker::PeerConnectivityChecker(rtc::scoped_refptr<webrtc::DataChannelInterface> dc,
+                                                 ConnectivityLostCallback cb,
+                                                 PingSentCallback pingSentCb) :
+    _dataChannel(dc), _cb(cb), _pingSentCb(pingSentCb)
 {
   _timerStartTime = std::chrono::steady_clock::now();
   _connectivityCheckTimer.start(_connectionCheckIntervalMs, std::bind(&PeerConnectivityChecker::_checkConnectivity, this));
@@ -21,12 +23,21 @@ bool PeerConnectivityChecker::handleMessageFromPeer(const uint8_t* data, std::si
       && std::equal(data, data + sizeof(PongMessage), PongMessage))
   {
     _lastReceivedPongTime = std::chrono::steady_clock::now();
+    if (_lastSentPingTime)
+    {
+      _lastRoundTripTime = *_lastReceivedPongTime - *_lastSentPingTime;
+    }
     return true;
   }
   _lastReceivedDataTime = std::chrono::steady_clock::now();
   return false;
 }
 
+std::optional<std::chrono::steady_clock::duration> PeerConnectivityChecker::lastRoundTripTime() const
+{
+  return _lastRoundTripTime;
+}
+
 void PeerConnectivityChecker::_startPing()
 {
   FAF_LOG_INFO << "PeerConnectivityChecker: pingTimer start";
@@ -37,6 +48,10 @@ void PeerConnectivityChecker::_sendPing()
 {
   _dataChannel->Send(webrtc::DataBuffer(rtc::CopyOnWriteBuffer(PingMessage, sizeof(PingMessage)), true));
   _lastSentPingTime = std::chrono::steady_clock::now();
+  if (_pingSentCb)
+  {
+    _pingSentCb();
+  }
 }
 
 void PeerConnectivityChecker::_checkConnectivity()
@@ -14,10 +14,17 @@ class PeerConnectivityChecker
 {
 public:
   typedef std::function<void()> ConnectivityLostCallback;
-  PeerConnectivityChecker(rtc::scoped_refptr<webrtc::DataChannelInterface> dc, ConnectivityLostCallback cb);
+  typedef std::function<void()> PingSentCallback;
+  PeerConnectivityChecker(rtc::scoped_refptr<webrtc::DataChannelInterface> dc,
+                          ConnectivityLostCallback cb,
+                          PingSentCallback pingSentCb = nullptr);
 
   bool handleMessageFromPeer(const uint8_t* data, std::size_t size);
 
+  /** \returns the round trip time of the last answered ping
+      */
+  std::optional<std::chrono::steady_clock::duration> lastRoundTripTime() const;
+
   static constexpr uint8_t PingMessage[] = "ICEADAPTERPING";
   static constexpr uint8_t PongMessage[] = "ICEADAPTERPONG";
 
@@ -28,6 +35,7 @@ protected:
 
   rtc::scoped_refptr<webrtc::DataChannelInterface> _dataChannel;
   ConnectivityLostCallback _cb;
+  PingSentCallback _pingSentCb;
   Timer _pingStartDelayTimer;
   Timer _pingTimer;
   Timer _connectivityCheckTimer;
@@ -35,6 +43,7 @@ protected:
   std::optional<std::chrono::steady_clock::time_point> _lastSentPingTime;
   std::optional<std::chrono::steady_clock::time_point> _lastReceivedPongTime;
   std::optional<std::chrono::steady_clock::time_point> _lastReceivedDataTime;
+  std::optional<std::chrono::steady_clock::duration> _lastRoundTripTime;
 
   int _connectionTimeoutMs{10000};
   int _connectionCheckIntervalMs{1000};
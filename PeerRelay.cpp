@@ -1,7 +1,14 @@
 #include "PeerRelay.h"
 
 #include <algorithm>
+#include <sstream>
 
+#include <webrtc/p2p/base/candidate.h>
+#include <webrtc/rtc_base/ipaddress.h>
+
+#include "EventLog.h"
+#include "IceServerProber.h"
+#include "JsonRpcCodec.h"
 #include "logging.h"
 #include "PeerRelayObservers.h"
 
@@ -30,7 +37,14 @@ PeerRelay::PeerRelay(Options options,
   _isOfferer(options.isOfferer),
   _gameUdpAddress("127.0.0.1", options.gameUdpPort),
   _localUdpSocket(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_DGRAM)),
-  _callbacks(callbacks)
+  _holdQueueMaxBytes(options.holdQueueBytes),
+  _holdQueueMaxAge(options.holdQueueMaxAgeMs),
+  _congestionPolicy(_parseCongestionPolicy(options.congestionPolicy)),
+  _congestionThreshold(options.congestionThreshold),
+  _callbacks(callbacks),
+  _eventLog(options.eventLog ? *options.eventLog : eventLog()),
+  _flightRecorderDirectory(options.flightRecorderDirectory),
+  _icePolicy(options.icePolicy)
 {
   _localUdpSocket->SignalReadEvent.connect(this, &PeerRelay::_onPeerdataFromGame);
   if (_localUdpSocket->Bind(rtc::SocketAddress("127.0.0.1", 0)) != 0)
@@ -61,6 +75,33 @@ int PeerRelay::localUdpSocketPort() const
 
 Json::Value PeerRelay::status() const
 {
+  _updateStatusCache();
+  Json::Value result(_statusCache);
+  result["counters"] = counters();
+  result["hold_queue"] = holdQueueStatus();
+  return result;
+}
+
+std::string const& PeerRelay::serializedStatus() const
+{
+  _updateStatusCache();
+  /* the counters and the hold queue change with every packet, so they are not part of the cache */
+  _serializedStatus.assign(_serializedStatusCache, 0, _serializedStatusCache.size() - 1);
+  FastJsonCodec codec;
+  _serializedStatus += ",\"counters\":";
+  codec.write(counters(), _serializedStatus);
+  _serializedStatus += ",\"hold_queue\":";
+  codec.write(holdQueueStatus(), _serializedStatus);
+  _serializedStatus += '}';
+  return _serializedStatus;
+}
+
+void PeerRelay::_updateStatusCache() const
+{
+  if (_statusCacheValid)
+  {
+    return;
+  }
   Json::Value result;
   result["remote_player_id"] = _remotePlayerId;
   result["remote_player_login"] = _remotePlayerLogin;
@@ -75,8 +116,32 @@ Json::Value PeerRelay::status() const
   result["ice"]["rem_cand_addr"] = _remoteCandAddress;
   result["ice"]["loc_cand_type"] = _localCandType;
   result["ice"]["rem_cand_type"] = _remoteCandType;
+  result["ice"]["exclude_relay"] = _excludeRelayCandidates;
+  result["ice"]["pair_switches"] = _pairSwitches;
+  result["ice"]["last_pair_switch"] = _lastPairSwitch;
+  result["ice"]["last_pair_switch_method"] = _lastPairSwitchMethod;
+  result["ice"]["policy"] = _icePolicy.toJson();
+  result["ice"]["lan_phase"] = _lanPhase;
+  result["ice"]["gathering_time"] = _gatheringComplete ? std::chrono::duration_cast<std::chrono::milliseconds>(_gatheringDuration).count() / 1000. : 0.;
+  result["ice"]["local_candidates"] = Json::Value(Json::objectValue);
+  for (auto const& count: _localCandidateCounts)
+  {
+    result["ice"]["local_candidates"][count.first] = count.second;
+  }
+  result["ice"]["remote_candidates"] = Json::Value(Json::objectValue);
+  for (auto const& count: _remoteCandidateCounts)
+  {
+    result["ice"]["remote_candidates"][count.first] = count.second;
+  }
+  result["ice"]["congested"] = _congested;
+  result["ice"]["direct_udp"] = !_directUdp ? "none" :
+                                _directUdp->active() ? "active" :
+                                _directUdpDiscovering ? "discovering" : "probing";
   result["ice"]["time_to_connected"] = _isConnected ? std::chrono::duration_cast<std::chrono::milliseconds>(_connectDuration).count() / 1000. : 0.;
-  return result;
+  _statusCache.swap(result);
+  _serializedStatusCache.clear();
+  FastJsonCodec().write(_statusCache, _serializedStatusCache);
+  _statusCacheValid = true;
 }
 
 bool PeerRelay::isConnected() const
@@ -84,11 +149,157 @@ bool PeerRelay::isConnected() const
   return _isConnected;
 }
 
+int PeerRelay::remotePlayerId() const
+{
+  return _remotePlayerId;
+}
+
+std::string const& PeerRelay::remotePlayerLogin() const
+{
+  return _remotePlayerLogin;
+}
+
+PeerRelay::Metrics const& PeerRelay::metrics() const
+{
+  return _metrics;
+}
+
+Json::Value PeerRelay::counters() const
+{
+  Json::Value result;
+  result["game_to_peer_packets"] = Json::UInt64(_metrics.gameToPeerPackets.value());
+  result["game_to_peer_bytes"] = Json::UInt64(_metrics.gameToPeerBytes.value());
+  result["game_to_peer_direct_udp_packets"] = Json::UInt64(_metrics.gameToPeerDirectUdpPackets.value());
+  result["dropped_not_connected"] = Json::UInt64(_metrics.droppedGamePackets.value());
+  result["dropped_no_datachannel"] = Json::UInt64(_metrics.droppedNoDataChannelPackets.value());
+  result["game_read_errors"] = Json::UInt64(_metrics.gameReadErrors.value());
+  result["truncated_game_packets"] = Json::UInt64(_metrics.truncatedGamePackets.value());
+  result["direct_udp_send_errors"] = Json::UInt64(_metrics.directUdpSendErrors.value());
+  result["datachannel_send_errors"] = Json::UInt64(_metrics.dataChannelSendErrors.value());
+  result["peer_to_game_packets"] = Json::UInt64(_metrics.peerToGamePackets.value());
+  result["peer_to_game_bytes"] = Json::UInt64(_metrics.peerToGameBytes.value());
+  result["peer_to_game_direct_udp_packets"] = Json::UInt64(_metrics.peerToGameDirectUdpPackets.value());
+  result["game_send_errors"] = Json::UInt64(_metrics.gameSendErrors.value());
+  result["pings_received"] = Json::UInt64(_metrics.pingsReceived.value());
+  result["pongs_received"] = Json::UInt64(_metrics.pongsReceived.value());
+  result["control_messages_received"] = Json::UInt64(_metrics.controlMessagesReceived.value());
+  result["held_packets"] = Json::UInt64(_metrics.heldPackets.value());
+  result["flushed_held_packets"] = Json::UInt64(_metrics.flushedHeldPackets.value());
+  result["held_packets_dropped_full"] = Json::UInt64(_metrics.heldPacketsDroppedFull.value());
+  result["held_packets_dropped_stale"] = Json::UInt64(_metrics.heldPacketsDroppedStale.value());
+  result["congestion_episodes"] = Json::UInt64(_metrics.congestionEpisodes.value());
+  result["congestion_dropped_packets"] = Json::UInt64(_metrics.congestionDroppedPackets.value());
+  return result;
+}
+
+Json::Value PeerRelay::holdQueueStatus() const
+{
+  Json::Value result;
+  result["packets"] = Json::UInt64(_heldPackets.size());
+  result["bytes"] = Json::UInt64(_heldBytes);
+  result["oldest_age"] = _heldPackets.empty() ? 0. :
+                         std::chrono::duration<double>(std::chrono::steady_clock::now() - _heldPackets.front().time).count();
+  result["max_bytes"] = Json::UInt64(_holdQueueMaxBytes);
+  result["max_age"] = std::chrono::duration<double>(_holdQueueMaxAge).count();
+  return result;
+}
+
+Json::Value PeerRelay::statsSamples() const
+{
+  auto optional = [](double value)
+  {
+    return value < 0. ? Json::Value() : Json::Value(value);
+  };
+  Json::Value samples(Json::arrayValue);
+  for (std::size_t i = 0; i < _statsSamples.size(); ++i)
+  {
+    auto const& sample = _statsSamples[i];
+    Json::Value sampleJson;
+    sampleJson["time"] = std::chrono::duration<double>(sample.time - _connectStartTime).count();
+    sampleJson["rtt"] = optional(sample.roundTripTime);
+    sampleJson["available_outgoing_bitrate"] = optional(sample.availableOutgoingBitrate);
+    sampleJson["bytes_sent"] = Json::UInt64(sample.bytesSent);
+    sampleJson["bytes_received"] = Json::UInt64(sample.bytesReceived);
+    sampleJson["messages_sent"] = sample.messagesSent;
+    sampleJson["messages_received"] = sample.messagesReceived;
+    sampleJson["direct_udp_bytes_sent"] = Json::UInt64(sample.directUdpBytesSent);
+    sampleJson["send_bitrate"] = Json::Value();
+    sampleJson["receive_bitrate"] = Json::Value();
+    if (i > 0)
+    {
+      auto const& previous = _statsSamples[i - 1];
+      auto seconds = std::chrono::duration<double>(sample.time - previous.time).count();
+      /* the counters restart with each new peerconnection */
+      if (seconds > 0. &&
+          sample.bytesSent >= previous.bytesSent &&
+          sample.bytesReceived >= previous.bytesReceived)
+      {
+        sampleJson["send_bitrate"] = 8. * (sample.bytesSent - previous.bytesSent) / seconds;
+        sampleJson["receive_bitrate"] = 8. * (sample.bytesReceived - previous.bytesReceived) / seconds;
+      }
+    }
+    samples.append(sampleJson);
+  }
+  Json::Value result;
+  result["remote_player_id"] = _remotePlayerId;
+  result["degraded"] = _isDegraded();
+  result["interval_ms"] = _isDegraded() ? degradedStatsIntervalMs : healthyStatsIntervalMs;
+  result["samples"] = samples;
+  return result;
+}
+
+bool PeerRelay::dumpFlightRecorder(std::string const& path, std::string const& reason) const
+{
+  std::ostringstream title;
+  title << "flight recorder of the relay to " << _remotePlayerLogin << " (" << _remotePlayerId << ")"
+        << (_isOfferer ? ", offerer" : ", answerer") << ", ice state " << _iceState
+        << ", dumped on " << reason;
+  if (!_flightRecorder.dump(path, title.str()))
+  {
+    RELAY_LOG_ERROR << "unable to write flight recorder dump " << path;
+    return false;
+  }
+  RELAY_LOG_INFO << "wrote the last " << std::min<std::uint64_t>(_flightRecorder.recorded(), FlightRecorder::capacity)
+                 << " packets to " << path;
+  return true;
+}
+
 void PeerRelay::setIceServers(webrtc::PeerConnectionInterface::IceServers const& iceServers)
 {
   _iceServerList = iceServers;
 }
 
+void PeerRelay::setIcePolicy(IcePolicy const& policy)
+{
+  _icePolicy = policy;
+  _lanFirstFailed = false;
+  _notifyStatusChanged();
+  if (_isOfferer &&
+      !_isConnected &&
+      _peerConnection)
+  {
+    _reinitPeerconnection(1);
+  }
+}
+
+IcePolicy const& PeerRelay::icePolicy() const
+{
+  return _icePolicy;
+}
+
+/* the DTLS certificate fingerprint of an SDP, unique to the peerconnection which created it */
+static std::string sdpFingerprint(std::string const& sdp)
+{
+  static const std::string attribute = "a=fingerprint:";
+  auto begin = sdp.find(attribute);
+  if (begin == std::string::npos)
+  {
+    return std::string();
+  }
+  auto end = sdp.find_first_of("\r\n", begin);
+  return sdp.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+}
+
 void PeerRelay::addIceMessage(Json::Value const& iceMsg)
 {
   FAF_LOG_DEBUG << "addIceMessage: " << Json::FastWriter().write(iceMsg);
@@ -98,10 +309,22 @@ void PeerRelay::addIceMessage(Json::Value const& iceMsg)
     webrtc::SdpParseError error;
     auto sdp = webrtc::CreateSessionDescription(iceMsg["type"].asString(), iceMsg["sdp"].asString(), &error);
 
-    /* reinit on each offer is necessary to trigger the creation of an answer */
+    /* an offer of a new offerer peerconnection needs a new peerconnection to answer it.
+     * Offers with the DTLS fingerprint of the current session are ICE restarts and keep it. */
     if (!_isOfferer)
     {
-      _reinitPeerconnection();
+      auto fingerprint = sdpFingerprint(iceMsg["sdp"].asString());
+      if (!_peerConnection ||
+          fingerprint.empty() ||
+          fingerprint != _remoteFingerprint)
+      {
+        _reinitPeerconnection();
+      }
+      else
+      {
+        RELAY_LOG_DEBUG << "ICE restart offer";
+      }
+      _remoteFingerprint = fingerprint;
     }
     if (sdp)
     {
@@ -123,6 +346,10 @@ void PeerRelay::addIceMessage(Json::Value const& iceMsg)
     {
       FAF_LOG_ERROR << "parsing ICE candidate failed: " << error.description;
     }
+    else if (!_acceptRemoteCandidate(candidate->candidate()))
+    {
+      RELAY_LOG_DEBUG << "ignoring remote " << candidate->candidate().type() << " candidate";
+    }
     else if (!_peerConnection)
     {
       FAF_LOG_ERROR << "!_peerConnection: this is unexpected!";
@@ -138,10 +365,20 @@ void PeerRelay::addIceMessage(Json::Value const& iceMsg)
 void PeerRelay::_close()
 {
   _closing = true;
+  _statsTimer.stop();
+  _lanFirstTimer.stop();
   if (_connectionChecker)
   {
     _connectionChecker = nullptr;
   }
+  _remoteFingerprint.clear();
+  _directUdp.reset();
+  /* _directUdpKey is kept, a transport must never be created twice with the same key */
+  _directUdpLocalPort = 0;
+  _directUdpMappedAddress.Clear();
+  _directUdpRemoteAddress.Clear();
+  _directUdpDiscovering = false;
+  _directUdpOffers = 0;
   if (_dataChannel)
   {
     _dataChannel->UnregisterObserver();
@@ -156,6 +393,40 @@ void PeerRelay::_close()
   _closing = false;
 }
 
+webrtc::PeerConnectionInterface::RTCConfiguration PeerRelay::_rtcConfiguration() const
+{
+  webrtc::PeerConnectionInterface::RTCConfiguration configuration;
+  configuration.servers = _iceServerList;
+  configuration.enable_ice_renomination = true;
+  _icePolicy.apply(configuration);
+  if (_lanPhase)
+  {
+    /* without servers only host candidates are gathered */
+    configuration.servers.clear();
+  }
+  else if (_excludeRelayCandidates)
+  {
+    /* there is no IceTransportsType without relay candidates, so the TURN URLs are dropped */
+    for (auto& server: configuration.servers)
+    {
+      server.urls.erase(std::remove_if(server.urls.begin(), server.urls.end(), [](std::string const& url)
+      {
+        return url.compare(0, 4, "turn") == 0;
+      }), server.urls.end());
+      if (server.uri.compare(0, 4, "turn") == 0)
+      {
+        server.uri.clear();
+      }
+    }
+    /* servers without any URL fail the configuration */
+    configuration.servers.erase(std::remove_if(configuration.servers.begin(), configuration.servers.end(), [](webrtc::PeerConnectionInterface::IceServer const& server)
+    {
+      return server.urls.empty() && server.uri.empty();
+    }), configuration.servers.end());
+  }
+  return configuration;
+}
+
 void PeerRelay::_reinitPeerconnection(int delayMs)
 {
   if (_closing)
@@ -164,10 +435,24 @@ void PeerRelay::_reinitPeerconnection(int delayMs)
   }
   auto reinitFunction = [this]()
   {
+    /* a pair switch which fell back to a new peerconnection is not a lost connection */
+    if (_peerConnection &&
+        !_pairSwitchReinit)
+    {
+      _metrics.reconnects.add();
+      _eventLog.write(EventId::Reconnect, _remotePlayerId, _metrics.reconnects.value());
+    }
+    _pairSwitchReinit = false;
     _close();
+    /* the new DataChannel starts with an empty send buffer */
+    _setCongested(false);
 
-    webrtc::PeerConnectionInterface::RTCConfiguration configuration;
-    configuration.servers = _iceServerList;
+    _betterDirectPairSamples = 0;
+    _lanPhase = _isOfferer &&
+                _icePolicy.lanFirst &&
+                _icePolicy.transportType == "all" &&
+                !_lanFirstFailed;
+    auto configuration = _rtcConfiguration();
     _peerConnection = _pcfactory->CreatePeerConnection(configuration,
                                                        nullptr,
                                                        nullptr,
@@ -177,6 +462,26 @@ void PeerRelay::_reinitPeerconnection(int delayMs)
       FAF_LOG_ERROR << "_pcfactory->CreatePeerConnection() failed!";
       std::exit(1);
     }
+    _gatheringStartTime = std::chrono::steady_clock::now();
+    _gatheringComplete = false;
+    _localCandidateCounts.clear();
+    _remoteCandidateCounts.clear();
+    _notifyStatusChanged();
+    /* sampling from the start also covers connection attempts which never succeed */
+    _requestStats();
+
+    if (_lanPhase)
+    {
+      _lanFirstTimer.singleShot(lanFirstTimeoutMs, [this]()
+      {
+        if (!_isConnected)
+        {
+          RELAY_LOG_INFO << "no LAN connection after " << lanFirstTimeoutMs << " ms, gathering all candidates";
+          _lanFirstFailed = true;
+          _reinitPeerconnection(1);
+        }
+      });
+    }
 
     if (_isOfferer)
     {
@@ -201,7 +506,12 @@ void PeerRelay::_reinitPeerconnection(int delayMs)
       _connectionChecker = std::make_unique<PeerConnectivityChecker>(_dataChannel,
                                                                      [this]()
       {
+          _fallBackToRelay("connectivity check failed");
           _reinitPeerconnection(1);
+      },
+                                                                     [this]()
+      {
+          _flightRecorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Ping, sizeof(PeerConnectivityChecker::PingMessage));
       });
     }
   };
@@ -222,7 +532,13 @@ void PeerRelay::_reinitPeerconnection(int delayMs)
 void PeerRelay::_setIceState(std::string const& state)
 {
   RELAY_LOG_DEBUG << "ice state changed to " << state;
+  _eventLog.write(EventId::IceState, _remotePlayerId, state);
   _iceState = state;
+  if (_iceState == "failed")
+  {
+    _dumpFlightRecorderOnFailure();
+  }
+  _notifyStatusChanged();
   if (_closing)
   {
     return;
@@ -251,6 +567,7 @@ void PeerRelay::_setIceState(std::string const& state)
 
     {
       RELAY_LOG_WARN << "Connection lost, forcing reconnect in 100 ms.";
+      _fallBackToRelay("connection " + _iceState);
       _connectionChecker = nullptr;
       _reinitPeerconnection(100);
     }
@@ -275,28 +592,503 @@ void PeerRelay::_setConnected(bool connected)
     {
       RELAY_LOG_INFO << "disconnected";
     }
+    _eventLog.write(EventId::Connected, _remotePlayerId, connected,
+                     connected ? static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(_connectDuration).count()) : 0);
+    if (connected)
+    {
+      _flushHeldPackets();
+    }
+    _notifyStatusChanged();
   }
   if (connected)
+  {
+    _requestStats();
+  }
+}
+
+void PeerRelay::_requestStats()
+{
+  _statsTimer.stop();
+  if (_peerConnection && !_closing)
   {
     _peerConnection->GetStats(_rtcStatsCollectorCallback.get());
   }
 }
 
+void PeerRelay::_addStatsSample(StatsSample const& sample)
+{
+  _statsSamples.push(sample);
+  if (_peerConnection && !_closing)
+  {
+    _statsTimer.singleShot(_isDegraded() ? degradedStatsIntervalMs : healthyStatsIntervalMs,
+                           [this]()
+    {
+      _requestStats();
+    });
+  }
+}
+
+bool PeerRelay::_isDegraded() const
+{
+  if (!_isConnected ||
+      _statsSamples.size() < 2)
+  {
+    return true;
+  }
+  auto const& last = _statsSamples.back();
+  auto const& previous = _statsSamples[_statsSamples.size() - 2];
+  if (last.roundTripTime > degradedRoundTripTime)
+  {
+    return true;
+  }
+  /* unanswered connectivity checks since the previous sample */
+  if (last.requestsSent >= previous.requestsSent &&
+      last.responsesReceived >= previous.responsesReceived &&
+      last.requestsSent - previous.requestsSent > last.responsesReceived - previous.responsesReceived)
+  {
+    return true;
+  }
+  return false;
+}
+
+void PeerRelay::_notifyStatusChanged()
+{
+  _statusCacheValid = false;
+  if (_callbacks.statusChangedCallback)
+  {
+    _callbacks.statusChangedCallback();
+  }
+}
+
+void PeerRelay::_evaluateCandidatePairs(std::vector<CandidatePairSample> const& pairs)
+{
+  if (!_isOfferer ||
+      !_isConnected ||
+      _excludeRelayCandidates)
+  {
+    return;
+  }
+  auto selectedIt = std::find_if(pairs.begin(), pairs.end(), [](CandidatePairSample const& pair)
+  {
+    return pair.selected;
+  });
+  if (selectedIt == pairs.end() ||
+      selectedIt->roundTripTime < 0. ||
+      (selectedIt->localType != "relay" &&
+       selectedIt->remoteType != "relay"))
+  {
+    _betterDirectPairSamples = 0;
+    return;
+  }
+  CandidatePairSample const* bestDirect = nullptr;
+  for (auto const& pair: pairs)
+  {
+    if (pair.localType != "relay" &&
+        pair.remoteType != "relay" &&
+        pair.roundTripTime >= 0. &&
+        pair.lossRate <= pairSwitchMaxLoss &&
+        (!bestDirect || pair.roundTripTime < bestDirect->roundTripTime))
+    {
+      bestDirect = &pair;
+    }
+  }
+  if (!bestDirect ||
+      bestDirect->roundTripTime > selectedIt->roundTripTime * pairSwitchRttRatio ||
+      bestDirect->roundTripTime + pairSwitchRttMargin > selectedIt->roundTripTime)
+  {
+    _betterDirectPairSamples = 0;
+    return;
+  }
+  if (++_betterDirectPairSamples < pairSwitchSamples ||
+      (_pairSwitches > 0 &&
+       std::chrono::steady_clock::now() - _lastPairSwitchTime < std::chrono::seconds(pairSwitchCooldownSeconds)))
+  {
+    return;
+  }
+  std::ostringstream description;
+  description << selectedIt->localType << "/" << selectedIt->remoteType << " "
+              << static_cast<int>(selectedIt->roundTripTime * 1000) << " ms -> "
+              << bestDirect->localType << "/" << bestDirect->remoteType << " "
+              << static_cast<int>(bestDirect->roundTripTime * 1000) << " ms";
+  RELAY_LOG_INFO << "restarting ICE without relay candidates: " << description.str();
+  _excludeRelayCandidates = true;
+  ++_pairSwitches;
+  _lastPairSwitch = description.str();
+  _lastPairSwitchTime = std::chrono::steady_clock::now();
+  _eventLog.write(EventId::PairSwitch, _remotePlayerId, true, _lastPairSwitch);
+  if (_restartIce())
+  {
+    _lastPairSwitchMethod = "ice_restart";
+  }
+  else
+  {
+    /* delayed to not close the peerconnection in its own stats callback */
+    RELAY_LOG_WARN << "ICE restart not possible, recreating the peerconnection";
+    _lastPairSwitchMethod = "new_peerconnection";
+    _pairSwitchReinit = true;
+    _reinitPeerconnection(1);
+  }
+  _notifyStatusChanged();
+}
+
+bool PeerRelay::_restartIce()
+{
+  if (!_peerConnection ||
+      !_isOfferer)
+  {
+    return false;
+  }
+  /* the new configuration applies to the candidates gathered for the restart,
+   * the DTLS and SCTP association and the DataChannel are kept */
+  webrtc::RTCError error;
+  if (!_peerConnection->SetConfiguration(_rtcConfiguration(), &error))
+  {
+    RELAY_LOG_WARN << "SetConfiguration() failed: " << error.message();
+    return false;
+  }
+  webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+  options.offer_to_receive_audio = 0;
+  options.offer_to_receive_video = 0;
+  options.ice_restart = true;
+  _peerConnection->CreateOffer(_createOfferObserver,
+                               options);
+  return true;
+}
+
+void PeerRelay::_fallBackToRelay(std::string const& reason)
+{
+  if (!_excludeRelayCandidates)
+  {
+    return;
+  }
+  RELAY_LOG_WARN << "direct connection failed, allowing relay candidates again: " << reason;
+  _excludeRelayCandidates = false;
+  ++_pairSwitches;
+  _lastPairSwitch = "direct -> relay: " + reason;
+  _lastPairSwitchMethod = "new_peerconnection";
+  _lastPairSwitchTime = std::chrono::steady_clock::now();
+  _eventLog.write(EventId::PairSwitch, _remotePlayerId, false, reason);
+  _notifyStatusChanged();
+}
+
+static std::string candidateTypeName(std::string const& type)
+{
+  /* cricket names the host and server reflexive types differently than the stats */
+  if (type == "local")
+  {
+    return "host";
+  }
+  if (type == "stun")
+  {
+    return "srflx";
+  }
+  return type;
+}
+
+bool PeerRelay::_acceptLocalCandidate(cricket::Candidate const& candidate)
+{
+  if (_icePolicy.ignoredNetworks & candidate.network_type())
+  {
+    ++_localCandidateCounts["filtered"];
+    _notifyStatusChanged();
+    return false;
+  }
+  ++_localCandidateCounts[candidateTypeName(candidate.type())];
+  _notifyStatusChanged();
+  return true;
+}
+
+bool PeerRelay::_acceptRemoteCandidate(cricket::Candidate const& candidate)
+{
+  auto type = candidateTypeName(candidate.type());
+  if ((_excludeRelayCandidates && type == "relay") ||
+      (_lanPhase && type != "host"))
+  {
+    ++_remoteCandidateCounts["filtered"];
+    _notifyStatusChanged();
+    return false;
+  }
+  ++_remoteCandidateCounts[type];
+  _notifyStatusChanged();
+  return true;
+}
+
 void PeerRelay::_onPeerdataFromGame(rtc::AsyncSocket* socket)
 {
   _sendCowBuffer.EnsureCapacity(sendBufferSize);
   auto msgLength = socket->Recv(_sendCowBuffer.data(), sendBufferSize, nullptr);
+  if (msgLength < 0)
+  {
+    _metrics.gameReadErrors.add();
+    return;
+  }
+  if (msgLength == 0)
+  {
+    return;
+  }
+  if (static_cast<std::size_t>(msgLength) >= sendBufferSize)
+  {
+    _metrics.truncatedGamePackets.add();
+  }
+
+  /* I hope the buffer doesn't shrink upon SetSize() */
+  _sendCowBuffer.SetSize(msgLength);
+
+  if (!_canSendToPeer())
+  {
+    if (_holdQueueMaxBytes > 0)
+    {
+      _holdPacket(_sendCowBuffer);
+      return;
+    }
+    if (!_isConnected)
+    {
+      RELAY_LOG_TRACE << "skipping " << msgLength << " bytes of P2P data until ICE connection is established";
+      _metrics.droppedGamePackets.add();
+      return;
+    }
+  }
+  if (!_heldPackets.empty())
+  {
+    _flushHeldPackets();
+    /* the flush stopped at the congestion limit: drop-oldest queues the packet behind the held ones
+     * to keep the order, the other policies handle it like any other packet in _sendToPeer() */
+    if (!_heldPackets.empty() &&
+        _congestionPolicy == CongestionPolicy::DropOldest)
+    {
+      _holdPacket(_sendCowBuffer);
+      return;
+    }
+  }
+  _sendToPeer(_sendCowBuffer);
+}
+
+bool PeerRelay::_canSendToPeer() const
+{
+  return _isConnected &&
+         ((_directUdp && _directUdp->active()) ||
+          (_dataChannel && _dataChannel->state() == webrtc::DataChannelInterface::kOpen));
+}
+
+void PeerRelay::_sendToPeer(rtc::CopyOnWriteBuffer const& packet)
+{
+  if (_directUdp &&
+      _directUdp->active())
+  {
+    if (_directUdp->send(packet.data(), packet.size()))
+    {
+      _flightRecorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Data, packet.size());
+      _metrics.gameToPeerPackets.add();
+      _metrics.gameToPeerBytes.add(packet.size());
+      _metrics.gameToPeerDirectUdpPackets.add();
+      return;
+    }
+    _metrics.directUdpSendErrors.add();
+  }
+  if (!_dataChannel)
+  {
+    _metrics.droppedNoDataChannelPackets.add();
+    return;
+  }
+  if (_applyCongestionPolicy(packet))
+  {
+    return;
+  }
+  if (!_dataChannel->Send({packet, true}))
+  {
+    _metrics.dataChannelSendErrors.add();
+    return;
+  }
+  _flightRecorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Data, packet.size());
+  _metrics.gameToPeerPackets.add();
+  _metrics.gameToPeerBytes.add(packet.size());
+}
+
+void PeerRelay::_holdPacket(rtc::CopyOnWriteBuffer const& packet)
+{
+  auto now = std::chrono::steady_clock::now();
+  _expireHeldPackets(now);
+  if (packet.size() > _holdQueueMaxBytes)
+  {
+    _metrics.heldPacketsDroppedFull.add();
+    return;
+  }
+  while (_heldBytes + packet.size() > _holdQueueMaxBytes)
+  {
+    _heldBytes -= _heldPackets.front().data.size();
+    _heldPackets.pop_front();
+    _metrics.heldPacketsDroppedFull.add();
+  }
+  /* copy, the receive buffer is reused for the next packet */
+  _heldPackets.push_back({now, rtc::CopyOnWriteBuffer(packet.data(), packet.size())});
+  _heldBytes += packet.size();
+  _metrics.heldPackets.add();
+  _scheduleHeldPacketExpiry(now);
+}
+
+void PeerRelay::_expireHeldPackets(std::chrono::steady_clock::time_point now)
+{
+  while (!_heldPackets.empty() &&
+         now - _heldPackets.front().time > _holdQueueMaxAge)
+  {
+    _heldBytes -= _heldPackets.front().data.size();
+    _heldPackets.pop_front();
+    _metrics.heldPacketsDroppedStale.add();
+  }
+  _scheduleHeldPacketExpiry(now);
+}
+
+void PeerRelay::_scheduleHeldPacketExpiry(std::chrono::steady_clock::time_point now)
+{
+  /* without it stale packets would stay queued until the next game packet or flush */
+  if (_heldPackets.empty())
+  {
+    _holdQueueTimer.stop();
+    return;
+  }
+  if (_holdQueueTimer.started())
+  {
+    return;
+  }
+  auto expiry = _heldPackets.front().time + _holdQueueMaxAge - now;
+  _holdQueueTimer.singleShot(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(expiry).count()) + 1,
+                             [this]()
+  {
+    _expireHeldPackets(std::chrono::steady_clock::now());
+  });
+}
+
+void PeerRelay::_flushHeldPackets()
+{
+  if (_heldPackets.empty() ||
+      !_canSendToPeer())
+  {
+    return;
+  }
+  _expireHeldPackets(std::chrono::steady_clock::now());
+  if (!_heldPackets.empty())
+  {
+    RELAY_LOG_DEBUG << "sending " << _heldPackets.size() << " held game packets (" << _heldBytes << " bytes)";
+  }
+  while (!_heldPackets.empty())
+  {
+    auto& packet = _heldPackets.front().data;
+    /* the direct UDP path doesn't use the DataChannel send buffer.
+     * Otherwise the rest is sent on the next OnBufferedAmountChange. */
+    if (!(_directUdp && _directUdp->active()))
+    {
+      if (_dataChannelCongested(packet.size()))
+      {
+        _setCongested(true);
+      }
+      if (_dataChannelFull(packet.size()))
+      {
+        break;
+      }
+    }
+    _sendToPeer(packet);
+    _heldBytes -= packet.size();
+    _heldPackets.pop_front();
+    _metrics.flushedHeldPackets.add();
+  }
+}
+
+PeerRelay::CongestionPolicy PeerRelay::_parseCongestionPolicy(std::string const& name)
+{
+  if (name == "drop-newest")
+  {
+    return CongestionPolicy::DropNewest;
+  }
+  if (name == "drop-oldest")
+  {
+    return CongestionPolicy::DropOldest;
+  }
+  if (name == "signal")
+  {
+    return CongestionPolicy::Signal;
+  }
+  return CongestionPolicy::None;
+}
+
+bool PeerRelay::_dataChannelCongested(std::size_t additionalBytes) const
+{
+  return _congestionPolicy != CongestionPolicy::None &&
+         _dataChannel &&
+         _dataChannel->buffered_amount() + additionalBytes > _congestionThreshold;
+}
+
+bool PeerRelay::_dataChannelFull(std::size_t additionalBytes) const
+{
+  /* signal keeps sending up to twice the threshold */
+  auto limit = _congestionPolicy == CongestionPolicy::Signal ? 2 * _congestionThreshold : _congestionThreshold;
+  return _congestionPolicy != CongestionPolicy::None &&
+         _dataChannel &&
+         _dataChannel->buffered_amount() + additionalBytes > limit;
+}
+
+bool PeerRelay::_applyCongestionPolicy(rtc::CopyOnWriteBuffer const& packet)
+{
+  if (!_dataChannelCongested(packet.size()))
+  {
+    return false;
+  }
+  _setCongested(true);
+  switch (_congestionPolicy)
+  {
+    case CongestionPolicy::DropOldest:
+      if (_holdQueueMaxBytes > 0)
+      {
+        _holdPacket(packet);
+        return true;
+      }
+      break;
+    case CongestionPolicy::Signal:
+      if (!_dataChannelFull(packet.size()))
+      {
+        return false;
+      }
+      break;
+    default:
+      break;
+  }
+  _metrics.congestionDroppedPackets.add();
+  return true;
+}
 
-  if (!_isConnected)
+void PeerRelay::_setCongested(bool congested)
+{
+  if (congested == _congested)
   {
-    RELAY_LOG_TRACE << "skipping " << msgLength << " bytes of P2P data until ICE connection is established";
     return;
   }
-  if (msgLength > 0 && _dataChannel)
+  _congested = congested;
+  if (congested)
   {
-    /* I hope the buffer doesn't shrink upon SetSize() */
-    _sendCowBuffer.SetSize(msgLength);
-    _dataChannel->Send({_sendCowBuffer, true});
+    _metrics.congestionEpisodes.add();
+    RELAY_LOG_WARN << "DataChannel congested, " << _dataChannel->buffered_amount() << " bytes buffered";
+  }
+  else
+  {
+    RELAY_LOG_INFO << "DataChannel congestion ended";
+  }
+  if (_callbacks.congestionCallback)
+  {
+    _callbacks.congestionCallback(congested);
+  }
+  _notifyStatusChanged();
+}
+
+void PeerRelay::_onBufferedAmountChange()
+{
+  if (_congested &&
+      _dataChannel &&
+      _dataChannel->buffered_amount() < _congestionThreshold / 2)
+  {
+    _setCongested(false);
+  }
+  if (!_heldPackets.empty())
+  {
+    _flushHeldPackets();
   }
 }
 
@@ -305,6 +1097,12 @@ void PeerRelay::_onRemoteMessage(const uint8_t* data, std::size_t size)
   if (_connectionChecker &&
       _connectionChecker->handleMessageFromPeer(data, size))
   {
+    _flightRecorder.record(FlightRecorder::Direction::Received, FlightRecorder::Kind::Pong, size);
+    _metrics.pongsReceived.add();
+    if (auto rtt = _connectionChecker->lastRoundTripTime())
+    {
+      _metrics.roundTripTime.set(std::chrono::duration<double>(*rtt).count());
+    }
     return;
   }
   /* the answerer doesnt have a _connectionChecker, so it handles Ping messages here */
@@ -316,12 +1114,305 @@ void PeerRelay::_onRemoteMessage(const uint8_t* data, std::size_t size)
       _dataChannel)
   {
     _dataChannel->Send(webrtc::DataBuffer(rtc::CopyOnWriteBuffer(PeerConnectivityChecker::PongMessage, sizeof(PeerConnectivityChecker::PongMessage)), true));
+    _flightRecorder.record(FlightRecorder::Direction::Received, FlightRecorder::Kind::Ping, size);
+    _metrics.pingsReceived.add();
+    _flightRecorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Pong, sizeof(PeerConnectivityChecker::PongMessage));
     return;
   }
-  _localUdpSocket->SendTo(data,
-                          size,
-                          _gameUdpAddress);
+  if (_handleDirectUdpMessage(data, size))
+  {
+    _flightRecorder.record(FlightRecorder::Direction::Received, FlightRecorder::Kind::Control, size);
+    _metrics.controlMessagesReceived.add();
+    return;
+  }
+  _sendToGame(data, size);
 }
 
+void PeerRelay::_dumpFlightRecorderOnFailure()
+{
+  auto now = std::chrono::steady_clock::now();
+  if (_flightRecorderDirectory.empty() ||
+      (_flightRecorderDumped &&
+       now - _lastFlightRecorderDumpTime < std::chrono::seconds(flightRecorderDumpCooldownSeconds)))
+  {
+    return;
+  }
+  _flightRecorderDumped = true;
+  _lastFlightRecorderDumpTime = now;
+  dumpFlightRecorder(_flightRecorderDirectory + "/" + FlightRecorder::fileName(_remotePlayerId), "ice state failed");
+}
+
+void PeerRelay::_sendToGame(const uint8_t* data, std::size_t size)
+{
+  _flightRecorder.record(FlightRecorder::Direction::Received, FlightRecorder::Kind::Data, size);
+  if (_localUdpSocket->SendTo(data,
+                              size,
+                              _gameUdpAddress) < 0)
+  {
+    _metrics.gameSendErrors.add();
+    return;
+  }
+  _metrics.peerToGamePackets.add();
+  _metrics.peerToGameBytes.add(size);
+}
+
+bool PeerRelay::_directUdpLanPathUsable() const
+{
+  rtc::IPAddress remoteIp;
+  return _localCandType == "host" &&
+         _remoteCandType == "host" &&
+         rtc::IPFromString(_remoteCandIp, &remoteIp) &&
+         remoteIp.family() == AF_INET &&
+         rtc::IPIsPrivate(remoteIp);
+}
+
+bool PeerRelay::_directUdpAllowed() const
+{
+  return _icePolicy.directUdp == "any" ||
+         (_icePolicy.directUdp == "lan" && _directUdpLanPathUsable());
+}
+
+std::unique_ptr<DirectUdpTransport> PeerRelay::_createDirectUdp(std::string const& key)
+{
+  auto transport = std::make_unique<DirectUdpTransport>(key,
+                                                        _isOfferer,
+                                                        [this](const uint8_t* data, std::size_t size)
+  {
+    _metrics.peerToGameDirectUdpPackets.add();
+    _sendToGame(data, size);
+  },
+                                                        [this](bool active)
+  {
+    RELAY_LOG_INFO << "direct UDP path " << (active ? "active" : "lost, using the DataChannel");
+    _eventLog.write(EventId::DirectUdp, _remotePlayerId, active);
+    if (active)
+    {
+      _flushHeldPackets();
+    }
+    _notifyStatusChanged();
+  });
+  _directUdpLocalPort = transport->bind();
+  if (_directUdpLocalPort == 0)
+  {
+    return nullptr;
+  }
+  _directUdpKey = key;
+  _directUdpMappedAddress.Clear();
+  _directUdpRemoteAddress.Clear();
+  _directUdpDiscovering = false;
+  return transport;
+}
+
+void PeerRelay::_discoverDirectUdpAddress(std::function<void()> done)
+{
+  /* peers on the same network reach each other via the host candidate address */
+  if (_icePolicy.directUdp != "any" ||
+      _directUdpLanPathUsable())
+  {
+    done();
+    return;
+  }
+  for (auto const& server: _iceServerList)
+  {
+    auto urls = server.urls;
+    if (!server.uri.empty())
+    {
+      urls.push_back(server.uri);
+    }
+    for (auto const& url: urls)
+    {
+      std::string host;
+      int port;
+      if (IceServerProber::parseUrl(url, host, port))
+      {
+        _directUdpDiscovering = true;
+        _directUdp->discoverMappedAddress(rtc::SocketAddress(host, port),
+                                          [this, done](rtc::SocketAddress const& mappedAddress)
+        {
+          _directUdpDiscovering = false;
+          _directUdpMappedAddress = mappedAddress;
+          if (mappedAddress.IsNil())
+          {
+            RELAY_LOG_DEBUG << "direct UDP address discovery failed, offering the candidate address";
+          }
+          else
+          {
+            RELAY_LOG_DEBUG << "direct UDP socket is mapped to " << mappedAddress.ToString();
+          }
+          done();
+        });
+        return;
+      }
+    }
+  }
+  done();
+}
+
+void PeerRelay::_appendDirectUdpEndpoint(rtc::CopyOnWriteBuffer& message) const
+{
+  uint32_t ip = 0;
+  int port = _directUdpLocalPort;
+  if (!_directUdpMappedAddress.IsNil())
+  {
+    ip = _directUdpMappedAddress.ipaddr().v4AddressAsHostOrderInteger();
+    port = _directUdpMappedAddress.port();
+  }
+  uint8_t endpoint[directUdpEndpointSize] = {static_cast<uint8_t>(ip >> 24),
+                                             static_cast<uint8_t>(ip >> 16),
+                                             static_cast<uint8_t>(ip >> 8),
+                                             static_cast<uint8_t>(ip),
+                                             static_cast<uint8_t>(port >> 8),
+                                             static_cast<uint8_t>(port)};
+  message.AppendData(endpoint, sizeof(endpoint));
+}
+
+rtc::SocketAddress PeerRelay::_parseDirectUdpEndpoint(const uint8_t* endpoint) const
+{
+  uint32_t ip = static_cast<uint32_t>(endpoint[0]) << 24 | static_cast<uint32_t>(endpoint[1]) << 16 |
+                static_cast<uint32_t>(endpoint[2]) << 8 | endpoint[3];
+  int port = endpoint[4] << 8 | endpoint[5];
+  if (ip == 0)
+  {
+    return rtc::SocketAddress(_remoteCandIp, port);
+  }
+  return rtc::SocketAddress(rtc::IPAddress(ip), port);
+}
+
+void PeerRelay::_connectDirectUdp(rtc::SocketAddress const& remoteAddress)
+{
+  if (remoteAddress == _directUdpRemoteAddress)
+  {
+    return;
+  }
+  RELAY_LOG_DEBUG << "probing direct UDP path to " << remoteAddress.ToString();
+  _directUdpRemoteAddress = remoteAddress;
+  _directUdp->connect(remoteAddress);
+}
+
+void PeerRelay::_sendDirectUdpOffer()
+{
+  if (!_dataChannel ||
+      !_directUdp)
+  {
+    return;
+  }
+  ++_directUdpOffers;
+  RELAY_LOG_DEBUG << "offering direct UDP path on port " << _directUdpLocalPort;
+  rtc::CopyOnWriteBuffer offer(DirectUdpOfferMessage, sizeof(DirectUdpOfferMessage));
+  _appendDirectUdpEndpoint(offer);
+  offer.AppendData(_directUdpKey.data(), _directUdpKey.size());
+  _dataChannel->Send(webrtc::DataBuffer(offer, true));
+  _flightRecorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Control, offer.size());
+}
+
+void PeerRelay::_sendDirectUdpAnswer()
+{
+  if (!_dataChannel ||
+      !_directUdp)
+  {
+    return;
+  }
+  rtc::CopyOnWriteBuffer answer(DirectUdpAnswerMessage, sizeof(DirectUdpAnswerMessage));
+  _appendDirectUdpEndpoint(answer);
+  _dataChannel->Send(webrtc::DataBuffer(answer, true));
+  _flightRecorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Control, answer.size());
+}
+
+void PeerRelay::_tryDirectUdp()
+{
+  if (!_isOfferer ||
+      !_isConnected ||
+      !_dataChannel ||
+      _closing ||
+      (_directUdp && _directUdp->active()) ||
+      _directUdpDiscovering ||
+      _directUdpOffers >= maxDirectUdpOffers ||
+      !_directUdpAllowed())
+  {
+    return;
+  }
+  if (!_directUdp)
+  {
+    _directUdp = _createDirectUdp(DirectUdpTransport::createKey());
+    if (!_directUdp)
+    {
+      _directUdpOffers = maxDirectUdpOffers;
+      return;
+    }
+    _notifyStatusChanged();
+    _discoverDirectUdpAddress([this]()
+    {
+      _sendDirectUdpOffer();
+      _notifyStatusChanged();
+    });
+    return;
+  }
+  _sendDirectUdpOffer();
+}
+
+bool PeerRelay::_handleDirectUdpMessage(const uint8_t* data, std::size_t size)
+{
+  static_assert(sizeof(DirectUdpOfferMessage) == sizeof(DirectUdpAnswerMessage), "control message magic sizes differ");
+  const std::size_t magicSize = sizeof(DirectUdpOfferMessage);
+  if (size < magicSize + directUdpEndpointSize)
+  {
+    return false;
+  }
+  if (!_isOfferer &&
+      size == magicSize + directUdpEndpointSize + DirectUdpTransport::keySize &&
+      std::equal(data, data + magicSize, DirectUdpOfferMessage))
+  {
+    if (!_directUdpAllowed() ||
+        !_dataChannel)
+    {
+      RELAY_LOG_DEBUG << "declining direct UDP path";
+      return true;
+    }
+    auto remoteAddress = _parseDirectUdpEndpoint(data + magicSize);
+    std::string key(reinterpret_cast<const char*>(data + magicSize + directUdpEndpointSize), DirectUdpTransport::keySize);
+    if (!_directUdp &&
+        key == _directUdpKey)
+    {
+      /* a new transport would start its sequence numbers, the AEAD nonces, at 0 again */
+      RELAY_LOG_DEBUG << "declining direct UDP offer with a key which was already used";
+      return true;
+    }
+    if (!_directUdp ||
+        key != _directUdpKey)
+    {
+      _directUdp = _createDirectUdp(key);
+      if (!_directUdp)
+      {
+        return true;
+      }
+      /* probing right away opens our NAT mapping towards the offerer */
+      _connectDirectUdp(remoteAddress);
+      _notifyStatusChanged();
+      _discoverDirectUdpAddress([this]()
+      {
+        _sendDirectUdpAnswer();
+        _notifyStatusChanged();
+      });
+      return true;
+    }
+    _connectDirectUdp(remoteAddress);
+    if (!_directUdpDiscovering)
+    {
+      _sendDirectUdpAnswer();
+    }
+    return true;
+  }
+  if (_isOfferer &&
+      size == magicSize + directUdpEndpointSize &&
+      std::equal(data, data + magicSize, DirectUdpAnswerMessage))
+  {
+    if (_directUdp)
+    {
+      _connectDirectUdp(_parseDirectUdpEndpoint(data + magicSize));
+    }
+    return true;
+  }
+  return false;
+}
 
 } // namespace faf
@@ -4,15 +4,28 @@
 #include <functional>
 #include <chrono>
 #include <array>
+#include <deque>
+#include <map>
+#include <vector>
 
 #include <webrtc/api/peerconnectioninterface.h>
 #include <webrtc/rtc_base/copyonwritebuffer.h>
 
 #include <webrtc/third_party/jsoncpp/source/include/json/json.h>
 
+#include "DirectUdpTransport.h"
+#include "EventLog.h"
+#include "FlightRecorder.h"
+#include "IcePolicy.h"
+#include "Metrics.h"
+#include "RingBuffer.h"
 #include "Timer.h"
 #include "PeerConnectivityChecker.h"
 
+namespace cricket {
+class Candidate;
+}
+
 namespace faf {
 
 class CreateOfferObserver;
@@ -31,6 +44,10 @@ public:
     std::function<void (Json::Value iceMsg)> iceMessageCallback;
     std::function<void (std::string state)> stateCallback;
     std::function<void (bool)> connectedCallback;
+    /* called whenever a value reported by status() changed */
+    std::function<void ()> statusChangedCallback;
+    /* called when the DataChannel send buffer exceeds or falls below the congestion threshold */
+    std::function<void (bool congested)> congestionCallback;
   };
 
   struct Options
@@ -40,6 +57,78 @@ public:
     bool isOfferer;
     int gameUdpPort;
     webrtc::PeerConnectionInterface::IceServers iceServers;
+    IcePolicy icePolicy;
+    std::string flightRecorderDirectory; /*!< directory of the automatic flight recorder dumps on ICE failure, empty disables them */
+    std::size_t holdQueueBytes{65536};   /*!< game packets held while not connected, 0 drops them */
+    int holdQueueMaxAgeMs{2000};         /*!< held packets older than this are dropped instead of sent */
+    std::string congestionPolicy{"drop-newest"}; /*!< "none", "drop-newest", "drop-oldest" or "signal" */
+    std::size_t congestionThreshold{16384};      /*!< DataChannel buffered amount in bytes which counts as congestion */
+    EventLog* eventLog{nullptr};                 /*!< event log of the session, nullptr uses the process event log */
+  };
+
+  /** \brief Counters of every branch of the packet forwarding path
+   *
+   *  Written by the relay thread only, aligned to a cache line so metrics
+   *  and status readers never share a line with other relay state.
+   */
+  struct alignas(64) Metrics
+  {
+    /* game -> peer */
+    Counter gameToPeerPackets;
+    Counter gameToPeerBytes;
+    Counter gameToPeerDirectUdpPackets; /*!< part of gameToPeerPackets sent via the direct UDP path */
+    Counter droppedGamePackets;         /*!< game packets received before the connection was established */
+    Counter droppedNoDataChannelPackets;
+    Counter gameReadErrors;
+    Counter truncatedGamePackets;       /*!< reads which filled the whole receive buffer */
+    Counter directUdpSendErrors;        /*!< the packet was sent via the DataChannel instead */
+    Counter dataChannelSendErrors;
+    /* peer -> game */
+    Counter peerToGamePackets;
+    Counter peerToGameBytes;
+    Counter peerToGameDirectUdpPackets; /*!< part of peerToGamePackets received via the direct UDP path */
+    Counter gameSendErrors;
+    Counter pingsReceived;
+    Counter pongsReceived;
+    Counter controlMessagesReceived;    /*!< direct UDP offers and answers */
+    /* game packets held while not connected */
+    Counter heldPackets;
+    Counter flushedHeldPackets;
+    Counter heldPacketsDroppedFull;     /*!< the oldest held packets dropped for newer ones */
+    Counter heldPacketsDroppedStale;    /*!< held packets which expired before the connection was up */
+    /* DataChannel send buffer congestion */
+    Counter congestionEpisodes;
+    Counter congestionDroppedPackets;   /*!< game packets dropped because the DataChannel send buffer was full */
+
+    Counter reconnects;
+    Gauge roundTripTime;        /*!< seconds, measured by the connectivity checker pings of the offerer */
+  };
+
+  /** \brief One getStats() sample of the selected candidate pair and the datachannel
+   */
+  struct StatsSample
+  {
+    std::chrono::steady_clock::time_point time;
+    double roundTripTime{-1.};            /*!< seconds, -1 if not reported */
+    double availableOutgoingBitrate{-1.}; /*!< bits/s, -1 if not reported */
+    std::uint64_t bytesSent{0};
+    std::uint64_t bytesReceived{0};
+    std::uint64_t requestsSent{0};        /*!< STUN connectivity checks on the pair */
+    std::uint64_t responsesReceived{0};
+    std::uint32_t messagesSent{0};
+    std::uint32_t messagesReceived{0};
+    std::uint64_t directUdpBytesSent{0};  /*!< UDP payload bytes of the direct path including its headers and probes */
+  };
+
+  /** \brief A succeeded candidate pair of a getStats() report, input of the pair switching policy
+   */
+  struct CandidatePairSample
+  {
+    std::string localType;
+    std::string remoteType;
+    double roundTripTime{-1.}; /*!< seconds, -1 if not reported */
+    double lossRate{0.};       /*!< unanswered share of the connectivity checks */
+    bool selected{false};
   };
 
   PeerRelay(Options options,
@@ -49,20 +138,94 @@ public:
 
   void setIceServers(webrtc::PeerConnectionInterface::IceServers const& iceServers);
 
+  /** \brief Change the candidate policy
+   *         An offerer which is not connected yet restarts ICE right away,
+   *         otherwise the policy is used for the next connection attempt.
+      */
+  void setIcePolicy(IcePolicy const& policy);
+  IcePolicy const& icePolicy() const;
+
   void addIceMessage(Json::Value const& iceMsg);
 
   int localUdpSocketPort() const;
 
   Json::Value status() const;
 
+  /** \brief The status as compact JSON, cached until the status changes,
+   *         only the "counters" member is serialized on each call
+      */
+  std::string const& serializedStatus() const;
+
   bool isConnected() const;
 
+  int remotePlayerId() const;
+  std::string const& remotePlayerLogin() const;
+
+  Metrics const& metrics() const;
+
+  /** \brief The packet counters of metrics() as JSON object
+      */
+  Json::Value counters() const;
+
+  /** \brief Size and limits of the queue of game packets held while not connected
+      */
+  Json::Value holdQueueStatus() const;
+
+  /** \brief The recorded getStats() samples, oldest first, with throughput derived from consecutive samples
+      */
+  Json::Value statsSamples() const;
+
+  /** \brief Write the last sent and received packets to a text file
+       \param reason: noted in the file header
+       \returns false if the file could not be written
+      */
+  bool dumpFlightRecorder(std::string const& path, std::string const& reason) const;
+
 protected:
   void _close();
+  webrtc::PeerConnectionInterface::RTCConfiguration _rtcConfiguration() const;
   void _reinitPeerconnection(int delayMs = 0);
   void _setIceState(std::string const& state);
   void _setConnected(bool connected);
+  void _notifyStatusChanged();
+  void _requestStats();
+  void _addStatsSample(StatsSample const& sample);
+  bool _isDegraded() const;
+  void _evaluateCandidatePairs(std::vector<CandidatePairSample> const& pairs);
+  void _fallBackToRelay(std::string const& reason);
+  /** \brief Apply the current configuration and send an offer with new ICE credentials
+       \returns false if the peerconnection refused the configuration
+      */
+  bool _restartIce();
+  bool _acceptLocalCandidate(cricket::Candidate const& candidate);
+  bool _acceptRemoteCandidate(cricket::Candidate const& candidate);
+  bool _directUdpLanPathUsable() const;
+  bool _directUdpAllowed() const;
+  void _tryDirectUdp();
+  bool _handleDirectUdpMessage(const uint8_t* data, std::size_t size);
+  std::unique_ptr<DirectUdpTransport> _createDirectUdp(std::string const& key);
+  void _discoverDirectUdpAddress(std::function<void()> done);
+  void _appendDirectUdpEndpoint(rtc::CopyOnWriteBuffer& message) const;
+  rtc::SocketAddress _parseDirectUdpEndpoint(const uint8_t* endpoint) const;
+  void _connectDirectUdp(rtc::SocketAddress const& remoteAddress);
+  void _sendDirectUdpOffer();
+  void _sendDirectUdpAnswer();
+  void _sendToGame(const uint8_t* data, std::size_t size);
+  void _dumpFlightRecorderOnFailure();
+  void _updateStatusCache() const;
   void _onPeerdataFromGame(rtc::AsyncSocket* socket);
+  bool _canSendToPeer() const;
+  void _sendToPeer(rtc::CopyOnWriteBuffer const& packet);
+  void _holdPacket(rtc::CopyOnWriteBuffer const& packet);
+  void _expireHeldPackets(std::chrono::steady_clock::time_point now);
+  void _scheduleHeldPacketExpiry(std::chrono::steady_clock::time_point now);
+  void _flushHeldPackets();
+  bool _dataChannelCongested(std::size_t additionalBytes = 0) const;
+  /* no packets are passed to the DataChannel above this limit */
+  bool _dataChannelFull(std::size_t additionalBytes) const;
+  bool _applyCongestionPolicy(rtc::CopyOnWriteBuffer const& packet);
+  void _setCongested(bool congested);
+  void _onBufferedAmountChange();
   void _onRemoteMessage(const uint8_t* data, std::size_t size);
 
   /* runtime objects for WebRTC */
@@ -92,8 +255,38 @@ protected:
   static constexpr const std::size_t sendBufferSize = 65507;
   rtc::CopyOnWriteBuffer _sendCowBuffer{sendBufferSize};
 
+  /* game packets which arrive while the connection is down are held and sent once it is up again,
+   * so the game does not have to wait for its own retransmissions after a reconnect */
+  struct HeldPacket
+  {
+    std::chrono::steady_clock::time_point time;
+    rtc::CopyOnWriteBuffer data;
+  };
+  std::size_t _holdQueueMaxBytes;
+  std::chrono::milliseconds _holdQueueMaxAge;
+  std::deque<HeldPacket> _heldPackets;
+  std::size_t _heldBytes{0};
+  Timer _holdQueueTimer;
+
+  /* SCTP buffers without limit, so game packets are not passed to the DataChannel while its buffered amount
+   * exceeds the threshold: they are dropped (drop-newest), queued in the hold queue (drop-oldest) or sent
+   * anyway up to twice the threshold after notifying the client (signal).
+   * The congestion ends when the buffered amount falls below half the threshold. */
+  enum class CongestionPolicy
+  {
+    None,
+    DropNewest,
+    DropOldest,
+    Signal
+  };
+  static CongestionPolicy _parseCongestionPolicy(std::string const& name);
+  CongestionPolicy _congestionPolicy;
+  std::size_t _congestionThreshold;
+  bool _congested{false};
+
   /* ICE state data */
   Callbacks _callbacks;
+  EventLog& _eventLog;
   bool _isConnected{false};
   bool _closing{false};
   std::string _iceState{"none"};
@@ -101,13 +294,76 @@ protected:
   std::string _remoteCandAddress;
   std::string _localCandType;
   std::string _remoteCandType;
+  std::string _remoteCandIp;
   std::string _localSdp;
   std::string _iceGatheringState{"none"};
   std::string _dataChannelState{"none"};
   std::chrono::steady_clock::time_point _connectStartTime;
   std::chrono::steady_clock::duration _connectDuration;
+  std::chrono::steady_clock::time_point _gatheringStartTime;
+  std::chrono::steady_clock::duration _gatheringDuration{0};
+  bool _gatheringComplete{false};
+  std::map<std::string, int> _localCandidateCounts;  /*!< by candidate type, plus "filtered" */
+  std::map<std::string, int> _remoteCandidateCounts;
   std::unique_ptr<PeerConnectivityChecker> _connectionChecker;
   Timer _reinitTimer;
+  Metrics _metrics;
+
+  /* the last packets of the relay, dumped on request or when ICE fails, but at most every flightRecorderDumpCooldownSeconds */
+  static constexpr int flightRecorderDumpCooldownSeconds = 60;
+  FlightRecorder _flightRecorder;
+  std::string _flightRecorderDirectory;
+  std::chrono::steady_clock::time_point _lastFlightRecorderDumpTime;
+  bool _flightRecorderDumped{false};
+
+  /* getStats() is sampled while the peerconnection exists, faster while the connection is degraded */
+  static constexpr int healthyStatsIntervalMs = 5000;
+  static constexpr int degradedStatsIntervalMs = 1000;
+  static constexpr double degradedRoundTripTime = 0.25;
+  Timer _statsTimer;
+  RingBuffer<StatsSample, 120> _statsSamples;
+
+  /* the offerer restarts ICE without relay candidates when a direct pair is clearly faster than the selected relayed one */
+  static constexpr int pairSwitchSamples = 3;
+  static constexpr double pairSwitchRttRatio = 0.7;
+  static constexpr double pairSwitchRttMargin = 0.02;
+  static constexpr double pairSwitchMaxLoss = 0.1;
+  static constexpr int pairSwitchCooldownSeconds = 60;
+  bool _excludeRelayCandidates{false};
+  int _betterDirectPairSamples{0};
+  int _pairSwitches{0};
+  std::string _lastPairSwitch;
+  std::string _lastPairSwitchMethod;
+  std::chrono::steady_clock::time_point _lastPairSwitchTime;
+  bool _pairSwitchReinit{false};
+  std::string _remoteFingerprint; /*!< of the answered offers, a new one needs a new peerconnection */
+
+  /* with lanFirst the offerer gathers host candidates only, and gathers all after lanFirstTimeoutMs without connection */
+  static constexpr int lanFirstTimeoutMs = 3000;
+  IcePolicy _icePolicy;
+  bool _lanPhase{false};
+  bool _lanFirstFailed{false};
+  Timer _lanFirstTimer;
+
+  /* the offerer proposes a direct UDP path via the DataChannel, which is unreliable, so offers are repeated with the stats samples.
+   * The endpoint is an IPv4 address (4 bytes, 0 for the address of the selected candidate) and a port (2 bytes). */
+  static constexpr uint8_t DirectUdpOfferMessage[] = "ICEADAPTERUDPOFR";  /* followed by the endpoint and the key */
+  static constexpr uint8_t DirectUdpAnswerMessage[] = "ICEADAPTERUDPANS"; /* followed by the endpoint */
+  static constexpr std::size_t directUdpEndpointSize = 6;
+  static constexpr int maxDirectUdpOffers = 5;
+  std::unique_ptr<DirectUdpTransport> _directUdp;
+  std::string _directUdpKey;
+  int _directUdpLocalPort{0};
+  rtc::SocketAddress _directUdpMappedAddress;  /*!< public address of the local socket discovered via STUN, nil if unknown */
+  rtc::SocketAddress _directUdpRemoteAddress;
+  bool _directUdpDiscovering{false};
+  int _directUdpOffers{0};
+
+  /* status() caches, invalidated by _notifyStatusChanged() */
+  mutable Json::Value _statusCache;
+  mutable std::string _serializedStatusCache;
+  mutable std::string _serializedStatus;
+  mutable bool _statusCacheValid{false};
 
   /* access declarations for observers */
   friend CreateOfferObserver;
@@ -1,7 +1,9 @@
 #include "PeerRelayObservers.h"
 
 #include <webrtc/api/stats/rtcstats_objects.h>
+#include <webrtc/p2p/base/candidate.h>
 
+#include "EventLog.h"
 #include "logging.h"
 #include "PeerRelay.h"
 
@@ -123,14 +125,24 @@ void PeerConnectionObserver::OnIceGatheringChange(webrtc::PeerConnectionInterfac
       break;
     case webrtc::PeerConnectionInterface::kIceGatheringComplete:
       _relay->_iceGatheringState = "complete";
+      _relay->_gatheringDuration = std::chrono::steady_clock::now() - _relay->_gatheringStartTime;
+      _relay->_gatheringComplete = true;
+      OBSERVER_LOG_DEBUG << "gathering took " << std::chrono::duration_cast<std::chrono::milliseconds>(_relay->_gatheringDuration).count() << " ms";
       break;
   }
+  _relay->_eventLog.write(EventId::GatheringState, _relay->_remotePlayerId, _relay->_iceGatheringState);
+  _relay->_notifyStatusChanged();
 }
 
 void PeerConnectionObserver::OnIceCandidate(const webrtc::IceCandidateInterface *candidate)
 {
   OBSERVER_LOG_DEBUG << "PeerConnectionObserver::OnIceCandidate";
 
+  if (!_relay->_acceptLocalCandidate(candidate->candidate()))
+  {
+    OBSERVER_LOG_DEBUG << "not signaling candidate of ignored network";
+    return;
+  }
   if (_relay->_callbacks.iceMessageCallback)
   {
     Json::Value candidateJson;
@@ -156,6 +168,14 @@ void PeerConnectionObserver::OnDataChannel(rtc::scoped_refptr<webrtc::DataChanne
   OBSERVER_LOG_DEBUG << "PeerConnectionObserver::OnDataChannel";
   _relay->_dataChannel = data_channel;
   _relay->_dataChannel->RegisterObserver(_relay->_dataChannelObserver.get());
+  /* the channel may have opened before the observer was registered, then OnStateChange never reports it */
+  if (data_channel->state() == webrtc::DataChannelInterface::kOpen)
+  {
+    _relay->_dataChannelState = "open";
+    _relay->_flushHeldPackets();
+    _relay->_eventLog.write(EventId::DataChannelState, _relay->_remotePlayerId, _relay->_dataChannelState);
+    _relay->_notifyStatusChanged();
+  }
 }
 
 void PeerConnectionObserver::OnAddStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream)
@@ -177,6 +197,7 @@ void DataChannelObserver::OnStateChange()
       case webrtc::DataChannelInterface::kOpen:
         OBSERVER_LOG_DEBUG << "DataChannelObserver::OnStateChange to Open";
         _relay->_dataChannelState = "open";
+        _relay->_flushHeldPackets();
         break;
       case webrtc::DataChannelInterface::kConnecting:
         OBSERVER_LOG_DEBUG << "DataChannelObserver::OnStateChange to Connecting";
@@ -191,6 +212,8 @@ void DataChannelObserver::OnStateChange()
         _relay->_dataChannelState = "closed";
         break;
     }
+    _relay->_eventLog.write(EventId::DataChannelState, _relay->_remotePlayerId, _relay->_dataChannelState);
+    _relay->_notifyStatusChanged();
   }
 }
 
@@ -200,44 +223,187 @@ void DataChannelObserver::OnMessage(const webrtc::DataBuffer& buffer)
                            buffer.data.size());
 }
 
+void DataChannelObserver::OnBufferedAmountChange(uint64_t previous_amount)
+{
+  _relay->_onBufferedAmountChange();
+}
+
 void RTCStatsCollectorCallback::OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report)
 {
-  OBSERVER_LOG_DEBUG << "RTCStatsCollectorCallback::OnStatsDelivered";
+  OBSERVER_LOG_TRACE << "RTCStatsCollectorCallback::OnStatsDelivered";
   if (!report)
   {
     OBSERVER_LOG_ERROR << "!report";
     return;
   }
-  std::string localCandId;
-  std::string remoteCandId;
-  auto pairs = report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>();
-  for (auto pair: pairs)
+  PeerRelay::StatsSample sample;
+  sample.time = std::chrono::steady_clock::now();
+  if (_relay->_directUdp)
   {
-    if (*pair->state == "succeeded")
+    sample.directUdpBytesSent = _relay->_directUdp->bytesSent();
+  }
+
+  /* prefer the pair selected by the transport, fall back to the first succeeded one */
+  webrtc::RTCIceCandidatePairStats const* selectedPair = nullptr;
+  for (auto transport: report->GetStatsOfType<webrtc::RTCTransportStats>())
+  {
+    if (transport->selected_candidate_pair_id.is_defined())
     {
-      localCandId = *pair->local_candidate_id;
-      remoteCandId = *pair->remote_candidate_id;
-      break;
+      auto pair = report->Get(*transport->selected_candidate_pair_id);
+      if (pair && pair->type() == webrtc::RTCIceCandidatePairStats::kType)
+      {
+        selectedPair = &pair->cast_to<webrtc::RTCIceCandidatePairStats>();
+        break;
+      }
+    }
+  }
+  if (!selectedPair)
+  {
+    for (auto pair: report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>())
+    {
+      if (pair->state.is_defined() &&
+          *pair->state == "succeeded")
+      {
+        selectedPair = pair;
+        break;
+      }
+    }
+  }
+
+  for (auto dataChannel: report->GetStatsOfType<webrtc::RTCDataChannelStats>())
+  {
+    if (dataChannel->messages_sent.is_defined())
+    {
+      sample.messagesSent += *dataChannel->messages_sent;
+    }
+    if (dataChannel->messages_received.is_defined())
+    {
+      sample.messagesReceived += *dataChannel->messages_received;
+    }
+  }
+
+  std::vector<PeerRelay::CandidatePairSample> pairSamples;
+  auto candidateType = [&report](webrtc::RTCStatsMember<std::string> const& candidateId)
+  {
+    if (!candidateId.is_defined())
+    {
+      return std::string();
+    }
+    auto candidate = static_cast<webrtc::RTCIceCandidateStats const*>(report->Get(*candidateId));
+    if (!candidate ||
+        !candidate->candidate_type.is_defined())
+    {
+      return std::string();
+    }
+    return *candidate->candidate_type;
+  };
+  for (auto pair: report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>())
+  {
+    if (!pair->state.is_defined() ||
+        *pair->state != "succeeded")
+    {
+      continue;
+    }
+    PeerRelay::CandidatePairSample pairSample;
+    pairSample.localType = candidateType(pair->local_candidate_id);
+    pairSample.remoteType = candidateType(pair->remote_candidate_id);
+    if (pair->current_round_trip_time.is_defined())
+    {
+      pairSample.roundTripTime = *pair->current_round_trip_time;
+    }
+    if (pair->requests_sent.is_defined() &&
+        pair->responses_received.is_defined() &&
+        *pair->requests_sent > 0 &&
+        *pair->responses_received <= *pair->requests_sent)
+    {
+      pairSample.lossRate = 1. - static_cast<double>(*pair->responses_received) / *pair->requests_sent;
     }
-    //OBSERVER_LOG_DEBUG << "*pair->state ==" << *pair->state << "nominated ==" << *pair->nominated;
+    pairSample.selected = pair == selectedPair;
+    pairSamples.push_back(pairSample);
   }
-  if (localCandId.empty())
+  _relay->_evaluateCandidatePairs(pairSamples);
+
+  if (!selectedPair)
   {
-    OBSERVER_LOG_WARN << "localCandId.empty()";
+    OBSERVER_LOG_DEBUG << "no selected candidate pair";
+    _relay->_addStatsSample(sample);
     return;
   }
-  auto lCand = static_cast<webrtc::RTCLocalIceCandidateStats const*>(report->Get(localCandId));
-  if (lCand)
+  if (selectedPair->current_round_trip_time.is_defined())
+  {
+    sample.roundTripTime = *selectedPair->current_round_trip_time;
+  }
+  if (selectedPair->available_outgoing_bitrate.is_defined())
+  {
+    sample.availableOutgoingBitrate = *selectedPair->available_outgoing_bitrate;
+  }
+  if (selectedPair->bytes_sent.is_defined())
+  {
+    sample.bytesSent = *selectedPair->bytes_sent;
+  }
+  if (selectedPair->bytes_received.is_defined())
   {
-    _relay->_localCandAddress = *lCand->protocol + " " + *lCand->ip +":" + std::to_string(*lCand->port);
-    _relay->_localCandType = *lCand->candidate_type;
+    sample.bytesReceived = *selectedPair->bytes_received;
+  }
+  if (selectedPair->requests_sent.is_defined())
+  {
+    sample.requestsSent = *selectedPair->requests_sent;
+  }
+  if (selectedPair->responses_received.is_defined())
+  {
+    sample.responsesReceived = *selectedPair->responses_received;
+  }
+  _relay->_addStatsSample(sample);
+
+  /* the candidates only change with the selected pair, so the status is only touched then */
+  bool candidatesChanged = false;
+  auto updateCandidate = [&candidatesChanged](std::string& address,
+                                              std::string& type,
+                                              webrtc::RTCIceCandidateStats const* candidate)
+  {
+    if (!candidate ||
+        !candidate->protocol.is_defined() ||
+        !candidate->ip.is_defined() ||
+        !candidate->port.is_defined())
+    {
+      return;
+    }
+    auto newAddress = *candidate->protocol + " " + *candidate->ip +":" + std::to_string(*candidate->port);
+    auto newType = candidate->candidate_type.is_defined() ? *candidate->candidate_type : std::string();
+    if (newAddress != address ||
+        newType != type)
+    {
+      address = newAddress;
+      type = newType;
+      candidatesChanged = true;
+    }
+  };
+  if (selectedPair->local_candidate_id.is_defined())
+  {
+    updateCandidate(_relay->_localCandAddress,
+                    _relay->_localCandType,
+                    static_cast<webrtc::RTCIceCandidateStats const*>(report->Get(*selectedPair->local_candidate_id)));
+  }
+  if (selectedPair->remote_candidate_id.is_defined())
+  {
+    auto remoteCandidate = static_cast<webrtc::RTCIceCandidateStats const*>(report->Get(*selectedPair->remote_candidate_id));
+    updateCandidate(_relay->_remoteCandAddress,
+                    _relay->_remoteCandType,
+                    remoteCandidate);
+    if (remoteCandidate &&
+        remoteCandidate->ip.is_defined())
+    {
+      _relay->_remoteCandIp = *remoteCandidate->ip;
+    }
   }
-  auto rCand = static_cast<webrtc::RTCRemoteIceCandidateStats const*>(report->Get(remoteCandId));
-  if (rCand)
+  if (candidatesChanged)
   {
-    _relay->_remoteCandAddress = *rCand->protocol + " " + *rCand->ip +":" + std::to_string(*rCand->port);
-    _relay->_remoteCandType = *rCand->candidate_type;
+    _relay->_eventLog.write(EventId::CandidatePair, _relay->_remotePlayerId,
+                     _relay->_localCandType, _relay->_remoteCandType,
+                     _relay->_localCandAddress, _relay->_remoteCandAddress);
+    _relay->_notifyStatusChanged();
   }
+  _relay->_tryDirectUdp();
 }
 
 } // namespace faf
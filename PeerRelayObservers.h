@@ -84,6 +84,7 @@ private:
 
   virtual void OnStateChange() override;
   virtual void OnMessage(const webrtc::DataBuffer& buffer) override;
+  virtual void OnBufferedAmountChange(uint64_t previous_amount) override;
 };
 
 class RTCStatsCollectorCallback : public webrtc::RTCStatsCollectorCallback
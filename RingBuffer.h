@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace faf {
+
+/*! \brief Fixed capacity ring which overwrites its oldest element when full
+ */
+template<typename T, std::size_t Capacity>
+class RingBuffer
+{
+public:
+  void push(T const& value)
+  {
+    _items[(_begin + _size) % Capacity] = value;
+    if (_size < Capacity)
+    {
+      ++_size;
+    }
+    else
+    {
+      _begin = (_begin + 1) % Capacity;
+    }
+  }
+
+  /** \returns the element at index, 0 is the oldest one
+      */
+  T const& operator[](std::size_t index) const
+  {
+    return _items[(_begin + index) % Capacity];
+  }
+
+  T const& back() const
+  {
+    return (*this)[_size - 1];
+  }
+
+  std::size_t size() const
+  {
+    return _size;
+  }
+
+  bool empty() const
+  {
+    return _size == 0;
+  }
+
+  void clear()
+  {
+    _begin = 0;
+    _size = 0;
+  }
+
+  static constexpr std::size_t capacity = Capacity;
+
+protected:
+  std::array<T, Capacity> _items{};
+  std::size_t _begin{0};
+  std::size_t _size{0};
+};
+
+} // namespace faf
@@ -0,0 +1,103 @@
+#include "SessionHost.h"
+
+#include <algorithm>
+#include <thread>
+
+#if defined(WEBRTC_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(WEBRTC_LINUX)
+#include <fstream>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+
+namespace faf {
+
+SessionHost::SessionHost(IceAdapterOptions const& options)
+{
+  auto factoryCount = options.pcFactories;
+  if (factoryCount == 0)
+  {
+    factoryCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency() / 2));
+  }
+  factoryCount = std::min(factoryCount, options.sessions);
+  for (int i = 0; i < factoryCount; ++i)
+  {
+    _pcfactories.push_back(std::make_shared<PeerConnectionFactory>(options, i));
+  }
+  _baseMemory = residentMemory();
+
+  _sessions.reserve(static_cast<std::size_t>(options.sessions));
+  for (int i = 0; i < options.sessions; ++i)
+  {
+    EventLog* sessionEventLog = &eventLog();
+    if (i > 0)
+    {
+      _eventLogs.push_back(std::make_unique<EventLog>());
+      sessionEventLog = _eventLogs.back().get();
+      if (!options.logDirectory.empty() &&
+          options.eventLogSize > 0)
+      {
+        sessionEventLog->open(options.logDirectory + "/ice_adapter_events_" + std::to_string(i) + ".bin",
+                              static_cast<std::size_t>(options.eventLogSize) * 1024 * 1024);
+      }
+    }
+    _sessions.push_back(std::make_unique<IceAdapter>(options.forSession(i), _pcfactories.at(i % _pcfactories.size()), *sessionEventLog));
+  }
+  FAF_LOG_INFO << "started " << _sessions.size() << " sessions on " << _pcfactories.size() << " peer connection factories";
+  for (auto const& session: _sessions)
+  {
+    FAF_LOG_INFO << "session of player " << session->options().localPlayerId
+                 << ": JSON-RPC port " << session->rpcPort()
+                 << ", GPGNet port " << session->gpgNetPort();
+  }
+  _logMemory();
+  _memoryLogTimer.start(60000, std::bind(&SessionHost::_logMemory, this));
+}
+
+std::size_t SessionHost::sessionCount() const
+{
+  return _sessions.size();
+}
+
+std::size_t SessionHost::residentMemory()
+{
+#if defined(WEBRTC_WIN)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    return counters.WorkingSetSize;
+  }
+  return 0;
+#elif defined(WEBRTC_LINUX)
+  /* total and resident pages */
+  std::ifstream statm("/proc/self/statm");
+  std::size_t totalPages = 0;
+  std::size_t residentPages = 0;
+  if (!(statm >> totalPages >> residentPages))
+  {
+    return 0;
+  }
+  return residentPages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+void SessionHost::_logMemory() const
+{
+  std::size_t relays = 0;
+  for (auto const& session : _sessions)
+  {
+    relays += session->relayCount();
+  }
+  auto memory = residentMemory();
+  auto sessionMemory = memory > _baseMemory ? memory - _baseMemory : 0;
+  FAF_LOG_INFO << _sessions.size() << " sessions with " << relays << " relays, resident memory "
+               << memory / (1024 * 1024) << " MiB, "
+               << sessionMemory / 1024 / _sessions.size() << " KiB per session";
+}
+
+} // namespace faf
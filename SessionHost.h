@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "EventLog.h"
+#include "IceAdapter.h"
+#include "IceAdapterOptions.h"
+#include "PeerConnectionFactory.h"
+#include "Timer.h"
+
+namespace faf {
+
+/*! \brief Runs many independent IceAdapter sessions in one process
+ *
+ *  All sessions live on the current thread and are spread over --pc-factories
+ *  peer connection factories, each with a network and a worker thread. Each session has its
+ *  own JSON-RPC, GPGNet, lobby and metrics ports, see IceAdapterOptions::forSession(),
+ *  and its own event log file, because the remote player IDs repeat across sessions.
+ *  The memory use per session is logged periodically.
+ */
+class SessionHost
+{
+public:
+  SessionHost(IceAdapterOptions const& options);
+
+  std::size_t sessionCount() const;
+
+  /** \returns the resident set size of the process in bytes, 0 if unknown on this platform
+      */
+  static std::size_t residentMemory();
+
+protected:
+  void _logMemory() const;
+
+  std::vector<std::shared_ptr<PeerConnectionFactory>> _pcfactories;
+  std::vector<std::unique_ptr<EventLog>> _eventLogs; /*!< of sessions 1 to N-1, session 0 uses the process event log */
+  std::vector<std::unique_ptr<IceAdapter>> _sessions;
+  std::size_t _baseMemory{0}; /*!< resident memory before the first session */
+  Timer _memoryLogTimer;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(SessionHost);
+};
+
+} // namespace faf
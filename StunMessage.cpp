@@ -0,0 +1,102 @@
+#include "StunMessage.h"
+
+#include <algorithm>
+
+#include <webrtc/rtc_base/ipaddress.h>
+
+namespace faf {
+namespace stun {
+
+static uint16_t read16(const uint8_t* data)
+{
+  return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+static uint32_t read32(const uint8_t* data)
+{
+  return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+         static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+TransactionId randomTransactionId(std::mt19937& random)
+{
+  TransactionId result;
+  std::uniform_int_distribution<int> byte(0, 255);
+  for (auto& b: result)
+  {
+    b = static_cast<uint8_t>(byte(random));
+  }
+  return result;
+}
+
+std::array<uint8_t, headerSize> bindingRequest(TransactionId const& transactionId)
+{
+  std::array<uint8_t, headerSize> request{{0x00, 0x01, 0x00, 0x00,
+                                          (magicCookie >> 24) & 0xff,
+                                          (magicCookie >> 16) & 0xff,
+                                          (magicCookie >> 8) & 0xff,
+                                          magicCookie & 0xff}};
+  std::copy(transactionId.begin(), transactionId.end(), request.begin() + 8);
+  return request;
+}
+
+bool parseBindingResponse(const uint8_t* data,
+                          std::size_t size,
+                          TransactionId& transactionId,
+                          rtc::SocketAddress* mappedAddress)
+{
+  if (size < headerSize)
+  {
+    return false;
+  }
+  auto type = read16(data);
+  /* a Binding error response proves reachability as well */
+  if ((type != 0x0101 && type != 0x0111) ||
+      read32(data + 4) != magicCookie)
+  {
+    return false;
+  }
+  std::copy(data + 8, data + headerSize, transactionId.begin());
+  if (!mappedAddress ||
+      type != 0x0101)
+  {
+    return true;
+  }
+  std::size_t end = std::min(size, headerSize + read16(data + 2));
+  std::size_t offset = headerSize;
+  while (offset + 4 <= end)
+  {
+    auto attributeType = read16(data + offset);
+    auto attributeLength = read16(data + offset + 2);
+    auto value = data + offset + 4;
+    if (offset + 4 + attributeLength > end)
+    {
+      break;
+    }
+    /* IPv4 family only */
+    if ((attributeType == 0x0020 || attributeType == 0x0001) &&
+        attributeLength == 8 &&
+        value[1] == 0x01)
+    {
+      auto port = read16(value + 2);
+      auto ip = read32(value + 4);
+      if (attributeType == 0x0020)
+      {
+        port ^= static_cast<uint16_t>(magicCookie >> 16);
+        ip ^= magicCookie;
+      }
+      *mappedAddress = rtc::SocketAddress(rtc::IPAddress(ip), port);
+      /* XOR-MAPPED-ADDRESS takes precedence */
+      if (attributeType == 0x0020)
+      {
+        break;
+      }
+    }
+    /* attributes are padded to 4 bytes */
+    offset += 4 + ((attributeLength + 3) & ~3u);
+  }
+  return true;
+}
+
+} // namespace stun
+} // namespace faf
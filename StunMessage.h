@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+
+#include <webrtc/rtc_base/asyncsocket.h>
+
+namespace faf {
+
+/*! \brief The few bits of STUN (RFC 5389) needed to probe servers and discover mapped addresses
+ */
+namespace stun {
+
+typedef std::array<uint8_t, 12> TransactionId;
+
+constexpr uint32_t magicCookie = 0x2112A442;
+constexpr std::size_t headerSize = 20;
+
+TransactionId randomTransactionId(std::mt19937& random);
+
+/** \brief A Binding request without attributes
+   */
+std::array<uint8_t, headerSize> bindingRequest(TransactionId const& transactionId);
+
+/** \brief Parse a Binding success or error response
+    \param transactionId: set to the transaction ID of the response
+    \param mappedAddress: if not null, set to the IPv4 XOR-MAPPED-ADDRESS or MAPPED-ADDRESS of a success response
+    \returns false if the data is no Binding response
+   */
+bool parseBindingResponse(const uint8_t* data,
+                          std::size_t size,
+                          TransactionId& transactionId,
+                          rtc::SocketAddress* mappedAddress = nullptr);
+
+} // namespace stun
+} // namespace faf
@@ -0,0 +1,232 @@
+#include "ThreadSettings.h"
+
+#include <sstream>
+
+#if defined(WEBRTC_WIN)
+#include <windows.h>
+#elif defined(WEBRTC_LINUX)
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+
+namespace faf {
+
+static bool setAffinity(std::vector<int> const& cpus)
+{
+#if defined(WEBRTC_WIN)
+  DWORD_PTR mask = 0;
+  for (auto cpu: cpus)
+  {
+    if (cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+    {
+      return false;
+    }
+    mask |= DWORD_PTR(1) << cpu;
+  }
+  return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(WEBRTC_LINUX)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu: cpus)
+  {
+    if (cpu >= CPU_SETSIZE)
+    {
+      return false;
+    }
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+static bool setPriority(ThreadPriority priority)
+{
+#if defined(WEBRTC_WIN)
+  int value = THREAD_PRIORITY_NORMAL;
+  switch (priority)
+  {
+    case ThreadPriority::Low:
+      value = THREAD_PRIORITY_BELOW_NORMAL;
+      break;
+    case ThreadPriority::Normal:
+      value = THREAD_PRIORITY_NORMAL;
+      break;
+    case ThreadPriority::High:
+      value = THREAD_PRIORITY_ABOVE_NORMAL;
+      break;
+    case ThreadPriority::Highest:
+      value = THREAD_PRIORITY_HIGHEST;
+      break;
+  }
+  return SetThreadPriority(GetCurrentThread(), value) != 0;
+#elif defined(WEBRTC_LINUX)
+  /* Linux applies nice values to single threads */
+  int nice = 0;
+  switch (priority)
+  {
+    case ThreadPriority::Low:
+      nice = 10;
+      break;
+    case ThreadPriority::Normal:
+      nice = 0;
+      break;
+    case ThreadPriority::High:
+      nice = -5;
+      break;
+    case ThreadPriority::Highest:
+      nice = -10;
+      break;
+  }
+  return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) == 0;
+#else
+  return priority == ThreadPriority::Normal;
+#endif
+}
+
+/* e.g. "CPUs 0-3,6, nice 0", to verify the settings in the log */
+static std::string describeCurrentThread()
+{
+  std::ostringstream result;
+#if defined(WEBRTC_WIN)
+  result << "priority " << GetThreadPriority(GetCurrentThread());
+#elif defined(WEBRTC_LINUX)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+  {
+    result << "CPUs ";
+    bool first = true;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (!CPU_ISSET(cpu, &set))
+      {
+        continue;
+      }
+      int last = cpu;
+      while (last + 1 < CPU_SETSIZE &&
+             CPU_ISSET(last + 1, &set))
+      {
+        ++last;
+      }
+      result << (first ? "" : ",") << cpu;
+      if (last > cpu)
+      {
+        result << "-" << last;
+      }
+      first = false;
+      cpu = last;
+    }
+    result << ", ";
+  }
+  errno = 0;
+  auto nice = getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+  result << "nice " << (errno == 0 ? std::to_string(nice) : "unknown");
+#endif
+  return result.str();
+}
+
+bool ThreadSettings::applyToCurrentThread(std::string const& name) const
+{
+  bool result = true;
+  if (!cpus.empty() &&
+      !setAffinity(cpus))
+  {
+    FAF_LOG_WARN << "unable to pin the " << name << " thread to its CPUs";
+    result = false;
+  }
+  if (priority != ThreadPriority::Normal &&
+      !setPriority(priority))
+  {
+    FAF_LOG_WARN << "unable to set the priority of the " << name << " thread";
+    result = false;
+  }
+  FAF_LOG_INFO << name << " thread runs with " << describeCurrentThread();
+  return result;
+}
+
+/* non-negative decimal number without sign */
+static bool parseIndex(std::string const& text, int& index)
+{
+  if (text.empty() || text.size() > 4)
+  {
+    return false;
+  }
+  int result = 0;
+  for (auto c: text)
+  {
+    if (c < '0' || c > '9')
+    {
+      return false;
+    }
+    result = result * 10 + (c - '0');
+  }
+  index = result;
+  return true;
+}
+
+bool parseCpuList(std::string const& list, std::vector<int>& cpus)
+{
+  std::vector<int> result;
+  std::istringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ','))
+  {
+    if (item.empty())
+    {
+      continue;
+    }
+    auto dash = item.find('-');
+    int first, last;
+    if (!parseIndex(item.substr(0, dash), first))
+    {
+      return false;
+    }
+    last = first;
+    if (dash != std::string::npos &&
+        (!parseIndex(item.substr(dash + 1), last) || last < first))
+    {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; ++cpu)
+    {
+      result.push_back(cpu);
+    }
+  }
+  cpus = result;
+  return true;
+}
+
+bool parseThreadPriority(std::string const& name, ThreadPriority& priority)
+{
+  if (name == "low")
+  {
+    priority = ThreadPriority::Low;
+  }
+  else if (name == "normal")
+  {
+    priority = ThreadPriority::Normal;
+  }
+  else if (name == "high")
+  {
+    priority = ThreadPriority::High;
+  }
+  else if (name == "highest")
+  {
+    priority = ThreadPriority::Highest;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+} // namespace faf
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace faf {
+
+enum class ThreadPriority
+{
+  Low,
+  Normal,
+  High,   /*!< may need elevated rights, e.g. CAP_SYS_NICE on Linux */
+  Highest
+};
+
+/*! \brief CPU affinity and scheduling priority of a thread
+ */
+struct ThreadSettings
+{
+  std::vector<int> cpus;                       /*!< CPUs the thread may run on, empty: all */
+  ThreadPriority priority{ThreadPriority::Normal};
+
+  /** \brief Pin the calling thread to the CPUs and set its priority
+   *         Failures are logged as warnings, the thread keeps running with the defaults.
+   *         The effective CPUs and priority of the thread are logged.
+       \param name: thread name for the log
+       \returns false if a setting could not be applied
+      */
+  bool applyToCurrentThread(std::string const& name) const;
+};
+
+/** \brief Parse a comma separated list of CPU indices and ranges, e.g. "0,2-3"
+    \returns false if the list is malformed
+   */
+bool parseCpuList(std::string const& list, std::vector<int>& cpus);
+
+/** \brief Parse "low", "normal", "high" or "highest"
+    \returns false if the name is unknown
+   */
+bool parseThreadPriority(std::string const& name, ThreadPriority& priority);
+
+} // namespace faf
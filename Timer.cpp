@@ -59,14 +59,17 @@ void Timer::OnMessage(rtc::Message* msg)
 {
   if (_callback)
   {
-    _callback();
     if (_singleShot)
     {
-      /* reset _callback, to make started() return false after this callback */
+      /* reset _callback before calling it, to make started() return false
+       * and to allow the callback to restart the timer */
+      auto callback = std::move(_callback);
       _callback = std::function<void()>();
+      callback();
     }
     else
     {
+      _callback();
       rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, _interval, this);
     }
   }
@@ -1,66 +1,109 @@
 #include "logging.h"
 
+#include <memory>
+
 #include "webrtc/rtc_base/logging.h"
 #include "webrtc/rtc_base/logsinks.h"
 
+#include "AsyncLogSink.h"
+
 namespace faf
 {
 
-void logging_init(std::string const& verbosity)
+/* unregisters the sink before the static destruction joins its writer thread */
+struct LogDirectorySink
+{
+  ~LogDirectorySink()
+  {
+    if (sink)
+    {
+      rtc::LogMessage::RemoveLogToStream(sink.get());
+    }
+  }
+  std::unique_ptr<AsyncLogSink> sink;
+};
+static LogDirectorySink logDirectorySink;
+
+static bool verbosityToSeverity(std::string const& verbosity, rtc::LoggingSeverity& severity)
 {
-  rtc::LogMessage::LogTimestamps();
-  rtc::LogMessage::LogThreads();
-  rtc::LogMessage::SetLogToStderr(true);
   if (verbosity == "error")
   {
-    rtc::LogMessage::LogToDebug(rtc::LS_ERROR);
+    severity = rtc::LS_ERROR;
   }
   else if (verbosity == "warn")
   {
-    rtc::LogMessage::LogToDebug(rtc::LS_WARNING);
+    severity = rtc::LS_WARNING;
   }
   else if (verbosity == "info")
   {
-    rtc::LogMessage::LogToDebug(rtc::LS_INFO);
+    severity = rtc::LS_INFO;
   }
   else if (verbosity == "verbose")
   {
-    rtc::LogMessage::LogToDebug(rtc::LS_VERBOSE);
+    severity = rtc::LS_VERBOSE;
   }
   else if (verbosity == "debug")
   {
-    rtc::LogMessage::LogToDebug(rtc::LS_SENSITIVE);
+    severity = rtc::LS_SENSITIVE;
+  }
+  else
+  {
+    return false;
   }
+  return true;
 }
 
-void logging_init_log_dir(std::string const& verbosity,
-                          std::string const& log_directory)
+static void warnIfStripped(rtc::LoggingSeverity severity)
 {
-  static rtc::FileRotatingLogSink sink(log_directory,
-                                       "ice_adapter",
-                                       1024*1024,
-                                       2);
-  sink.Init();
-  if (verbosity == "error")
-  {
-    rtc::LogMessage::AddLogToStream(&sink, rtc::LS_ERROR);
-  }
-  else if (verbosity == "warn")
+#ifdef FAF_LOG_STRIP_DEBUG
+  if (severity < rtc::LS_INFO)
   {
-    rtc::LogMessage::AddLogToStream(&sink, rtc::LS_WARNING);
+    FAF_LOG_WARN << "this build was configured with FAF_LOG_STRIP_DEBUG, trace and debug messages are compiled out";
   }
-  else if (verbosity == "info")
+#else
+  (void) severity;
+#endif
+}
+
+void logging_init(std::string const& verbosity)
+{
+  rtc::LogMessage::LogTimestamps();
+  rtc::LogMessage::LogThreads();
+  rtc::LogMessage::SetLogToStderr(true);
+  rtc::LoggingSeverity severity;
+  if (verbosityToSeverity(verbosity, severity))
   {
-    rtc::LogMessage::AddLogToStream(&sink, rtc::LS_INFO);
+    rtc::LogMessage::LogToDebug(severity);
+    loggingMinSeverity.store(severity);
+    warnIfStripped(severity);
   }
-  else if (verbosity == "verbose")
+}
+
+void logging_init_log_dir(std::string const& verbosity,
+                          std::string const& log_directory)
+{
+  rtc::LoggingSeverity severity;
+  if (!verbosityToSeverity(verbosity, severity))
   {
-    rtc::LogMessage::AddLogToStream(&sink, rtc::LS_VERBOSE);
+    return;
   }
-  else if (verbosity == "debug")
+  auto fileSink = std::make_unique<rtc::FileRotatingLogSink>(log_directory,
+                                                             "ice_adapter",
+                                                             1024*1024,
+                                                             2);
+  fileSink->Init();
+  /* file I/O and rotation happen on the writer thread of the AsyncLogSink */
+  logDirectorySink.sink = std::make_unique<AsyncLogSink>(std::move(fileSink));
+  rtc::LogMessage::AddLogToStream(logDirectorySink.sink.get(), severity);
+  if (severity < loggingMinSeverity.load())
   {
-    rtc::LogMessage::AddLogToStream(&sink, rtc::LS_SENSITIVE);
+    loggingMinSeverity.store(severity);
   }
 }
 
+std::uint64_t logging_dropped_messages()
+{
+  return logDirectorySink.sink ? logDirectorySink.sink->droppedMessages() : 0;
+}
+
 }
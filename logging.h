@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 #include <webrtc/rtc_base/logging.h>
@@ -10,11 +12,38 @@ namespace faf
 void logging_init(std::string const& verbosity);
 void logging_init_log_dir(std::string const& verbosity,
                           std::string const& log_directory);
+/* log records which did not fit into the queue of the log directory writer thread */
+std::uint64_t logging_dropped_messages();
 
-#define FAF_LOG_TRACE RTC_LOG(LS_SENSITIVE) << "[trace] FAF: "
-#define FAF_LOG_DEBUG RTC_LOG(LS_VERBOSE)   << "[debug] FAF: "
-#define FAF_LOG_INFO  RTC_LOG(LS_INFO)      << "[info] FAF: "
-#define FAF_LOG_WARN  RTC_LOG(LS_WARNING)   << "[warn] FAF: "
-#define FAF_LOG_ERROR RTC_LOG(LS_ERROR)     << "[error] FAF: "
+/* lowest severity of all sinks, set by logging_init() and logging_init_log_dir() */
+inline std::atomic<int> loggingMinSeverity{rtc::LS_INFO};
+
+inline bool logging_enabled(rtc::LoggingSeverity severity)
+{
+  return severity >= loggingMinSeverity.load(std::memory_order_relaxed);
+}
+
+/* Nothing right of the macro, not even the prefix, is evaluated for disabled severities.
+ * `<<` binds tighter than `&`, which binds tighter than `?:`, so the whole stream expression
+ * ends up in the second branch. */
+#define FAF_LOG_AT(severity, prefix) \
+  !faf::logging_enabled(rtc::severity) ? (void) 0 : \
+    rtc::LogMessageVoidify() & rtc::LogMessage(__FILE__, __LINE__, rtc::severity).stream() << prefix
+
+/* still type checks the statement, but the optimizer removes it */
+#define FAF_LOG_COMPILED_OUT(severity, prefix) \
+  true ? (void) 0 : \
+    rtc::LogMessageVoidify() & rtc::LogMessage(__FILE__, __LINE__, rtc::severity).stream() << prefix
+
+#ifdef FAF_LOG_STRIP_DEBUG
+#define FAF_LOG_TRACE FAF_LOG_COMPILED_OUT(LS_SENSITIVE, "[trace] FAF: ")
+#define FAF_LOG_DEBUG FAF_LOG_COMPILED_OUT(LS_VERBOSE,   "[debug] FAF: ")
+#else
+#define FAF_LOG_TRACE FAF_LOG_AT(LS_SENSITIVE, "[trace] FAF: ")
+#define FAF_LOG_DEBUG FAF_LOG_AT(LS_VERBOSE,   "[debug] FAF: ")
+#endif
+#define FAF_LOG_INFO  FAF_LOG_AT(LS_INFO,      "[info] FAF: ")
+#define FAF_LOG_WARN  FAF_LOG_AT(LS_WARNING,   "[warn] FAF: ")
+#define FAF_LOG_ERROR FAF_LOG_AT(LS_ERROR,     "[error] FAF: ")
 
 }
@@ -1,8 +1,11 @@
 
 #include <webrtc/rtc_base/ssladapter.h>
 
+#include "EventLog.h"
 #include "IceAdapter.h"
 #include "IceAdapterOptions.h"
+#include "PeerConnectionFactory.h"
+#include "SessionHost.h"
 #include "logging.h"
 
 int main(int argc, char *argv[])
@@ -13,6 +16,11 @@ int main(int argc, char *argv[])
   if (!options.logDirectory.empty())
   {
     faf::logging_init_log_dir(options.logLevel, options.logDirectory);
+    if (options.eventLogSize > 0)
+    {
+      faf::eventLog().open(options.logDirectory + "/ice_adapter_events.bin",
+                           static_cast<std::size_t>(options.eventLogSize) * 1024 * 1024);
+    }
   }
 
   if (!rtc::InitializeSSL())
@@ -21,9 +29,23 @@ int main(int argc, char *argv[])
     std::exit(1);
   }
 
-  faf::IceAdapter iceAdapter(options);
+  /* the current thread runs the game sockets and the WebRTC signaling.
+   * Its settings are applied once the peer connection factories exist,
+   * new threads would inherit its CPU affinity and priority. */
+  auto gameThreadSettings = faf::threadSettings(options, "game");
 
-  rtc::Thread::Current()->Run();
+  if (options.sessions > 1)
+  {
+    faf::SessionHost sessionHost(options);
+    gameThreadSettings.applyToCurrentThread("game");
+    rtc::Thread::Current()->Run();
+  }
+  else
+  {
+    faf::IceAdapter iceAdapter(options);
+    gameThreadSettings.applyToCurrentThread("game");
+    rtc::Thread::Current()->Run();
+  }
 
   rtc::CleanupSSL();
 
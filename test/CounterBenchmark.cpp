@@ -0,0 +1,125 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+#include "PeerRelay.h"
+
+/* Overhead of the PeerRelay packet counters on the forwarding path.
+ * The forwarding work is simulated by copying the packet into a send buffer. */
+
+static const std::size_t packets = 20000000;
+static const std::size_t packetSize = 120;
+
+/* counters without alignment, sharing a cache line with data another thread writes */
+struct UnalignedCounters
+{
+  std::atomic<std::uint64_t> neighbour{0};
+  faf::Counter packets;
+  faf::Counter bytes;
+};
+
+struct AlignedCounters
+{
+  std::atomic<std::uint64_t> neighbour{0};
+  faf::PeerRelay::Metrics metrics;
+};
+
+static double benchmark(std::string const& name, std::function<void (std::uint8_t const* packet, std::uint8_t* buffer)> forward)
+{
+  std::vector<std::uint8_t> packet(packetSize, 0x42);
+  std::vector<std::uint8_t> buffer(65507);
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < packets; ++i)
+  {
+    packet[0] = static_cast<std::uint8_t>(i);
+    forward(packet.data(), buffer.data());
+  }
+  auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / packets;
+  std::cout << "  " << name << ": " << ns << " ns/packet" << std::endl;
+  return ns;
+}
+
+/* runs the benchmark while another thread reads or writes next to the counters */
+static double withThread(std::string const& name,
+                         std::function<void ()> threadStep,
+                         std::function<void (std::uint8_t const* packet, std::uint8_t* buffer)> forward)
+{
+  std::atomic<bool> stop{false};
+  std::thread thread([&]()
+  {
+    while (!stop.load(std::memory_order_relaxed))
+    {
+      threadStep();
+    }
+  });
+  auto result = benchmark(name, forward);
+  stop = true;
+  thread.join();
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  std::cout << packets << " packets of " << packetSize << " bytes" << std::endl;
+  std::uint64_t checksum = 0;
+  auto copy = [&checksum](std::uint8_t const* packet, std::uint8_t* buffer)
+  {
+    std::memcpy(buffer, packet, packetSize);
+    checksum += buffer[0];
+  };
+
+  AlignedCounters aligned;
+  auto& metrics = aligned.metrics;
+  auto counted = [&](std::uint8_t const* packet, std::uint8_t* buffer)
+  {
+    copy(packet, buffer);
+    metrics.gameToPeerPackets.add();
+    metrics.gameToPeerBytes.add(packetSize);
+    metrics.gameToPeerDirectUdpPackets.add();
+  };
+
+  auto baseline = benchmark("no counters", copy);
+  auto countedNs = benchmark("counters", counted);
+
+  std::atomic<std::uint64_t> scraped{0};
+  auto scrape = [&]()
+  {
+    scraped += metrics.gameToPeerPackets.value() + metrics.gameToPeerBytes.value() + metrics.gameToPeerDirectUdpPackets.value();
+  };
+  withThread("counters, scraped every ms", [&]()
+  {
+    scrape();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }, counted);
+  withThread("counters, scraped continuously", scrape, counted);
+
+  UnalignedCounters unaligned;
+  withThread("unaligned counters, neighbour written by another thread", [&]()
+  {
+    unaligned.neighbour.fetch_add(1, std::memory_order_relaxed);
+  }, [&](std::uint8_t const* packet, std::uint8_t* buffer)
+  {
+    copy(packet, buffer);
+    unaligned.packets.add();
+    unaligned.bytes.add(packetSize);
+  });
+  withThread("aligned counters, neighbour written by another thread", [&]()
+  {
+    aligned.neighbour.fetch_add(1, std::memory_order_relaxed);
+  }, [&](std::uint8_t const* packet, std::uint8_t* buffer)
+  {
+    copy(packet, buffer);
+    metrics.gameToPeerPackets.add();
+    metrics.gameToPeerBytes.add(packetSize);
+  });
+
+  std::cout << "counter overhead: " << countedNs - baseline << " ns/packet"
+            << " (checksum " << checksum % 256 << ", " << scraped % 256 << ")" << std::endl;
+  return 0;
+}
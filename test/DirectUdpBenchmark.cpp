@@ -0,0 +1,224 @@
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <webrtc/rtc_base/ssladapter.h>
+#include <webrtc/rtc_base/thread.h>
+#include <webrtc/media/engine/webrtcmediaengine.h>
+
+#include "PeerRelay.h"
+#include "logging.h"
+
+/* two relays in one process, each with a fake game socket, which bounce a datagram back and forth */
+class RelayPair : public sigslot::has_slots<>
+{
+public:
+  RelayPair(rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> const& pcfactory, bool directUdp)
+  {
+    _gameSocket1.reset(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+    _gameSocket1->Bind(rtc::SocketAddress("127.0.0.1", 0));
+    _gameSocket1->SignalReadEvent.connect(this, &RelayPair::_onGame1Read);
+    _gameSocket2.reset(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+    _gameSocket2->Bind(rtc::SocketAddress("127.0.0.1", 0));
+    _gameSocket2->SignalReadEvent.connect(this, &RelayPair::_onGame2Read);
+
+    faf::IcePolicy policy;
+    policy.directUdp = directUdp ? "lan" : "off";
+
+    faf::PeerRelay::Callbacks callbacks1;
+    callbacks1.iceMessageCallback = [this](Json::Value iceMsg)
+    {
+      _relay2->addIceMessage(iceMsg);
+    };
+    faf::PeerRelay::Options options1;
+    options1.remotePlayerId = 2;
+    options1.remotePlayerLogin = "Player2";
+    options1.isOfferer = true;
+    options1.gameUdpPort = _gameSocket1->GetLocalAddress().port();
+    options1.icePolicy = policy;
+
+    faf::PeerRelay::Callbacks callbacks2;
+    callbacks2.iceMessageCallback = [this](Json::Value iceMsg)
+    {
+      _relay1->addIceMessage(iceMsg);
+    };
+    faf::PeerRelay::Options options2;
+    options2.remotePlayerId = 1;
+    options2.remotePlayerLogin = "Player1";
+    options2.isOfferer = false;
+    options2.gameUdpPort = _gameSocket2->GetLocalAddress().port();
+    options2.icePolicy = policy;
+
+    /* the answerer must exist when the offerer emits its first ICE message */
+    _relay2 = std::make_unique<faf::PeerRelay>(options2, callbacks2, pcfactory);
+    _relay1 = std::make_unique<faf::PeerRelay>(options1, callbacks1, pcfactory);
+  }
+
+  bool ready(bool directUdp) const
+  {
+    if (!_relay1->isConnected() ||
+        !_relay2->isConnected())
+    {
+      return false;
+    }
+    return !directUdp ||
+           (_relay1->status()["ice"]["direct_udp"].asString() == "active" &&
+            _relay2->status()["ice"]["direct_udp"].asString() == "active");
+  }
+
+  /* waits for the next getStats() sample of the offerer, which sends the pings */
+  Json::Value nextStatsSample()
+  {
+    auto last = [this]()
+    {
+      auto samples = _relay1->statsSamples()["samples"];
+      return samples.empty() ? Json::Value() : samples[samples.size() - 1];
+    };
+    auto previous = last();
+    auto start = std::chrono::steady_clock::now();
+    while (last() == previous &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+    {
+      rtc::Thread::Current()->ProcessMessages(10);
+    }
+    return last();
+  }
+
+  void measure(std::string const& name, std::size_t roundTrips, std::size_t packetSize)
+  {
+    auto statsBefore = nextStatsSample();
+    _payload.assign(packetSize, 0x42);
+    _roundTripTimes.clear();
+    _roundTripTimes.reserve(roundTrips);
+    _remaining = roundTrips;
+
+    auto cpuStart = std::clock();
+    auto wallStart = std::chrono::steady_clock::now();
+    _sendPing();
+    while (_remaining > 0 &&
+           std::chrono::steady_clock::now() - wallStart < std::chrono::seconds(60))
+    {
+      rtc::Thread::Current()->ProcessMessages(10);
+    }
+    auto cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    auto statsAfter = nextStatsSample();
+
+    if (_roundTripTimes.empty())
+    {
+      std::cout << "  " << name << ": no round trip completed" << std::endl;
+      return;
+    }
+    std::sort(_roundTripTimes.begin(), _roundTripTimes.end());
+    double sum = 0;
+    for (auto rtt: _roundTripTimes)
+    {
+      sum += rtt;
+    }
+    std::cout << "  " << name << ": " << _roundTripTimes.size() << " round trips of " << packetSize << " bytes, "
+              << "mean " << sum / _roundTripTimes.size() << " us, "
+              << "p50 " << _roundTripTimes[_roundTripTimes.size() / 2] << " us, "
+              << "p99 " << _roundTripTimes[_roundTripTimes.size() * 99 / 100] << " us, "
+              << "CPU " << 1e6 * cpuSeconds / _roundTripTimes.size() << " us/round trip";
+    /* UDP payload bytes including DTLS/SCTP or direct UDP headers, the connectivity checks add a little */
+    auto bytesSent = [](Json::Value const& sample)
+    {
+      return sample["bytes_sent"].asUInt64() + sample["direct_udp_bytes_sent"].asUInt64();
+    };
+    if (statsBefore.isObject() &&
+        statsAfter.isObject() &&
+        bytesSent(statsAfter) >= bytesSent(statsBefore))
+    {
+      std::cout << ", " << static_cast<double>(bytesSent(statsAfter) - bytesSent(statsBefore)) / _roundTripTimes.size()
+                << " bytes on the wire/datagram";
+    }
+    std::cout << std::endl;
+  }
+
+protected:
+  void _sendPing()
+  {
+    _pingTime = std::chrono::steady_clock::now();
+    _gameSocket1->SendTo(_payload.data(), _payload.size(), rtc::SocketAddress("127.0.0.1", _relay1->localUdpSocketPort()));
+  }
+
+  void _onGame1Read(rtc::AsyncSocket* socket)
+  {
+    while (socket->Recv(_readBuffer.data(), _readBuffer.size(), nullptr) > 0)
+    {
+      if (_remaining == 0)
+      {
+        continue;
+      }
+      _roundTripTimes.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _pingTime).count());
+      if (--_remaining > 0)
+      {
+        _sendPing();
+      }
+    }
+  }
+
+  void _onGame2Read(rtc::AsyncSocket* socket)
+  {
+    int msgLength;
+    while ((msgLength = socket->Recv(_readBuffer.data(), _readBuffer.size(), nullptr)) > 0)
+    {
+      socket->SendTo(_readBuffer.data(), static_cast<std::size_t>(msgLength), rtc::SocketAddress("127.0.0.1", _relay2->localUdpSocketPort()));
+    }
+  }
+
+  std::unique_ptr<rtc::AsyncSocket> _gameSocket1;
+  std::unique_ptr<rtc::AsyncSocket> _gameSocket2;
+  std::unique_ptr<faf::PeerRelay> _relay1;
+  std::unique_ptr<faf::PeerRelay> _relay2;
+  std::vector<uint8_t> _payload;
+  std::vector<double> _roundTripTimes;
+  std::size_t _remaining{0};
+  std::chrono::steady_clock::time_point _pingTime;
+  std::array<uint8_t, 2048> _readBuffer;
+};
+
+int main(int argc, char *argv[])
+{
+  faf::logging_init("warn");
+  if (!rtc::InitializeSSL())
+  {
+    std::cerr << "Error in InitializeSSL()";
+    std::exit(1);
+  }
+  auto pcfactory = webrtc::CreateModularPeerConnectionFactory(nullptr,
+                                                              nullptr,
+                                                              nullptr,
+                                                              nullptr,
+                                                              nullptr,
+                                                              nullptr);
+
+  const std::size_t roundTrips = 10000;
+  std::cout << "game datagram round trips between two local relays" << std::endl;
+  for (bool directUdp: {false, true})
+  {
+    RelayPair pair(pcfactory, directUdp);
+    auto start = std::chrono::steady_clock::now();
+    while (!pair.ready(directUdp) &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(30))
+    {
+      rtc::Thread::Current()->ProcessMessages(10);
+    }
+    if (!pair.ready(directUdp))
+    {
+      std::cout << "  " << (directUdp ? "direct UDP" : "DataChannel") << ": relays did not connect, is a private network interface up?" << std::endl;
+      continue;
+    }
+    for (std::size_t size: {64, 512})
+    {
+      pair.measure(directUdp ? "direct UDP " : "DataChannel", roundTrips, size);
+    }
+  }
+
+  rtc::CleanupSSL();
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "EventLog.h"
+#include "EventLogReader.h"
+#include "logging.h"
+
+static void check(bool condition, std::string const& message)
+{
+  if (!condition)
+  {
+    std::cerr << "FAILED: " << message << std::endl;
+    std::exit(1);
+  }
+}
+
+static std::vector<Json::Value> readBack(std::string const& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+  std::vector<Json::Value> events;
+  std::string error;
+  check(faf::readEventLog(data, events, error), "decode failed: " + error);
+  return events;
+}
+
+int main(int argc, char *argv[])
+{
+  faf::logging_init("debug");
+
+  std::string path = "EventLogTest.bin";
+  faf::EventLog log;
+  check(!log.open(path, faf::EventLog::fileHeaderSize + faf::EventLog::blockSize), "reject a ring of one block");
+
+  log.write(faf::EventId::Reconnect, 1, 1u);
+  check(!log.isOpen(), "writing to a closed log is ignored");
+
+  check(log.open(path, faf::EventLog::fileHeaderSize + 4 * faf::EventLog::blockSize), "open");
+  log.write(faf::EventId::AdapterStarted, 0, 1234u, std::string("test"));
+  log.write(faf::EventId::CandidatePair, -5, "relay", "srflx", "10.0.0.1:6112", "1.2.3.4:51000");
+  log.write(faf::EventId::Connected, 5, true, 1500u);
+
+  auto events = readBack(path);
+  check(events.size() == 3, "three events while the log is open");
+  check(events[0]["event"] == "adapter_started" &&
+        events[0]["local_player_id"].asUInt() == 1234 &&
+        events[0]["version"] == "test", "adapter_started fields");
+  check(events[1]["relay"].asInt() == -5 &&
+        events[1]["remote_type"] == "srflx" &&
+        events[1]["remote_address"] == "1.2.3.4:51000", "candidate_pair fields");
+  check(events[2]["connected"].asUInt() == 1 &&
+        events[2]["time_to_connected_ms"].asUInt() == 1500, "connected fields");
+  check(events[1]["time_us"].asUInt64() >= events[0]["time_us"].asUInt64() &&
+        events[2]["time_us"].asUInt64() >= events[1]["time_us"].asUInt64(), "timestamps are monotonic");
+  std::cout << faf::eventToText(events[1]) << std::endl;
+
+  /* wrap the ring a few times, only the newest blocks survive */
+  const unsigned int count = 5000;
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    log.write(faf::EventId::Reconnect, static_cast<int>(i % 7), i);
+  }
+  log.close();
+
+  events = readBack(path);
+  std::cout << events.size() << " of " << count << " events retained, first "
+            << faf::eventToText(events.front()) << std::endl;
+  check(events.size() > 3 * faf::EventLog::blockSize / 8, "at least three blocks retained");
+  check(events.size() < count, "oldest blocks overwritten");
+  check(events.front()["event"] == "reconnect", "events before the wrap are gone");
+  for (std::size_t i = 0; i < events.size(); ++i)
+  {
+    auto expected = count - events.size() + i;
+    check(events[i]["reconnects"].asUInt() == expected, "event " + std::to_string(expected) + " in order");
+    check(events[i]["relay"].asUInt() == expected % 7, "relay tag of event " + std::to_string(expected));
+  }
+
+  std::remove(path.c_str());
+  std::cout << "OK" << std::endl;
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FlightRecorder.h"
+
+static void check(bool condition, std::string const& message)
+{
+  if (!condition)
+  {
+    std::cerr << "FAILED: " << message << std::endl;
+    std::exit(1);
+  }
+}
+
+static std::vector<std::string> packetLines(faf::FlightRecorder const& recorder)
+{
+  std::ostringstream out;
+  recorder.write(out, "test");
+  std::istringstream in(out.str());
+  std::vector<std::string> result;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (!line.empty() && line[0] != '#')
+    {
+      result.push_back(line);
+    }
+  }
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  using faf::FlightRecorder;
+
+  FlightRecorder recorder;
+  check(packetLines(recorder).empty(), "empty recorder");
+
+  recorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Ping, 15);
+  recorder.record(FlightRecorder::Direction::Received, FlightRecorder::Kind::Pong, 15);
+  recorder.record(FlightRecorder::Direction::Received, FlightRecorder::Kind::Data, 120);
+  auto lines = packetLines(recorder);
+  check(lines.size() == 3, "three packets");
+  check(lines[0].find(" sent ping 15") != std::string::npos, "first packet: " + lines[0]);
+  check(lines[2].find(" received data 120") != std::string::npos, "last packet: " + lines[2]);
+  check(lines[2][0] == '-', "times are relative to the dump: " + lines[2]);
+
+  /* overwrite the ring, the packet sizes count up */
+  const std::size_t count = FlightRecorder::capacity + 1000;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    recorder.record(FlightRecorder::Direction::Sent, FlightRecorder::Kind::Data, i);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << std::chrono::duration<double, std::nano>(elapsed).count() / count << " ns per recorded packet" << std::endl;
+
+  check(recorder.recorded() == count + 3, "recorded count");
+  lines = packetLines(recorder);
+  check(lines.size() == FlightRecorder::capacity, "ring keeps capacity packets");
+  for (std::size_t i = 0; i < lines.size(); ++i)
+  {
+    auto expected = " sent data " + std::to_string(count - FlightRecorder::capacity + i);
+    check(lines[i].size() >= expected.size() &&
+          lines[i].compare(lines[i].size() - expected.size(), expected.size(), expected) == 0,
+          "packet " + std::to_string(i) + " in order: " + lines[i]);
+  }
+
+  auto name = FlightRecorder::fileName(42);
+  check(name.find("flight_recorder_42_") == 0 &&
+        name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0, "file name " + name);
+
+  std::cout << "OK" << std::endl;
+  return 0;
+}
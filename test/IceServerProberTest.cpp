@@ -0,0 +1,161 @@
+
+#include <array>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+
+#include <webrtc/rtc_base/asyncsocket.h>
+#include <webrtc/rtc_base/thread.h>
+
+#include "IceServerProber.h"
+#include "Timer.h"
+#include "logging.h"
+
+/* answers STUN Binding requests on a local UDP port after a fixed delay, or never */
+class StunStandIn : public sigslot::has_slots<>
+{
+public:
+  StunStandIn(int delayMs, bool answer = true):
+    _delayMs(delayMs),
+    _answer(answer),
+    _socket(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_DGRAM))
+  {
+    _socket->Bind(rtc::SocketAddress("127.0.0.1", 0));
+    _socket->SignalReadEvent.connect(this, &StunStandIn::_onRead);
+    _flushTimer.start(1, [this]()
+    {
+      auto now = std::chrono::steady_clock::now();
+      while (!_responses.empty() &&
+             _responses.front().due <= now)
+      {
+        _socket->SendTo(_responses.front().data.data(), _responses.front().data.size(), _responses.front().to);
+        _responses.pop_front();
+      }
+    });
+  }
+
+  std::string url(std::string const& host = "127.0.0.1") const
+  {
+    return "stun:" + host + ":" + std::to_string(_socket->GetLocalAddress().port());
+  }
+
+  int requests{0};
+
+protected:
+  struct Response
+  {
+    std::chrono::steady_clock::time_point due;
+    rtc::SocketAddress to;
+    std::array<uint8_t, 20> data;
+  };
+
+  void _onRead(rtc::AsyncSocket* socket)
+  {
+    std::array<uint8_t, 512> buffer;
+    rtc::SocketAddress from;
+    int msgLength;
+    while ((msgLength = socket->RecvFrom(buffer.data(), buffer.size(), &from, nullptr)) > 0)
+    {
+      if (msgLength < 20 ||
+          buffer[0] != 0x00 ||
+          buffer[1] != 0x01)
+      {
+        continue;
+      }
+      ++requests;
+      if (!_answer)
+      {
+        continue;
+      }
+      Response response{std::chrono::steady_clock::now() + std::chrono::milliseconds(_delayMs), from, {}};
+      std::copy(buffer.begin(), buffer.begin() + 20, response.data.begin());
+      response.data[0] = 0x01;
+      _responses.push_back(response);
+    }
+  }
+
+  int _delayMs;
+  bool _answer;
+  std::unique_ptr<rtc::AsyncSocket> _socket;
+  std::deque<Response> _responses;
+  faf::Timer _flushTimer;
+};
+
+static void check(bool condition, std::string const& message)
+{
+  if (!condition)
+  {
+    std::cerr << "FAILED: " << message << std::endl;
+    std::exit(1);
+  }
+}
+
+static webrtc::PeerConnectionInterface::IceServer iceServer(std::string const& url)
+{
+  webrtc::PeerConnectionInterface::IceServer server;
+  server.urls.push_back(url);
+  return server;
+}
+
+int main(int argc, char *argv[])
+{
+  faf::logging_init("debug");
+
+  std::string host;
+  int port = 0;
+  check(faf::IceServerProber::parseUrl("stun:stun.example.com", host, port) &&
+        host == "stun.example.com" && port == 3478, "parse stun URL with default port");
+  check(faf::IceServerProber::parseUrl("turn:turn.example.com:443?transport=tcp", host, port) &&
+        host == "turn.example.com" && port == 443, "parse turn URL with query");
+  check(faf::IceServerProber::parseUrl("STUN:[::1]:1234", host, port) &&
+        host == "::1" && port == 1234, "parse IPv6 URL");
+  check(!faf::IceServerProber::parseUrl("turns:turn.example.com:5349", host, port), "reject TLS URL");
+  check(!faf::IceServerProber::parseUrl("stun:host:99999", host, port), "reject invalid port");
+
+  StunStandIn silent(0, false);
+  StunStandIn slow(60);
+  StunStandIn fast(0);
+  StunStandIn named(30);
+
+  webrtc::PeerConnectionInterface::IceServers servers;
+  servers.push_back(iceServer(silent.url()));
+  servers.push_back(iceServer(slow.url()));
+  servers.push_back(iceServer(fast.url()));
+  servers.push_back(iceServer("turns:turn.example.com:5349"));
+  /* probed once the hostname is resolved */
+  servers.push_back(iceServer(named.url("localhost")));
+
+  faf::IceServerProber prober(3, 20, 300);
+  std::vector<faf::IceServerProber::Result> ranking;
+  bool done = false;
+  prober.probe(servers, [&](std::vector<faf::IceServerProber::Result> const& results)
+  {
+    ranking = results;
+    done = true;
+  });
+  for (int i = 0; i < 500 && !done; ++i)
+  {
+    rtc::Thread::Current()->ProcessMessages(10);
+  }
+  check(done, "probing did not finish");
+  check(!prober.probing(), "prober still running");
+
+  for (auto const& result: ranking)
+  {
+    std::cout << result.serverIndex << " " << result.url << ": "
+              << (result.reachable ? std::to_string(result.roundTripTime.count()) + " us" : "unreachable") << std::endl;
+  }
+  check(ranking.size() == 5, "one result per server");
+  check(ranking[0].serverIndex == 2 && ranking[0].reachable, "fast server first");
+  check(ranking[1].serverIndex == 4 && ranking[1].reachable, "server with hostname second");
+  check(ranking[2].serverIndex == 1 && ranking[2].reachable, "slow server third");
+  check(ranking[2].roundTripTime >= std::chrono::milliseconds(60), "slow server round trip time");
+  check(ranking[3].serverIndex == 0 && !ranking[3].reachable, "silent server unreachable");
+  check(ranking[4].serverIndex == 3 && !ranking[4].reachable && ranking[4].url.empty(), "TLS only server not probed");
+  check(silent.requests == 3 && slow.requests == 3 && fast.requests == 3, "three probes per server");
+  check(named.requests == 3, "three probes to the server with hostname");
+
+  std::cout << "OK" << std::endl;
+  return 0;
+}
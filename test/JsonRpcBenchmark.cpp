@@ -0,0 +1,298 @@
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+#include "JsonRpcCodec.h"
+#include "JsonRpcFramer.h"
+
+static Json::Value createIceCandidateRequest(std::size_t index)
+{
+  Json::Value candidate;
+  candidate["candidate"] = "candidate:842163049 1 udp 1677729535 93.184.216.34 " + std::to_string(40000 + index % 20000) +
+                           " typ srflx raddr 192.168.1.12 rport 51234 generation 0 ufrag \"{x}\" network-cost 50";
+  candidate["sdpMid"] = "data";
+  candidate["sdpMLineIndex"] = 0;
+  Json::Value iceMsg;
+  iceMsg["type"] = "candidate";
+  iceMsg["candidate"] = candidate;
+  Json::Value params(Json::arrayValue);
+  params.append(2);
+  params.append(iceMsg);
+  Json::Value request;
+  request["jsonrpc"] = "2.0";
+  request["method"] = "iceMsg";
+  request["params"] = params;
+  request["id"] = static_cast<int>(index);
+  return request;
+}
+
+/* an SDP offer bloated with candidate lines, like the ones of multihomed hosts */
+static Json::Value createSdpRequest(std::size_t index)
+{
+  std::string sdp = "v=0\r\no=- 4611731400430051336 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n"
+                    "a=group:BUNDLE data\r\na=msid-semantic: WMS\r\n"
+                    "m=application 9 DTLS/SCTP 5000\r\nc=IN IP4 0.0.0.0\r\n"
+                    "a=ice-ufrag:Jx5q\r\na=ice-pwd:6EKTeGXAYaYzLbWbQ0Bs+Qm0\r\na=ice-options:trickle\r\n"
+                    "a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+                    "a=setup:actpass\r\na=mid:data\r\na=sctpmap:5000 webrtc-datachannel 1024\r\n";
+  for (int i = 0; i < 64; ++i)
+  {
+    sdp += "a=candidate:" + std::to_string(1000000 + i) + " 1 udp 2122260223 10.0." + std::to_string(i) + ".12 " +
+           std::to_string(50000 + i) + " typ host generation 0 network-id " + std::to_string(i) + "\r\n";
+  }
+  Json::Value iceMsg;
+  iceMsg["type"] = "offer";
+  iceMsg["sdp"] = sdp;
+  Json::Value params(Json::arrayValue);
+  params.append(2);
+  params.append(iceMsg);
+  Json::Value request;
+  request["jsonrpc"] = "2.0";
+  request["method"] = "iceMsg";
+  request["params"] = params;
+  request["id"] = static_cast<int>(index);
+  return request;
+}
+
+/* builds a pipelined stream of requests of at least totalSize bytes */
+static std::string createStream(std::function<Json::Value (std::size_t)> createRequest,
+                                faf::JsonRpcFraming framing,
+                                std::size_t totalSize,
+                                std::size_t& numMessages)
+{
+  std::string result;
+  numMessages = 0;
+  while (result.size() < totalSize)
+  {
+    auto frameStart = faf::JsonRpcFramer::beginFrame(result, framing);
+    result += Json::FastWriter().write(createRequest(numMessages));
+    if (result.back() == '\n')
+    {
+      result.pop_back();
+    }
+    faf::JsonRpcFramer::endFrame(result, frameStart, framing);
+    ++numMessages;
+  }
+  return result;
+}
+
+static void benchmarkFramer(std::string const& stream,
+                            faf::JsonRpcFraming framing,
+                            std::size_t numMessages,
+                            std::size_t chunkSize)
+{
+  faf::JsonRpcFramer framer(framing);
+  Json::Value msg;
+  std::size_t parsedMessages = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t pos = 0; pos < stream.size(); pos += chunkSize)
+  {
+    framer.append(stream.data() + pos, std::min(chunkSize, stream.size() - pos));
+    while (framer.next(msg))
+    {
+      ++parsedMessages;
+    }
+  }
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  double megabytes = stream.size() / (1024. * 1024.);
+  std::cout << "  " << megabytes << " MB in chunks of " << chunkSize << " bytes: "
+            << parsedMessages << "/" << numMessages << " messages in "
+            << duration / 1000. << " ms, "
+            << megabytes / (duration / 1e6) << " MB/s" << std::endl;
+  if (parsedMessages != numMessages)
+  {
+    std::cerr << "ERROR: message count mismatch" << std::endl;
+    std::exit(1);
+  }
+}
+
+static Json::Value createNotification(std::string const& method, Json::Value const& params)
+{
+  Json::Value notification;
+  notification["jsonrpc"] = "2.0";
+  notification["method"] = method;
+  notification["params"] = params;
+  return notification;
+}
+
+/* the RPC traffic of an adapter during the setup of a 12 player lobby */
+static std::vector<std::string> createLobbySetupTrace()
+{
+  std::vector<std::string> trace;
+  auto add = [&trace](Json::Value const& message)
+  {
+    trace.push_back(Json::FastWriter().write(message));
+  };
+  for (int peer = 2; peer <= 12; ++peer)
+  {
+    Json::Value connectParams(Json::arrayValue);
+    connectParams.append("Player" + std::to_string(peer));
+    connectParams.append(peer);
+    connectParams.append(true);
+    Json::Value connect = createNotification("connectToPeer", connectParams);
+    connect["id"] = peer;
+    add(connect);
+
+    add(createSdpRequest(static_cast<std::size_t>(peer)));
+    for (std::size_t candidate = 0; candidate < 8; ++candidate)
+    {
+      add(createIceCandidateRequest(candidate));
+    }
+
+    for (auto state : {"checking", "connected", "completed"})
+    {
+      Json::Value stateParams(Json::arrayValue);
+      stateParams.append(1);
+      stateParams.append(peer);
+      stateParams.append(state);
+      add(createNotification("onIceConnectionStateChanged", stateParams));
+    }
+
+    Json::Value gpgnetParams(Json::arrayValue);
+    gpgnetParams.append("GameOption");
+    Json::Value chunks(Json::arrayValue);
+    chunks.append("Slots");
+    chunks.append(peer);
+    chunks.append(3.5);
+    chunks.append("Unit\u00e9 \"restricted\"\n");
+    gpgnetParams.append(chunks);
+    add(createNotification("onGpgNetMessageReceived", gpgnetParams));
+  }
+  return trace;
+}
+
+/* a recorded trace file contains one JSON-RPC message per line */
+static std::vector<std::string> loadTrace(std::string const& filename)
+{
+  std::vector<std::string> trace;
+  std::ifstream file(filename);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (!line.empty())
+    {
+      trace.push_back(line);
+    }
+  }
+  return trace;
+}
+
+static void benchmarkCodec(std::string const& name,
+                           faf::JsonRpcCodec& codec,
+                           std::vector<std::string> const& trace,
+                           int iterations)
+{
+  std::vector<Json::Value> parsed(trace.size());
+  std::string error;
+  auto parseStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+  {
+    for (std::size_t m = 0; m < trace.size(); ++m)
+    {
+      if (!codec.parse(trace[m].data(), trace[m].data() + trace[m].size(), parsed[m], error))
+      {
+        std::cerr << "ERROR: " << name << " failed to parse message " << m << ": " << error << std::endl;
+        std::exit(1);
+      }
+    }
+  }
+  auto parseDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - parseStart).count();
+
+  std::string out;
+  std::size_t writtenBytes = 0;
+  auto writeStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+  {
+    for (auto const& message : parsed)
+    {
+      out.clear();
+      codec.write(message, out);
+      writtenBytes += out.size();
+    }
+  }
+  auto writeDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - writeStart).count();
+
+  double messages = static_cast<double>(trace.size()) * iterations;
+  std::cout << "  " << name << ": parse " << parseDuration * 1000. / messages << " ns/msg, "
+            << "write " << writeDuration * 1000. / messages << " ns/msg "
+            << "(" << writtenBytes / iterations << " bytes per iteration)" << std::endl;
+}
+
+static void verifyCodecsAgree(std::vector<std::string> const& trace)
+{
+  faf::JsoncppCodec reference;
+  faf::FastJsonCodec fast;
+  std::string error;
+  for (std::size_t m = 0; m < trace.size(); ++m)
+  {
+    Json::Value referenceValue;
+    Json::Value fastValue;
+    Json::Value roundTripValue;
+    std::string written;
+    reference.parse(trace[m].data(), trace[m].data() + trace[m].size(), referenceValue, error);
+    fast.parse(trace[m].data(), trace[m].data() + trace[m].size(), fastValue, error);
+    fast.write(fastValue, written);
+    reference.parse(written.data(), written.data() + written.size(), roundTripValue, error);
+    if (!(referenceValue == fastValue) ||
+        !(referenceValue == roundTripValue))
+    {
+      std::cerr << "ERROR: codecs disagree on message " << m << ": " << trace[m] << std::endl;
+      std::exit(1);
+    }
+  }
+}
+
+static void benchmarkCodecs(std::vector<std::string> const& trace)
+{
+  verifyCodecsAgree(trace);
+  faf::JsoncppCodec jsoncpp;
+  faf::FastJsonCodec fast;
+  benchmarkCodec("JsoncppCodec", jsoncpp, trace, 200);
+  benchmarkCodec("FastJsonCodec", fast, trace, 200);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1)
+  {
+    auto trace = loadTrace(argv[1]);
+    std::cout << "JsonRpcCodec: recorded trace " << argv[1] << " (" << trace.size() << " messages)" << std::endl;
+    benchmarkCodecs(trace);
+    return 0;
+  }
+  {
+    auto trace = createLobbySetupTrace();
+    std::cout << "JsonRpcCodec: 12 player lobby setup trace (" << trace.size() << " messages)" << std::endl;
+    benchmarkCodecs(trace);
+  }
+
+  const std::vector<std::pair<std::string, faf::JsonRpcFraming>> framings = {
+    {"brace", faf::JsonRpcFraming::BraceCounting},
+    {"ndjson", faf::JsonRpcFraming::NewlineDelimited},
+    {"length", faf::JsonRpcFraming::LengthPrefixed}
+  };
+  for (auto const& framing : framings)
+  {
+    std::cout << "JsonRpcFramer (" << framing.first << "): pipelined iceMsg candidate requests" << std::endl;
+    for (std::size_t megabytes : {1, 4, 16})
+    {
+      std::size_t numMessages;
+      auto stream = createStream(createIceCandidateRequest, framing.second, megabytes * 1024 * 1024, numMessages);
+      /* 2048 bytes matches the JsonRpc read buffer, the full stream simulates a single burst */
+      benchmarkFramer(stream, framing.second, numMessages, 2048);
+      benchmarkFramer(stream, framing.second, numMessages, stream.size());
+    }
+    std::cout << "JsonRpcFramer (" << framing.first << "): pipelined iceMsg SDP requests" << std::endl;
+    std::size_t numMessages;
+    auto stream = createStream(createSdpRequest, framing.second, 16 * 1024 * 1024, numMessages);
+    benchmarkFramer(stream, framing.second, numMessages, 2048);
+    benchmarkFramer(stream, framing.second, numMessages, stream.size());
+  }
+  return 0;
+}
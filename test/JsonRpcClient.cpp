@@ -91,6 +91,7 @@ void JsonRpcClient::_onRead(rtc::AsyncSocket* socket)
 
 void JsonRpcClient::_onDisconnected(rtc::AsyncSocket* socket, int)
 {
+  _onSocketClosed(socket);
   SignalDisconnected.emit(_socket.get());
 }
 
@@ -0,0 +1,179 @@
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include <webrtc/rtc_base/thread.h>
+
+#include "JsonRpc.h"
+#include "logging.h"
+
+/* a peer which swallows everything and never answers */
+class BlackholeJsonRpc : public faf::JsonRpc
+{
+public:
+  void closeSocket(rtc::AsyncSocket* socket)
+  {
+    _onSocketClosed(socket);
+  }
+
+  std::size_t sentBytes{0};
+
+protected:
+  virtual bool _sendMessage(std::string const& message, rtc::AsyncSocket* socket) override
+  {
+    sentBytes += message.size();
+    return true;
+  }
+};
+
+static std::size_t residentSetSize()
+{
+#if defined(WEBRTC_LINUX)
+  std::ifstream statm("/proc/self/statm");
+  std::size_t size = 0;
+  std::size_t resident = 0;
+  statm >> size >> resident;
+  return resident * 4096;
+#else
+  return 0;
+#endif
+}
+
+static void check(bool condition, std::string const& message)
+{
+  if (!condition)
+  {
+    std::cerr << "FAILED: " << message << std::endl;
+    std::exit(1);
+  }
+}
+
+static void processUntilIdle(BlackholeJsonRpc& rpc)
+{
+  while (rpc.pendingRequests() > 0)
+  {
+    rtc::Thread::Current()->ProcessMessages(5);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const std::size_t maxPending = 2000;
+  BlackholeJsonRpc rpc;
+  rpc.setRequestTimeout(2);
+  rpc.setMaxPendingRequests(maxPending);
+
+  std::size_t requests = 0;
+  std::size_t timeouts = 0;
+  std::size_t rejected = 0;
+  std::size_t closed = 0;
+  std::size_t otherResults = 0;
+  auto resultCb = [&](Json::Value const& result, Json::Value const& error)
+  {
+    if (error == "request timed out")
+    {
+      ++timeouts;
+    }
+    else if (error == "too many pending requests")
+    {
+      ++rejected;
+    }
+    else if (error == "connection closed")
+    {
+      ++closed;
+    }
+    else
+    {
+      ++otherResults;
+    }
+  };
+
+  Json::Value params(Json::arrayValue);
+  params.append(1);
+  params.append("onIceMsg payload which is never acknowledged by the peer");
+
+  /* the cap rejects requests once it is reached */
+  for (std::size_t i = 0; i < maxPending + 100; ++i, ++requests)
+  {
+    rpc.sendRequest("ping", params, nullptr, resultCb);
+  }
+  check(rpc.pendingRequests() == maxPending, "pending requests exceed the cap");
+  check(rejected == 100, "requests over the cap were not rejected");
+  processUntilIdle(rpc);
+  check(timeouts == maxPending, "pending requests did not time out");
+
+  /* pending requests of a closed connection fail */
+  char dummySocket;
+  auto socket = reinterpret_cast<rtc::AsyncSocket*>(&dummySocket);
+  for (int i = 0; i < 10; ++i, ++requests)
+  {
+    rpc.sendRequest("ping", params, socket, resultCb);
+  }
+  rpc.closeSocket(socket);
+  processUntilIdle(rpc);
+  check(closed == 10, "requests of closed socket did not fail");
+
+  /* rounds of unanswered requests beyond the cap, every one must be rejected or time out */
+  const std::size_t rounds = 100;
+  const std::size_t requestsPerRound = maxPending + 500;
+  std::size_t baselineRss = 0;
+  for (std::size_t round = 0; round < rounds; ++round)
+  {
+    auto rejectedBefore = rejected;
+    for (std::size_t i = 0; i < requestsPerRound; ++i, ++requests)
+    {
+      rpc.sendRequest("ping", params, nullptr, resultCb);
+    }
+    check(rpc.pendingRequests() == maxPending, "pending requests exceed the cap");
+    check(rejected - rejectedBefore == requestsPerRound - maxPending, "requests over the cap were not rejected");
+    processUntilIdle(rpc);
+    if (round == 10)
+    {
+      baselineRss = residentSetSize();
+    }
+  }
+  std::size_t finalRss = residentSetSize();
+
+  std::cout << "sent " << requests << " requests (" << rpc.sentBytes / (1024 * 1024) << " MB)" << std::endl;
+  std::cout << "timeouts: " << timeouts << ", rejected: " << rejected << ", closed: " << closed << std::endl;
+  std::cout << "RSS after warmup: " << baselineRss / 1024 << " kB, at the end: " << finalRss / 1024 << " kB" << std::endl;
+
+  check(otherResults == 0, "unexpected request results");
+  check(timeouts + rejected + closed == requests, "not every request callback was called exactly once");
+  check(rpc.pendingRequests() == 0, "pending requests leaked");
+  /* allow some allocator noise, a leak of one callback per request would be far above */
+  check(finalRss <= baselineRss + 2 * 1024 * 1024, "memory grew during the soak test");
+
+  /* the defaults bound what an unresponsive client can pin: 1024 requests for 30 seconds */
+  BlackholeJsonRpc defaultRpc;
+  std::size_t defaultTimeouts = 0;
+  std::size_t defaultRejected = 0;
+  auto defaultResultCb = [&](Json::Value const& result, Json::Value const& error)
+  {
+    if (error == "request timed out")
+    {
+      ++defaultTimeouts;
+    }
+    else if (error == "too many pending requests")
+    {
+      ++defaultRejected;
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < 1100; ++i)
+  {
+    defaultRpc.sendRequest("ping", params, nullptr, defaultResultCb);
+  }
+  check(defaultRpc.pendingRequests() == 1024, "default cap is not 1024 pending requests");
+  check(defaultRejected == 1100 - 1024, "requests over the default cap were not rejected");
+  processUntilIdle(defaultRpc);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "default timeout after " << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms" << std::endl;
+  check(defaultTimeouts == 1024, "pending requests did not time out with the default timeout");
+  check(elapsed >= std::chrono::seconds(30) && elapsed < std::chrono::seconds(35), "default timeout is not 30 seconds");
+
+  std::cout << "OK" << std::endl;
+  return 0;
+}
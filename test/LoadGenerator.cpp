@@ -0,0 +1,745 @@
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(WEBRTC_LINUX)
+#include <unistd.h>
+#endif
+
+#include <webrtc/rtc_base/ssladapter.h>
+#include <webrtc/rtc_base/thread.h>
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+#include "cxxopts.hpp"
+#include "GPGNetMessage.h"
+#include "IceAdapter.h"
+#include "IceAdapterOptions.h"
+#include "PeerConnectionFactory.h"
+#include "SessionHost.h"
+#include "Timer.h"
+#include "logging.h"
+#include "test/GPGNetClient.h"
+#include "test/JsonRpcClient.h"
+#include "test/Pingtracker.h"
+#include "test/Process.h"
+
+/* Headless performance regression benchmark: N ice-adapters, in this process or as
+ * subprocesses, connected in a full mesh. The load generator plays the client for all of them,
+ * relaying the ICE messages in memory, and the game, sending PingPackets through every relay.
+ * Reports round trip percentiles and loss per directed pair, CPU time and resident memory. */
+
+struct LoadOptions
+{
+  int adapters{12};
+  bool subprocess{false};
+  std::string executable{"./faf-ice-adapter"};
+  std::string adapterArgs;
+  std::string iceServer;
+  int duration{30};
+  int pingInterval{20};
+  int connectTimeout{60};
+  std::string logLevel{"error"};
+  std::string report;
+};
+
+/* round trips of one direction, pings sent by the lobby socket of `from` to the relay to `to` */
+struct PairStats
+{
+  std::uint64_t sent{0};
+  std::uint64_t received{0};
+  std::map<std::uint32_t, std::chrono::steady_clock::time_point> pending;
+  std::vector<double> roundTripTimes; /* ms */
+};
+
+/* CPU seconds and resident memory of a process, Linux only */
+struct ProcessUsage
+{
+  double cpuSeconds{0};
+  std::size_t residentMemory{0};
+  bool valid{false};
+};
+
+static ProcessUsage processUsage(int pid)
+{
+  ProcessUsage result;
+#if defined(WEBRTC_LINUX)
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string line;
+  if (!std::getline(stat, line))
+  {
+    return result;
+  }
+  /* the fields following the command name in parentheses, utime and stime are the 14th and 15th field */
+  std::istringstream fields(line.substr(line.rfind(')') + 2));
+  std::vector<std::string> values;
+  std::string value;
+  while (fields >> value)
+  {
+    values.push_back(value);
+  }
+  std::ifstream statm("/proc/" + std::to_string(pid) + "/statm");
+  std::size_t totalPages = 0;
+  std::size_t residentPages = 0;
+  if (values.size() < 13 || !(statm >> totalPages >> residentPages))
+  {
+    return result;
+  }
+  auto ticks = static_cast<double>(sysconf(_SC_CLK_TCK));
+  result.cpuSeconds = (std::stod(values[11]) + std::stod(values[12])) / ticks;
+  result.residentMemory = residentPages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  result.valid = true;
+#endif
+  return result;
+}
+
+static int unusedTcpPort()
+{
+  std::unique_ptr<rtc::AsyncSocket> socket(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_STREAM));
+  if (socket->Bind(rtc::SocketAddress("127.0.0.1", 0)) != 0)
+  {
+    FAF_LOG_ERROR << "unable to bind tcp server";
+    std::exit(1);
+  }
+  return socket->GetLocalAddress().port();
+}
+
+static std::vector<std::string> splitArgs(std::string const& args)
+{
+  std::vector<std::string> result;
+  std::istringstream stream(args);
+  std::string arg;
+  while (stream >> arg)
+  {
+    result.push_back(arg);
+  }
+  return result;
+}
+
+class LoadGenerator;
+
+/* one simulated player: the adapter, its client connection and its game */
+class Player : public sigslot::has_slots<>
+{
+public:
+  Player(LoadGenerator& generator, int id);
+  ~Player();
+
+  void start(std::shared_ptr<faf::PeerConnectionFactory> const& pcfactory);
+  void sendPings();
+  void quit();
+
+  int id;
+  std::string login;
+  int rpcPort;
+  int gpgnetPort;
+  int pid{0};                       /*!< of the subprocess, 0 if unknown */
+  faf::JsonRpcClient rpc;
+  faf::GPGNetClient gpgnet;
+  std::unique_ptr<faf::IceAdapter> adapter;
+  std::unique_ptr<faf::Process> process;
+  std::unique_ptr<rtc::AsyncSocket> lobbySocket;
+  std::map<int, rtc::SocketAddress> relayAddresses; /*!< by remote player, from JoinGame/ConnectToPeer */
+  std::map<int, bool> connected;                    /*!< by remote player, from onConnected */
+
+protected:
+  void _connectClients();
+  void _onRpcConnected(rtc::AsyncSocket* socket);
+  void _onRpcDisconnected(rtc::AsyncSocket* socket);
+  void _onGpgNetConnected(rtc::AsyncSocket* socket);
+  void _onGpgNetMessage(faf::GPGNetMessage const& message);
+  void _onLobbyRead(rtc::AsyncSocket* socket);
+
+  LoadGenerator& _generator;
+  faf::Timer _retryTimer;
+  std::uint32_t _pingId{0};
+  std::array<char, 2048> _readBuffer;
+};
+
+class LoadGenerator
+{
+public:
+  LoadGenerator(LoadOptions const& options):
+    _options(options)
+  {
+  }
+
+  int run()
+  {
+    std::shared_ptr<faf::PeerConnectionFactory> pcfactory;
+    if (!_options.subprocess)
+    {
+      pcfactory = std::make_shared<faf::PeerConnectionFactory>(adapterOptions(0));
+    }
+    for (int i = 0; i < _options.adapters; ++i)
+    {
+      players.push_back(std::make_unique<Player>(*this, i));
+    }
+    for (auto& player: players)
+    {
+      player->start(pcfactory);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!_waitFor([this]() { return _rpcConnectedCount == players.size(); }, start) ||
+        !_connectMesh(start))
+    {
+      std::cerr << "the mesh did not connect within " << _options.connectTimeout << " s: "
+                << _connectedPairs() << " of " << players.size() * (players.size() - 1) << " relays connected" << std::endl;
+      _shutdown();
+      return 1;
+    }
+    auto connectTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << players.size() << " adapters (" << (_options.subprocess ? "subprocesses" : "in process") << ") connected in a full mesh in "
+              << connectTime << " s" << std::endl;
+
+    auto usageBefore = _usage();
+    auto measureStart = std::chrono::steady_clock::now();
+    faf::Timer pingTimer;
+    pingTimer.start(_options.pingInterval, [this]()
+    {
+      for (auto& player: players)
+      {
+        player->sendPings();
+      }
+    });
+    _process(std::chrono::seconds(_options.duration));
+    pingTimer.stop();
+    /* answers still in flight */
+    _process(std::chrono::seconds(2));
+    auto wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - measureStart).count();
+    auto usageAfter = _usage();
+
+    _report(connectTime, wallSeconds, usageBefore, usageAfter);
+    _shutdown();
+    return 0;
+  }
+
+  faf::IceAdapterOptions adapterOptions(int id) const
+  {
+    std::vector<std::string> args = {"faf-ice-adapter",
+                                     "--id", std::to_string(id),
+                                     "--login", "Player" + std::to_string(id),
+                                     "--log-level", _options.logLevel};
+    auto extraArgs = splitArgs(_options.adapterArgs);
+    args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+    std::vector<char*> argv;
+    for (auto& arg: args)
+    {
+      argv.push_back(&arg[0]);
+    }
+    return faf::IceAdapterOptions::init(static_cast<int>(argv.size()), argv.data());
+  }
+
+  /* the in-memory signaling relay */
+  void relayIceMessage(int from, int to, Json::Value const& message)
+  {
+    if (to < 0 || to >= static_cast<int>(players.size()))
+    {
+      return;
+    }
+    Json::Value params(Json::arrayValue);
+    params.append(from);
+    params.append(message);
+    players[to]->rpc.sendRequest("iceMsg", params);
+  }
+
+  void onPing(int from, int to, std::uint32_t pingId)
+  {
+    auto& stats = pairStats[{from, to}];
+    ++stats.sent;
+    stats.pending[pingId] = std::chrono::steady_clock::now();
+  }
+
+  void onPong(int from, int to, std::uint32_t pingId)
+  {
+    auto& stats = pairStats[{from, to}];
+    auto pingIt = stats.pending.find(pingId);
+    if (pingIt == stats.pending.end())
+    {
+      return;
+    }
+    ++stats.received;
+    stats.roundTripTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pingIt->second).count());
+    stats.pending.erase(pingIt);
+  }
+
+  void onRpcConnected()
+  {
+    ++_rpcConnectedCount;
+  }
+
+  LoadOptions const& options() const
+  {
+    return _options;
+  }
+
+  std::vector<std::unique_ptr<Player>> players;
+  std::map<std::pair<int, int>, PairStats> pairStats;
+
+protected:
+  struct Usage
+  {
+    double cpuSeconds{0};
+    std::size_t residentMemory{0};
+    bool valid{true};
+  };
+
+  bool _waitFor(std::function<bool()> condition, std::chrono::steady_clock::time_point start)
+  {
+    while (!condition())
+    {
+      if (std::chrono::steady_clock::now() - start > std::chrono::seconds(_options.connectTimeout))
+      {
+        return false;
+      }
+      rtc::Thread::Current()->ProcessMessages(10);
+    }
+    return true;
+  }
+
+  void _process(std::chrono::steady_clock::duration duration)
+  {
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+      rtc::Thread::Current()->ProcessMessages(10);
+    }
+  }
+
+  /* Relays can only accept ICE messages once they exist, so all answering relays are created
+   * before the offering ones. For each pair the lower ID offers, the host is player 0. */
+  bool _connectMesh(std::chrono::steady_clock::time_point start)
+  {
+    if (!_options.iceServer.empty())
+    {
+      Json::Value iceServer;
+      iceServer["urls"].append(_options.iceServer);
+      Json::Value params(Json::arrayValue);
+      params.append(Json::Value(Json::arrayValue));
+      params[0].append(iceServer);
+      for (auto& player: players)
+      {
+        player->rpc.sendRequest("setIceServers", params);
+      }
+    }
+
+    auto onResult = [this](Json::Value const&, Json::Value const& error)
+    {
+      if (!error.isNull())
+      {
+        std::cerr << "request failed: " << error << std::endl;
+      }
+      --_pendingRequests;
+    };
+    auto connectToPeer = [&](Player& player, Player const& remote, bool createOffer)
+    {
+      Json::Value params(Json::arrayValue);
+      params.append(remote.login);
+      params.append(remote.id);
+      if (player.id != 0 && remote.id == 0)
+      {
+        player.rpc.sendRequest("joinGame", params, nullptr, onResult);
+      }
+      else
+      {
+        params.append(createOffer);
+        player.rpc.sendRequest("connectToPeer", params, nullptr, onResult);
+      }
+      ++_pendingRequests;
+    };
+
+    Json::Value hostParams(Json::arrayValue);
+    hostParams.append("loadtest");
+    players.front()->rpc.sendRequest("hostGame", hostParams);
+    for (bool offerers: {false, true})
+    {
+      for (auto& player: players)
+      {
+        for (auto const& remote: players)
+        {
+          if (player->id != remote->id &&
+              (player->id < remote->id) == offerers)
+          {
+            connectToPeer(*player, *remote, offerers);
+          }
+        }
+      }
+      if (!_waitFor([this]() { return _pendingRequests == 0; }, start))
+      {
+        return false;
+      }
+    }
+
+    return _waitFor([this]() { return _connectedPairs() == players.size() * (players.size() - 1); }, start);
+  }
+
+  std::size_t _connectedPairs() const
+  {
+    std::size_t result = 0;
+    for (auto const& player: players)
+    {
+      for (auto const& remote: player->connected)
+      {
+        if (remote.second &&
+            player->relayAddresses.count(remote.first) > 0)
+        {
+          ++result;
+        }
+      }
+    }
+    return result;
+  }
+
+  Usage _usage() const
+  {
+    Usage result;
+    if (!_options.subprocess)
+    {
+      result.cpuSeconds = static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+      result.residentMemory = faf::SessionHost::residentMemory();
+      return result;
+    }
+    for (auto const& player: players)
+    {
+      auto usage = processUsage(player->pid);
+      result.valid = result.valid && player->pid > 0 && usage.valid;
+      result.cpuSeconds += usage.cpuSeconds;
+      result.residentMemory += usage.residentMemory;
+    }
+    return result;
+  }
+
+  static double percentile(std::vector<double> const& sorted, double p)
+  {
+    if (sorted.empty())
+    {
+      return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()))];
+  }
+
+  void _report(double connectTime, double wallSeconds, Usage const& before, Usage const& after)
+  {
+    Json::Value report;
+    report["adapters"] = static_cast<Json::UInt>(players.size());
+    report["subprocess"] = _options.subprocess;
+    report["adapter_args"] = _options.adapterArgs;
+    report["duration"] = wallSeconds;
+    report["connect_time"] = connectTime;
+
+    std::vector<double> all;
+    std::uint64_t sent = 0;
+    std::uint64_t received = 0;
+    std::cout << "round trip times in ms per directed pair:" << std::endl;
+    for (auto& pair: pairStats)
+    {
+      auto& stats = pair.second;
+      std::sort(stats.roundTripTimes.begin(), stats.roundTripTimes.end());
+      auto loss = stats.sent > 0 ? 100.0 * (stats.sent - stats.received) / stats.sent : 0.0;
+      std::cout << "  " << pair.first.first << " -> " << pair.first.second << ": "
+                << stats.received << "/" << stats.sent << " answered, loss " << loss << " %, "
+                << "p50 " << percentile(stats.roundTripTimes, 0.5) << ", "
+                << "p95 " << percentile(stats.roundTripTimes, 0.95) << ", "
+                << "p99 " << percentile(stats.roundTripTimes, 0.99) << ", "
+                << "max " << (stats.roundTripTimes.empty() ? 0 : stats.roundTripTimes.back()) << std::endl;
+      Json::Value pairReport;
+      pairReport["from"] = pair.first.first;
+      pairReport["to"] = pair.first.second;
+      pairReport["sent"] = static_cast<Json::UInt64>(stats.sent);
+      pairReport["received"] = static_cast<Json::UInt64>(stats.received);
+      pairReport["p50"] = percentile(stats.roundTripTimes, 0.5);
+      pairReport["p95"] = percentile(stats.roundTripTimes, 0.95);
+      pairReport["p99"] = percentile(stats.roundTripTimes, 0.99);
+      report["pairs"].append(pairReport);
+      all.insert(all.end(), stats.roundTripTimes.begin(), stats.roundTripTimes.end());
+      sent += stats.sent;
+      received += stats.received;
+    }
+    std::sort(all.begin(), all.end());
+    auto loss = sent > 0 ? 100.0 * (sent - received) / sent : 0.0;
+    std::cout << "all pairs: " << received << "/" << sent << " answered, loss " << loss << " %, "
+              << "p50 " << percentile(all, 0.5) << " ms, "
+              << "p95 " << percentile(all, 0.95) << " ms, "
+              << "p99 " << percentile(all, 0.99) << " ms" << std::endl;
+    report["sent"] = static_cast<Json::UInt64>(sent);
+    report["received"] = static_cast<Json::UInt64>(received);
+    report["loss"] = loss;
+    report["p50"] = percentile(all, 0.5);
+    report["p95"] = percentile(all, 0.95);
+    report["p99"] = percentile(all, 0.99);
+
+    if (before.valid && after.valid)
+    {
+      auto cpuPercent = 100.0 * (after.cpuSeconds - before.cpuSeconds) / wallSeconds;
+      std::cout << "CPU " << cpuPercent << " % of one core"
+                << (_options.subprocess ? " by all adapters" : " including the load generator")
+                << ", resident memory " << after.residentMemory / (1024 * 1024) << " MiB, "
+                << after.residentMemory / 1024 / players.size() << " KiB per adapter" << std::endl;
+      report["cpu_percent"] = cpuPercent;
+      report["resident_memory"] = static_cast<Json::UInt64>(after.residentMemory);
+    }
+    else
+    {
+      std::cout << "CPU and memory of the adapters are unknown on this platform" << std::endl;
+    }
+
+    if (!_options.report.empty())
+    {
+      std::ofstream file(_options.report);
+      file << report.toStyledString();
+      if (!file)
+      {
+        std::cerr << "unable to write " << _options.report << std::endl;
+      }
+    }
+  }
+
+  void _shutdown()
+  {
+    for (auto& player: players)
+    {
+      player->quit();
+    }
+    _process(std::chrono::milliseconds(500));
+    players.clear();
+  }
+
+  LoadOptions _options;
+  std::size_t _rpcConnectedCount{0};
+  std::size_t _pendingRequests{0};
+};
+
+Player::Player(LoadGenerator& generator, int id):
+  id(id),
+  login("Player" + std::to_string(id)),
+  rpcPort(unusedTcpPort()),
+  gpgnetPort(unusedTcpPort()),
+  _generator(generator)
+{
+  rpc.SignalConnected.connect(this, &Player::_onRpcConnected);
+  rpc.SignalDisconnected.connect(this, &Player::_onRpcDisconnected);
+  rpc.setRpcCallback("onIceMsg",
+                     [this](Json::Value const& paramsArray,
+                            Json::Value&,
+                            Json::Value&,
+                            rtc::AsyncSocket*)
+  {
+    _generator.relayIceMessage(this->id, paramsArray[1].asInt(), paramsArray[2]);
+  });
+  rpc.setRpcCallback("onConnected",
+                     [this](Json::Value const& paramsArray,
+                            Json::Value&,
+                            Json::Value&,
+                            rtc::AsyncSocket*)
+  {
+    connected[paramsArray[1].asInt()] = paramsArray[2].asBool();
+  });
+  gpgnet.SignalConnected.connect(this, &Player::_onGpgNetConnected);
+  gpgnet.setCallback(std::bind(&Player::_onGpgNetMessage, this, std::placeholders::_1));
+}
+
+Player::~Player()
+{
+  rpc.disconnect();
+  gpgnet.disconnect();
+  if (process)
+  {
+    process->close();
+  }
+}
+
+void Player::start(std::shared_ptr<faf::PeerConnectionFactory> const& pcfactory)
+{
+  if (pcfactory)
+  {
+    auto options = _generator.adapterOptions(id);
+    options.rpcPort = rpcPort;
+    options.gpgNetPort = gpgnetPort;
+    adapter = std::make_unique<faf::IceAdapter>(options, pcfactory);
+  }
+  else
+  {
+    auto args = splitArgs(_generator.options().adapterArgs);
+    args.insert(args.begin(), {"--id", std::to_string(id),
+                               "--login", login,
+                               "--rpc-port", std::to_string(rpcPort),
+                               "--gpgnet-port", std::to_string(gpgnetPort),
+                               "--log-level", _generator.options().logLevel});
+    process = std::make_unique<faf::Process>();
+#if defined(WEBRTC_POSIX)
+    /* exec keeps the PID of the shell */
+    process->open("echo PID $$; exec " + _generator.options().executable, args);
+#else
+    process->open(_generator.options().executable, args);
+#endif
+  }
+  _connectClients();
+}
+
+void Player::sendPings()
+{
+  if (!lobbySocket)
+  {
+    return;
+  }
+  for (auto const& relay: relayAddresses)
+  {
+    faf::PingPacket packet = {faf::PingPacket::PING,
+                              static_cast<uint32_t>(id),
+                              static_cast<uint32_t>(relay.first),
+                              _pingId};
+    lobbySocket->SendTo(reinterpret_cast<const char*>(&packet), sizeof(packet), relay.second);
+    _generator.onPing(id, relay.first, _pingId);
+  }
+  ++_pingId;
+}
+
+void Player::quit()
+{
+  if (rpc.isConnected())
+  {
+    if (adapter)
+    {
+      /* quit would stop the thread of all in-process adapters */
+      rpc.disconnect();
+    }
+    else
+    {
+      rpc.sendRequest("quit");
+    }
+  }
+}
+
+void Player::_connectClients()
+{
+  if (process && pid == 0)
+  {
+    for (auto const& line: process->checkOutput())
+    {
+      if (line.compare(0, 4, "PID ") == 0)
+      {
+        pid = std::atoi(line.c_str() + 4);
+      }
+    }
+  }
+  rpc.connect("127.0.0.1", rpcPort);
+}
+
+void Player::_onRpcConnected(rtc::AsyncSocket* socket)
+{
+  _generator.onRpcConnected();
+  gpgnet.connect("127.0.0.1", gpgnetPort);
+}
+
+void Player::_onGpgNetConnected(rtc::AsyncSocket* socket)
+{
+  gpgnet.sendMessage({"GameState", {"Idle"}});
+}
+
+void Player::_onRpcDisconnected(rtc::AsyncSocket* socket)
+{
+  /* the subprocess may not listen yet */
+  _retryTimer.singleShot(200, std::bind(&Player::_connectClients, this));
+}
+
+void Player::_onGpgNetMessage(faf::GPGNetMessage const& message)
+{
+  if (message.header == "CreateLobby")
+  {
+    lobbySocket.reset(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+    lobbySocket->SignalReadEvent.connect(this, &Player::_onLobbyRead);
+    lobbySocket->Bind(rtc::SocketAddress("127.0.0.1", message.chunks.at(1).asInt()));
+    gpgnet.sendMessage({"GameState", {"Lobby"}});
+  }
+  else if (message.header == "JoinGame" ||
+           message.header == "ConnectToPeer")
+  {
+    rtc::SocketAddress address;
+    address.FromString(message.chunks.at(0).asString());
+    relayAddresses[message.chunks.at(2).asInt()] = address;
+  }
+}
+
+void Player::_onLobbyRead(rtc::AsyncSocket* socket)
+{
+  int msgLength;
+  while ((msgLength = socket->Recv(_readBuffer.data(), _readBuffer.size(), nullptr)) > 0)
+  {
+    if (static_cast<std::size_t>(msgLength) != sizeof(faf::PingPacket))
+    {
+      continue;
+    }
+    auto packet = reinterpret_cast<faf::PingPacket*>(_readBuffer.data());
+    if (packet->type == faf::PingPacket::PING)
+    {
+      auto relayIt = relayAddresses.find(static_cast<int>(packet->senderId));
+      if (relayIt != relayAddresses.end())
+      {
+        packet->type = faf::PingPacket::PONG;
+        socket->SendTo(_readBuffer.data(), sizeof(faf::PingPacket), relayIt->second);
+      }
+    }
+    else if (packet->type == faf::PingPacket::PONG)
+    {
+      _generator.onPong(id, static_cast<int>(packet->answererId), packet->pingId);
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  LoadOptions loadOptions;
+  cxxopts::Options options("faf-ice-loadgen", "Connects ice-adapters in a full mesh, sends game packets through all relays and reports round trip times, loss, CPU and memory");
+  options.add_options()
+    ("help", "Show this help message")
+    ("adapters", "number of ice-adapters (default: 12)", cxxopts::value<int>(loadOptions.adapters))
+    ("subprocess", "run every ice-adapter as a subprocess instead of in this process", cxxopts::value<bool>(loadOptions.subprocess))
+    ("executable", "the ice-adapter executable for --subprocess (default: ./faf-ice-adapter)", cxxopts::value<std::string>(loadOptions.executable))
+    ("adapter-args", "additional ice-adapter options, e.g. \"--direct-udp lan\"", cxxopts::value<std::string>(loadOptions.adapterArgs))
+    ("ice-server", "STUN or TURN server URL passed to all adapters (default: none, host candidates only)", cxxopts::value<std::string>(loadOptions.iceServer))
+    ("duration", "seconds to send game packets (default: 30)", cxxopts::value<int>(loadOptions.duration))
+    ("ping-interval", "milliseconds between the PingPackets sent through every relay (default: 20)", cxxopts::value<int>(loadOptions.pingInterval))
+    ("connect-timeout", "seconds to wait for the mesh to connect (default: 60)", cxxopts::value<int>(loadOptions.connectTimeout))
+    ("log-level", "log level of the load generator and the adapters (default: error)", cxxopts::value<std::string>(loadOptions.logLevel))
+    ("report", "write the results as JSON to this file", cxxopts::value<std::string>(loadOptions.report))
+    ;
+  options.parse(argc, argv);
+  if (options.count("help"))
+  {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+  if (loadOptions.adapters < 2 ||
+      loadOptions.duration < 1 ||
+      loadOptions.pingInterval < 1)
+  {
+    std::cerr << "Error: need at least 2 adapters, a duration and a ping interval\n" << std::endl;
+    std::cout << options.help() << std::endl;
+    return 1;
+  }
+
+  faf::logging_init(loadOptions.logLevel);
+  if (!rtc::InitializeSSL())
+  {
+    std::cerr << "Error in InitializeSSL()";
+    return 1;
+  }
+  int result;
+  {
+    LoadGenerator generator(loadOptions);
+    result = generator.run();
+  }
+  rtc::CleanupSSL();
+  return result;
+}
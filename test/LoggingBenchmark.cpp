@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <webrtc/rtc_base/logging.h>
+
+#include "AsyncLogSink.h"
+#include "logging.h"
+
+/* a log file on a slow disk: every few records the write blocks for a while */
+class StallingSink : public rtc::LogSink
+{
+public:
+  StallingSink(std::size_t stallEvery, std::chrono::milliseconds stall):
+    _stallEvery(stallEvery),
+    _stall(stall)
+  {
+  }
+
+  void OnLogMessage(std::string const& message) override
+  {
+    _bytes += message.size();
+    if (++_messages % _stallEvery == 0)
+    {
+      std::this_thread::sleep_for(_stall);
+    }
+  }
+
+protected:
+  std::size_t _stallEvery;
+  std::chrono::milliseconds _stall;
+  std::size_t _messages{0};
+  std::size_t _bytes{0};
+};
+
+/* bursts of debug logs like during a reconnect, with short pauses in between */
+static void benchmark(std::string const& name,
+                      rtc::LogSink* sink,
+                      std::size_t bursts,
+                      std::size_t burstSize)
+{
+  rtc::LogMessage::AddLogToStream(sink, rtc::LS_VERBOSE);
+  std::vector<double> callTimes;
+  callTimes.reserve(bursts * burstSize);
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t burst = 0; burst < bursts; ++burst)
+  {
+    for (std::size_t i = 0; i < burstSize; ++i)
+    {
+      auto callStart = std::chrono::steady_clock::now();
+      FAF_LOG_DEBUG << "PeerRelay for Player" << i << " (" << i << "): candidate pair changed, burst " << burst;
+      callTimes.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - callStart).count());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  auto wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  rtc::LogMessage::RemoveLogToStream(sink);
+
+  std::sort(callTimes.begin(), callTimes.end());
+  double sum = 0;
+  for (auto callTime: callTimes)
+  {
+    sum += callTime;
+  }
+  std::cout << "  " << name << ": " << callTimes.size() << " calls in " << wallSeconds << " s, "
+            << "mean " << sum / callTimes.size() << " us, "
+            << "p50 " << callTimes[callTimes.size() / 2] << " us, "
+            << "p99 " << callTimes[callTimes.size() * 99 / 100] << " us, "
+            << "p99.9 " << callTimes[callTimes.size() * 999 / 1000] << " us, "
+            << "max " << callTimes.back() << " us" << std::endl;
+}
+
+/* cost of a disabled RELAY_LOG_TRACE like statement, as in PeerRelay::_onPeerdataFromGame */
+static void benchmarkDisabled(std::string const& name,
+                              std::size_t iterations,
+                              std::function<void (std::string const& login, int id, std::size_t i)> statement)
+{
+  std::string login = "Player2";
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i)
+  {
+    statement(login, 2, i);
+  }
+  auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "  " << name << ": " << static_cast<double>(duration) / iterations << " ns/packet" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  /* only the benchmarked sinks receive the records */
+  rtc::LogMessage::LogToDebug(rtc::LS_NONE);
+  rtc::LogMessage::SetLogToStderr(false);
+  rtc::LogMessage::LogTimestamps();
+  rtc::LogMessage::LogThreads();
+
+  const std::size_t packets = 10000000;
+  std::cout << "disabled trace statement with the relay prefix, " << packets << " packets" << std::endl;
+  faf::loggingMinSeverity.store(rtc::LS_INFO);
+  benchmarkDisabled("RTC_LOG gate           ", packets, [](std::string const& login, int id, std::size_t i)
+  {
+    RTC_LOG(LS_SENSITIVE) << "[trace] FAF: " << "PeerRelay for " << login << " (" << id << "): " << "skipping " << i << " bytes";
+  });
+  benchmarkDisabled("FAF_LOG_AT inline gate ", packets, [](std::string const& login, int id, std::size_t i)
+  {
+    FAF_LOG_AT(LS_SENSITIVE, "[trace] FAF: ") << "PeerRelay for " << login << " (" << id << "): " << "skipping " << i << " bytes";
+  });
+  benchmarkDisabled("FAF_LOG_STRIP_DEBUG    ", packets, [](std::string const& login, int id, std::size_t i)
+  {
+    FAF_LOG_COMPILED_OUT(LS_SENSITIVE, "[trace] FAF: ") << "PeerRelay for " << login << " (" << id << "): " << "skipping " << i << " bytes";
+  });
+
+  /* the sinks below accept debug records */
+  faf::loggingMinSeverity.store(rtc::LS_VERBOSE);
+
+  const std::size_t bursts = 50;
+  const std::size_t burstSize = 200;
+  const std::size_t stallEvery = 500;
+  const auto stall = std::chrono::milliseconds(20);
+  std::cout << "latency per FAF_LOG_DEBUG call, " << bursts << " bursts of " << burstSize << " records, "
+            << "the sink blocks " << stall.count() << " ms every " << stallEvery << " records" << std::endl;
+
+  StallingSink synchronousSink(stallEvery, stall);
+  benchmark("synchronous sink ", &synchronousSink, bursts, burstSize);
+
+  std::uint64_t dropped;
+  std::uint64_t written;
+  {
+    faf::AsyncLogSink asyncSink(std::make_unique<StallingSink>(stallEvery, stall));
+    benchmark("AsyncLogSink     ", &asyncSink, bursts, burstSize);
+    /* the destructor writes the remaining queue */
+    dropped = asyncSink.droppedMessages();
+    written = asyncSink.writtenMessages();
+  }
+  std::cout << "  AsyncLogSink dropped " << dropped << " records, " << written << " were written while logging" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,282 @@
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <webrtc/rtc_base/ssladapter.h>
+#include <webrtc/rtc_base/thread.h>
+#include <webrtc/media/engine/webrtcmediaengine.h>
+
+#include "IceAdapterOptions.h"
+#include "PeerConnectionFactory.h"
+#include "PeerRelay.h"
+#include "ThreadSettings.h"
+#include "Timer.h"
+#include "logging.h"
+
+/* Game datagram round trip times in a full mesh of local relays, like a 12 player game,
+ * for different thread layouts, with and without busy threads competing for the CPUs. */
+
+static constexpr std::size_t numPeers = 12;
+static constexpr std::size_t packetSize = 64;
+static constexpr int sendIntervalMs = 10;
+
+/* one simulated game with its lobby socket and a relay to every other peer */
+struct Peer
+{
+  std::unique_ptr<rtc::AsyncSocket> gameSocket;
+  std::map<std::size_t, std::unique_ptr<faf::PeerRelay>> relays;
+};
+
+class Mesh : public sigslot::has_slots<>
+{
+public:
+  Mesh(rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> const& pcfactory)
+  {
+    for (std::size_t i = 0; i < numPeers; ++i)
+    {
+      auto peer = std::make_unique<Peer>();
+      peer->gameSocket.reset(rtc::Thread::Current()->socketserver()->CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+      peer->gameSocket->Bind(rtc::SocketAddress("127.0.0.1", 0));
+      peer->gameSocket->SignalReadEvent.connect(this, &Mesh::_onGameRead);
+      _peers.push_back(std::move(peer));
+    }
+    /* the answerer must exist when the offerer emits its first ICE message */
+    for (bool offerers: {false, true})
+    {
+      for (std::size_t i = 0; i < numPeers; ++i)
+      {
+        for (std::size_t j = 0; j < numPeers; ++j)
+        {
+          if (i == j || (i < j) != offerers)
+          {
+            continue;
+          }
+          faf::PeerRelay::Callbacks callbacks;
+          callbacks.iceMessageCallback = [this, i, j](Json::Value iceMsg)
+          {
+            _peers[j]->relays.at(i)->addIceMessage(iceMsg);
+          };
+          faf::PeerRelay::Options options;
+          options.remotePlayerId = static_cast<int>(j);
+          options.remotePlayerLogin = "Player" + std::to_string(j);
+          options.isOfferer = offerers;
+          options.gameUdpPort = _peers[i]->gameSocket->GetLocalAddress().port();
+          _peers[i]->relays[j] = std::make_unique<faf::PeerRelay>(options, callbacks, pcfactory);
+        }
+      }
+    }
+  }
+
+  bool connected() const
+  {
+    for (auto const& peer: _peers)
+    {
+      for (auto const& relay: peer->relays)
+      {
+        if (!relay.second->isConnected())
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  /* every peer sends a datagram to every other peer each interval, the receiver echoes it */
+  void measure(std::string const& name, std::chrono::seconds duration)
+  {
+    _roundTripTimes.clear();
+    _sent = 0;
+    faf::Timer sendTimer;
+    sendTimer.start(sendIntervalMs, std::bind(&Mesh::_sendPings, this));
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+      rtc::Thread::Current()->ProcessMessages(10);
+    }
+    sendTimer.stop();
+    /* collect the echoes still in flight */
+    auto drainStart = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - drainStart < std::chrono::milliseconds(500))
+    {
+      rtc::Thread::Current()->ProcessMessages(10);
+    }
+
+    if (_roundTripTimes.empty())
+    {
+      std::cout << "  " << name << ": no round trip completed" << std::endl;
+      return;
+    }
+    std::sort(_roundTripTimes.begin(), _roundTripTimes.end());
+    double sum = 0;
+    for (auto rtt: _roundTripTimes)
+    {
+      sum += rtt;
+    }
+    std::cout << "  " << name << ": " << _roundTripTimes.size() << " of " << _sent << " round trips, "
+              << "mean " << sum / _roundTripTimes.size() << " us, "
+              << "p50 " << _roundTripTimes[_roundTripTimes.size() / 2] << " us, "
+              << "p99 " << _roundTripTimes[_roundTripTimes.size() * 99 / 100] << " us, "
+              << "max " << _roundTripTimes.back() << " us" << std::endl;
+  }
+
+protected:
+  enum : std::uint8_t
+  {
+    Ping = 1,
+    Echo = 2
+  };
+
+  void _sendPings()
+  {
+    std::array<std::uint8_t, packetSize> packet{};
+    packet[0] = Ping;
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::memcpy(packet.data() + 1, &now, sizeof(now));
+    for (auto const& peer: _peers)
+    {
+      for (auto const& relay: peer->relays)
+      {
+        peer->gameSocket->SendTo(packet.data(), packet.size(), rtc::SocketAddress("127.0.0.1", relay.second->localUdpSocketPort()));
+        ++_sent;
+      }
+    }
+  }
+
+  void _onGameRead(rtc::AsyncSocket* socket)
+  {
+    rtc::SocketAddress from;
+    int msgLength;
+    while ((msgLength = socket->RecvFrom(_readBuffer.data(), _readBuffer.size(), &from, nullptr)) > 0)
+    {
+      if (static_cast<std::size_t>(msgLength) != packetSize)
+      {
+        continue;
+      }
+      if (_readBuffer[0] == Ping)
+      {
+        /* answer via the relay which delivered the ping */
+        _readBuffer[0] = Echo;
+        socket->SendTo(_readBuffer.data(), packetSize, from);
+      }
+      else if (_readBuffer[0] == Echo)
+      {
+        std::chrono::steady_clock::rep sentTime;
+        std::memcpy(&sentTime, _readBuffer.data() + 1, sizeof(sentTime));
+        auto rtt = std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(sentTime));
+        _roundTripTimes.push_back(std::chrono::duration_cast<std::chrono::microseconds>(rtt).count());
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Peer>> _peers;
+  std::vector<double> _roundTripTimes;
+  std::size_t _sent{0};
+  std::array<std::uint8_t, 2048> _readBuffer;
+};
+
+/* busy threads on every CPU while alive */
+class CpuContention
+{
+public:
+  CpuContention(bool enabled)
+  {
+    if (!enabled)
+    {
+      return;
+    }
+    for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency()); ++i)
+    {
+      _threads.emplace_back([this]()
+      {
+        volatile std::uint64_t counter = 0;
+        while (!_stop.load(std::memory_order_relaxed))
+        {
+          counter = counter + 1;
+        }
+      });
+    }
+  }
+
+  ~CpuContention()
+  {
+    _stop = true;
+    for (auto& thread: _threads)
+    {
+      thread.join();
+    }
+  }
+
+protected:
+  std::atomic<bool> _stop{false};
+  std::vector<std::thread> _threads;
+};
+
+static void run(std::string const& name,
+                rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> const& pcfactory)
+{
+  Mesh mesh(pcfactory);
+  auto start = std::chrono::steady_clock::now();
+  while (!mesh.connected() &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(60))
+  {
+    rtc::Thread::Current()->ProcessMessages(10);
+  }
+  if (!mesh.connected())
+  {
+    std::cout << "  " << name << ": relays did not connect" << std::endl;
+    return;
+  }
+  for (bool contention: {false, true})
+  {
+    CpuContention busyThreads(contention);
+    mesh.measure(name + (contention ? ", CPU contention" : ""), std::chrono::seconds(5));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  faf::logging_init("warn");
+  if (!rtc::InitializeSSL())
+  {
+    std::cerr << "Error in InitializeSSL()";
+    std::exit(1);
+  }
+
+  std::cout << numPeers << " peers in a full mesh, " << packetSize << " byte datagrams every "
+            << sendIntervalMs << " ms to every peer, " << std::thread::hardware_concurrency() << " CPUs" << std::endl;
+  {
+    auto pcfactory = webrtc::CreateModularPeerConnectionFactory(nullptr,
+                                                                nullptr,
+                                                                nullptr,
+                                                                nullptr,
+                                                                nullptr,
+                                                                nullptr);
+    run("libwebrtc thread layout", pcfactory);
+  }
+  {
+    auto options = faf::IceAdapterOptions::init(0, "Player0");
+    faf::PeerConnectionFactory pcfactory(options);
+    run("explicit network and worker threads", pcfactory.factory());
+  }
+  {
+    /* raising the priority usually needs elevated rights, the warnings tell if it failed */
+    auto options = faf::IceAdapterOptions::init(0, "Player0");
+    options.networkThreadPriority = "high";
+    options.gameThreadPriority = "high";
+    faf::PeerConnectionFactory pcfactory(options);
+    faf::threadSettings(options, "game").applyToCurrentThread("game");
+    run("explicit threads, high network and game thread priority", pcfactory.factory());
+  }
+
+  rtc::CleanupSSL();
+  return 0;
+}
@@ -0,0 +1,97 @@
+
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include <webrtc/rtc_base/ssladapter.h>
+#include <webrtc/rtc_base/thread.h>
+#include <webrtc/third_party/jsoncpp/source/include/json/json.h>
+
+#include "IceAdapter.h"
+#include "IceAdapterOptions.h"
+#include "Timer.h"
+#include "logging.h"
+
+static void benchmark(std::string const& name,
+                      std::size_t iterations,
+                      std::function<std::size_t ()> call)
+{
+  std::size_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i)
+  {
+    bytes += call();
+  }
+  auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "  " << name << ": " << duration / 1000. / iterations << " us/call, "
+            << bytes / iterations << " bytes" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  faf::logging_init("warn");
+  if (!rtc::InitializeSSL())
+  {
+    std::cerr << "Error in InitializeSSL()";
+    std::exit(1);
+  }
+
+  auto options = faf::IceAdapterOptions::init(1, "Benchmark");
+  faf::IceAdapter adapter(options);
+
+  Json::Value iceServers(Json::arrayValue);
+  Json::Value iceServer;
+  iceServer["urls"].append("stun:stun.example.com:3478");
+  iceServer["urls"].append("turn:turn.example.com:3478?transport=udp");
+  iceServer["credential"] = "password";
+  iceServer["username"] = "user";
+  iceServers.append(iceServer);
+  adapter.setIceServers(iceServers);
+
+  /* answerer relays only create their peerconnection on the remote offer */
+  for (int remoteId = 2; remoteId <= 13; ++remoteId)
+  {
+    adapter.connectToPeer("Player" + std::to_string(remoteId), remoteId, false);
+  }
+
+  const std::size_t iterations = 10000;
+  std::cout << "status of an adapter with 12 relays, " << iterations << " calls" << std::endl;
+  benchmark("status() + Json::FastWriter", iterations, [&adapter]()
+  {
+    return Json::FastWriter().write(adapter.status()).size();
+  });
+  benchmark("serializedStatus(), unchanged", iterations, [&adapter]()
+  {
+    return adapter.serializedStatus().size();
+  });
+  benchmark("serializedStatus(), adapter state changed before each call", iterations, [&adapter]()
+  {
+    adapter.setLobbyInitMode("normal");
+    return adapter.serializedStatus().size();
+  });
+
+  /* 10 calls every millisecond */
+  std::size_t calls = 0;
+  faf::Timer pollTimer;
+  pollTimer.start(1, [&adapter, &calls]()
+  {
+    for (int i = 0; i < 10; ++i)
+    {
+      adapter.serializedStatus();
+      ++calls;
+    }
+  });
+  auto cpuStart = std::clock();
+  auto wallStart = std::chrono::steady_clock::now();
+  rtc::Thread::Current()->ProcessMessages(2000);
+  auto cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+  auto wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  pollTimer.stop();
+  std::cout << "  polling: " << calls / wallSeconds << " calls/s at "
+            << 100. * cpuSeconds / wallSeconds << " % CPU" << std::endl;
+
+  rtc::CleanupSSL();
+  return 0;
+}